@@ -34,6 +34,8 @@
 #include "armsoc_exa.h"
 
 #include "dri2.h"
+#include "property.h"
+#include <X11/Xatom.h>
 
 /* any point to support earlier? */
 #if DRI2INFOREC_VERSION < 5
@@ -93,6 +95,28 @@ struct ARMSOCDRI2BufferRec {
 	 */
 	int previous_canflip;
 
+	/**
+	 * Place in the screen's list of back buffers, see
+	 * ARMSOCDRI2ReleaseBackBuffers(). The drawable may be gone by the
+	 * time the buffer is destroyed, so the screen is kept here.
+	 */
+	ScreenPtr pScreen;
+	struct ARMSOCDRI2BufferRec *back_prev;
+	struct ARMSOCDRI2BufferRec *back_next;
+
+	/**
+	 * When the buffer was last swapped, or created. With a
+	 * DRI2IdleTimeout the back pixmaps other than the current one are
+	 * released once it is that old.
+	 */
+	CARD32 last_swap;
+
+	/**
+	 * Frame pacing of the swaps of this drawable, published on its
+	 * window with PerfCounters, see publishSwapStats().
+	 */
+	struct armsoc_swap_stats swap_stats;
+	CARD32 stats_published;
 };
 
 #define ARMSOCBUF(p)	((struct ARMSOCDRI2BufferRec *)(p))
@@ -120,6 +144,9 @@ canflip(DrawablePtr pDraw)
 	if (pARMSOC->NoFlip) {
 		/* flipping is disabled by user option */
 		return FALSE;
+	} else if (drmmode_crtcs_shadowed(pScrn)) {
+		/* the CRTCs scan out their shadows, not the screen's fb */
+		return FALSE;
 	} else {
 		return (pDraw->type == DRAWABLE_WINDOW) &&
 				DRI2CanFlip(pDraw);
@@ -214,12 +241,16 @@ static Bool create_buffer(DrawablePtr pDraw, struct ARMSOCDRI2BufferRec *buf)
 	buf->pPixmaps[0] = pPixmap;
 	assert(buf->currentPixmap == 0);
 
-	bo = ARMSOCPixmapBo(pPixmap);
+	/* small pixmaps may still be in system memory, others in cached
+	 * memory */
+	bo = ARMSOCPixmapPromote(pPixmap) ? ARMSOCPixmapBo(pPixmap) : NULL;
 	if (!bo) {
 		ERROR_MSG(
 				"Attempting to DRI2 wrap a pixmap with no DRM buffer object backing");
 		goto fail;
 	}
+	if (buffer->attachment != DRI2BufferFrontLeft)
+		armsoc_bo_set_usage(bo, ARMSOC_USAGE_DRI2);
 
 	DRIBUF(buf)->pitch = exaGetPixmapPitch(pPixmap);
 	DRIBUF(buf)->cpp = pPixmap->drawable.bitsPerPixel / 8;
@@ -274,7 +305,8 @@ fail:
 
 static Bool destroy_buffer(DrawablePtr pDraw, struct ARMSOCDRI2BufferRec *buf)
 {
-	ScreenPtr pScreen = buf->pPixmaps[0]->drawable.pScreen;
+	ScreenPtr pScreen =
+		buf->pPixmaps[buf->currentPixmap]->drawable.pScreen;
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 	DRI2BufferPtr buffer = DRIBUF(buf);
@@ -289,7 +321,11 @@ static Bool destroy_buffer(DrawablePtr pDraw, struct ARMSOCDRI2BufferRec *buf)
 	} else
 		numBuffers = 1;
 
-	for (i = 0; i < numBuffers && buf->pPixmaps[i] != NULL; i++) {
+	/* back pixmaps are allocated lazily and may have been released,
+	 * see ARMSOCDRI2ReleaseBackBuffers() */
+	for (i = 0; i < numBuffers; i++) {
+		if (!buf->pPixmaps[i])
+			continue;
 		ARMSOCDeregisterExternalAccess(buf->pPixmaps[i]);
 		pScreen->DestroyPixmap(buf->pPixmaps[i]);
 	}
@@ -332,9 +368,38 @@ ARMSOCDRI2CreateBuffer(DrawablePtr pDraw, unsigned int attachment,
 		return NULL;
 	}
 
+	if (attachment == DRI2BufferBackLeft) {
+		struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+
+		buf->pScreen = pScreen;
+		buf->last_swap = GetTimeInMillis();
+		buf->back_next = pARMSOC->dri2_back_buffers;
+		if (buf->back_next)
+			buf->back_next->back_prev = buf;
+		pARMSOC->dri2_back_buffers = buf;
+	}
+
 	return DRIBUF(buf);
 }
 
+static void
+unlink_back_buffer(struct ARMSOCDRI2BufferRec *buf)
+{
+	struct ARMSOCRec *pARMSOC;
+
+	if (!buf->pScreen)
+		return;
+
+	pARMSOC = ARMSOCPTR_FROM_SCREEN(buf->pScreen);
+
+	if (buf->back_prev)
+		buf->back_prev->back_next = buf->back_next;
+	else
+		pARMSOC->dri2_back_buffers = buf->back_next;
+	if (buf->back_next)
+		buf->back_next->back_prev = buf->back_prev;
+}
+
 /**
  * Destroy Buffer
  */
@@ -347,18 +412,22 @@ ARMSOCDRI2DestroyBuffer(DrawablePtr pDraw, DRI2BufferPtr buffer)
 	/* Note: pDraw may already be deleted, so use the pPixmap here
 	 * instead (since it is at least refcntd)
 	 */
-	if (NULL == buf->pPixmaps || NULL == buf->pPixmaps[0]) {
-		if (--buf->refcnt == 0)
+	if (NULL == buf->pPixmaps ||
+			NULL == buf->pPixmaps[buf->currentPixmap]) {
+		if (--buf->refcnt == 0) {
+			unlink_back_buffer(buf);
 			free(buf);
+		}
 		return;
 	}
 
-	pScreen = buf->pPixmaps[0]->drawable.pScreen;
+	pScreen = buf->pPixmaps[buf->currentPixmap]->drawable.pScreen;
 	pScrn = xf86ScreenToScrn(pScreen);
 
 	DEBUG_MSG("pDraw=%p, DRIbuffer=%p", pDraw, buffer);
 
 	if (destroy_buffer(pDraw, buf)) {
+		unlink_back_buffer(buf);
 		free(buf->pPixmaps);
 		free(buf);
 	}
@@ -492,6 +561,8 @@ struct ARMSOCDRISwapCmd {
 	struct armsoc_bo *old_dst_bo;  /* Swap chain holds ref on dst bo */
 	struct armsoc_bo *new_scanout; /* scanout to be used after swap */
 	unsigned int swap_id;
+	uint64_t scheduled_us;
+	Bool queued;   /* another flip was pending when this one was made */
 };
 
 static const char * const swap_names[] = {
@@ -506,6 +577,98 @@ struct ARMSOCDRIVBlankCmd {
 	DrawablePtr pDraw;
 };
 
+static uint64_t
+release_back_buffers(ScreenPtr pScreen, CARD32 idle_ms, Bool *spares_left)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCDRI2BufferRec *buf;
+	CARD32 now = GetTimeInMillis();
+	uint64_t start = armsoc_device_total_bytes(pARMSOC->dev);
+	uint64_t freed;
+	unsigned i;
+
+	*spares_left = FALSE;
+
+	for (buf = pARMSOC->dri2_back_buffers; buf; buf = buf->back_next) {
+		/* pending swaps hold a reference */
+		Bool keep = buf->refcnt > 1 || now - buf->last_swap < idle_ms;
+
+		if (!buf->pPixmaps)
+			continue;
+
+		/* numPixmaps may have been cut after an allocation failure,
+		 * but not the array, see destroy_buffer() */
+		for (i = 0; i < pARMSOC->driNumBufs - 1; i++) {
+			PixmapPtr pPixmap = buf->pPixmaps[i];
+
+			if (i == buf->currentPixmap || !pPixmap)
+				continue;
+
+			if (keep) {
+				*spares_left = TRUE;
+				continue;
+			}
+
+			ARMSOCDeregisterExternalAccess(pPixmap);
+			pScreen->DestroyPixmap(pPixmap);
+			buf->pPixmaps[i] = NULL;
+		}
+	}
+
+	/* a pixmap still referenced elsewhere, or whose bo is, gives
+	 * nothing back, so measure what was actually destroyed */
+	armsoc_device_flush_deferred(pARMSOC->dev);
+	freed = start - armsoc_device_total_bytes(pARMSOC->dev);
+	if (freed)
+		DEBUG_MSG("released %llu bytes of DRI2 back buffers",
+				(unsigned long long)freed);
+	return freed;
+}
+
+/**
+ * Destroy the back pixmaps other than the current one of every DRI2
+ * drawable not swapped for idle_ms and without a swap in flight.
+ * nextBuffer() allocates them again when they come round. Returns the
+ * bytes released.
+ */
+uint64_t ARMSOCDRI2ReleaseBackBuffers(ScreenPtr pScreen, CARD32 idle_ms)
+{
+	Bool spares_left;
+
+	return release_back_buffers(pScreen, idle_ms, &spares_left);
+}
+
+static CARD32
+ARMSOCDRI2IdleTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+	ScreenPtr pScreen = arg;
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR_FROM_SCREEN(pScreen);
+	CARD32 timeout = pARMSOC->DRI2IdleTimeout * 1000;
+	Bool spares_left;
+
+	release_back_buffers(pScreen, timeout, &spares_left);
+
+	/* stay quiet while there is nothing left to release, until
+	 * allocNextBuffer() creates another spare */
+	pARMSOC->dri2_idle_armed = spares_left;
+	return spares_left ? max(timeout / 2, 1000) : 0;
+}
+
+static void
+ARMSOCDRI2ArmIdleTimer(ScreenPtr pScreen)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR_FROM_SCREEN(pScreen);
+	CARD32 timeout = pARMSOC->DRI2IdleTimeout * 1000;
+
+	if (!timeout || pARMSOC->dri2_idle_armed)
+		return;
+
+	pARMSOC->dri2_idle_timer = TimerSet(pARMSOC->dri2_idle_timer, 0,
+			max(timeout / 2, 1000), ARMSOCDRI2IdleTimer, pScreen);
+	pARMSOC->dri2_idle_armed = TRUE;
+}
+
 static Bool allocNextBuffer(DrawablePtr pDraw, PixmapPtr *ppPixmap,
 		uint32_t *name) {
 	ScreenPtr pScreen = pDraw->pScreen;
@@ -521,15 +684,17 @@ static Bool allocNextBuffer(DrawablePtr pDraw, PixmapPtr *ppPixmap,
 	if (!pPixmap)
 		goto error;
 
-	bo = ARMSOCPixmapBo(pPixmap);
+	bo = ARMSOCPixmapPromote(pPixmap) ? ARMSOCPixmapBo(pPixmap) : NULL;
 	if (!bo) {
 		WARNING_MSG(
 			"Attempting to DRI2 wrap a pixmap with no DRM buffer object backing");
 		goto error;
 	}
 
+	armsoc_bo_set_usage(bo, ARMSOC_USAGE_DRI2);
 	ARMSOCRegisterExternalAccess(pPixmap);
 	extRegistered = TRUE;
+	ARMSOCDRI2ArmIdleTimer(pScreen);
 
 	ret = armsoc_bo_get_name(bo, &new_name);
 	if (ret) {
@@ -594,16 +759,26 @@ static void nextBuffer(DrawablePtr pDraw, struct ARMSOCDRI2BufferRec *backBuf)
 		ret = allocNextBuffer(pDraw, curBackPix,
 			&DRIBUF(backBuf)->name);
 		if (!ret) {
-			/* can't have failed on the first buffer */
-			assert(backBuf->currentPixmap > 0);
-			/* Fall back to last buffer */
-			backBuf->currentPixmap--;
+			unsigned failed = backBuf->currentPixmap;
+
+			/* Fall back to the last buffer, which is never
+			 * released */
+			backBuf->currentPixmap = (failed + backBuf->numPixmaps - 1)
+					% backBuf->numPixmaps;
+			if (failed == 0) {
+				/* the first buffer was released, see
+				 * ARMSOCDRI2ReleaseBackBuffers(); retry on the
+				 * next swap */
+				WARNING_MSG(
+					"Failed to reallocate a back buffer, reusing the current one");
+				return;
+			}
 			WARNING_MSG(
 				"Failed to use the requested %d-buffering due to an allocation failure.\n"
 				"Falling back to %d-buffering for this DRI2Drawable",
 				backBuf->numPixmaps+1,
-				backBuf->currentPixmap+2);
-			backBuf->numPixmaps = backBuf->currentPixmap+1;
+				failed+1);
+			backBuf->numPixmaps = failed;
 		}
 	}
 }
@@ -671,6 +846,36 @@ ARMSOCDRI2ResizeSwapChain(ScrnInfoPtr pScrn, struct armsoc_bo *old_bo,
 	}
 }
 
+/**
+ * Publish the swap statistics of a drawable on its window with
+ * PerfCounters, at most once every ARMSOC_PERF_PUBLISH_MS.
+ */
+static void
+publishSwapStats(ScrnInfoPtr pScrn, struct ARMSOCDRI2BufferRec *src,
+		XID draw_id)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	CARD32 now = GetTimeInMillis();
+	DrawablePtr pDraw;
+	char buf[512];
+	int len;
+
+	if (!pARMSOC->PerfCounters ||
+			now - src->stats_published < ARMSOC_PERF_PUBLISH_MS)
+		return;
+
+	if (dixLookupDrawable(&pDraw, draw_id, serverClient,
+			M_ANY, DixWriteAccess) == Success &&
+			pDraw->type == DRAWABLE_WINDOW) {
+		len = armsoc_swap_stats_format(&src->swap_stats,
+				buf, sizeof(buf));
+		dixChangeWindowProperty(serverClient,
+				(WindowPtr)pDraw, pARMSOC->swap_atom,
+				XA_STRING, 8, PropModeReplace, len, buf,
+				TRUE);
+	}
+	src->stats_published = now;
+}
 
 void
 ARMSOCDRI2SwapComplete(struct ARMSOCDRISwapCmd *cmd)
@@ -703,6 +908,21 @@ ARMSOCDRI2SwapComplete(struct ARMSOCDRISwapCmd *cmd)
 			   (cmd->flags & ARMSOC_SWAP_FAKE_FLIP) == 0) {
 				assert(cmd->type == DRI2_FLIP_COMPLETE);
 				set_scanout_bo(pScrn, cmd->new_scanout);
+			} else if (cmd->type != DRI2_FLIP_COMPLETE) {
+				/* flips are accounted in FlipComplete */
+				struct ARMSOCDRI2BufferRec *src =
+						ARMSOCBUF(cmd->pSrcBuffer);
+				int exchange =
+					cmd->type == DRI2_EXCHANGE_COMPLETE;
+				uint64_t done_us = armsoc_perf_now_us();
+
+				armsoc_swap_stats_copy(&pARMSOC->swap_stats,
+						exchange, cmd->scheduled_us,
+						done_us);
+				armsoc_swap_stats_copy(&src->swap_stats,
+						exchange, cmd->scheduled_us,
+						done_us);
+				publishSwapStats(pScrn, src, cmd->draw_id);
 			}
 		} else {
 			ERROR_MSG("dixLookupDrawable fail on swap complete");
@@ -732,6 +952,37 @@ ARMSOCDRI2SwapComplete(struct ARMSOCDRISwapCmd *cmd)
 	free(cmd);
 }
 
+/**
+ * Called from the page flip event of a flip scheduled by ScheduleSwap.
+ * The flip is accounted in the swap statistics of the screen and of the
+ * drawable, by the kernel's timestamp of the vblank it landed on, once
+ * the last CRTC has flipped. Blits and exchanges are accounted in
+ * ARMSOCDRI2SwapComplete().
+ */
+void
+ARMSOCDRI2FlipComplete(struct ARMSOCDRISwapCmd *cmd, unsigned int sequence,
+		unsigned int tv_sec, unsigned int tv_usec)
+{
+	ScreenPtr pScreen = cmd->pScreen;
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCDRI2BufferRec *src = ARMSOCBUF(cmd->pSrcBuffer);
+	uint64_t flip_us = (uint64_t)tv_sec * 1000000 + tv_usec;
+
+	if (cmd->swapCount > 1 || (cmd->flags & ARMSOC_SWAP_FAIL)) {
+		ARMSOCDRI2SwapComplete(cmd);
+		return;
+	}
+
+	armsoc_swap_stats_flip(&pARMSOC->swap_stats, cmd->queued,
+			cmd->scheduled_us, flip_us, sequence);
+	armsoc_swap_stats_flip(&src->swap_stats, cmd->queued,
+			cmd->scheduled_us, flip_us, sequence);
+	publishSwapStats(pScrn, src, cmd->draw_id);
+
+	ARMSOCDRI2SwapComplete(cmd);
+}
+
 /**
  * ScheduleSwap is responsible for requesting a DRM vblank event for the
  * appropriate frame.
@@ -793,6 +1044,9 @@ ARMSOCDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 	ARMSOCDRI2ReferenceBuffer(pSrcBuffer);
 	ARMSOCDRI2ReferenceBuffer(pDstBuffer);
 
+	src->last_swap = GetTimeInMillis();
+	cmd->scheduled_us = armsoc_perf_now_us();
+
 	src_bo = boFromBuffer(pSrcBuffer);
 	dst_bo = boFromBuffer(pDstBuffer);
 
@@ -855,13 +1109,31 @@ ARMSOCDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 	if (do_flip) {
 		DEBUG_MSG("FLIPPING:  FB%d -> FB%d", src_fb_id, dst_fb_id);
 		cmd->type = DRI2_FLIP_COMPLETE;
+		ARMSOC_PERF_INC(ARMSOC_PERF_SWAP_FLIP);
+		ARMSOC_TRACE(swap_flip, "draw=0x%x cmd=%p fb=%d",
+				(unsigned int)pDraw->id, cmd, src_fb_id);
 
 		/* Add swap operation to the swap chain */
 		cmd->swap_id = pARMSOC->swap_chain_count++;
 		idx = cmd->swap_id % pARMSOC->swap_chain_size;
-		if (NULL != pARMSOC->swap_chain[idx])
+		if (NULL != pARMSOC->swap_chain[idx]) {
 			WARNING_MSG("Flip is called too fast\n");
+			pARMSOC->swap_stats.too_fast++;
+			src->swap_stats.too_fast++;
+		}
 		pARMSOC->swap_chain[idx] = cmd;
+		if (pARMSOC->pending_flips) {
+			cmd->queued = TRUE;
+			pARMSOC->swap_stats.queued++;
+			src->swap_stats.queued++;
+			/* more flips in flight than there are back buffers */
+			if (pARMSOC->drmmode_interface->use_early_display &&
+					pARMSOC->pending_flips >=
+					pARMSOC->driNumBufs - 1) {
+				pARMSOC->swap_stats.early_display++;
+				src->swap_stats.early_display++;
+			}
+		}
 		/* TODO: MIDEGL-1461: Handle rollback if multiple CRTC flip is
 		 * only partially successful
 		 */
@@ -919,6 +1191,9 @@ ARMSOCDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 				ARMSOCDRI2SwapComplete(cmd);
 		}
 	} else if (canexchange(pDraw, src_bo, dst_bo)) {
+		ARMSOC_PERF_INC(ARMSOC_PERF_SWAP_EXCHANGE);
+		ARMSOC_TRACE(swap_exchange, "draw=0x%x cmd=%p",
+				(unsigned int)pDraw->id, cmd);
 		exchangebufs(pDraw, pSrcBuffer, pDstBuffer);
 		if (pSrcBuffer->attachment == DRI2BufferBackLeft)
 			nextBuffer(pDraw, ARMSOCBUF(pSrcBuffer));
@@ -943,6 +1218,9 @@ ARMSOCDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 		RegionRec region;
 
 		DEBUG_MSG("BLITTING");
+		ARMSOC_PERF_INC(ARMSOC_PERF_SWAP_BLIT);
+		ARMSOC_TRACE(swap_blit, "draw=0x%x cmd=%p",
+				(unsigned int)pDraw->id, cmd);
 		RegionInit(&region, &box, 0);
 		ARMSOCDRI2CopyRegion(pDraw, &region, pDstBuffer, pSrcBuffer);
 		cmd->type = DRI2_BLIT_COMPLETE;
@@ -1172,6 +1450,10 @@ ARMSOCDRI2CloseScreen(ScreenPtr pScreen)
 	}
 	DRI2CloseScreen(pScreen);
 
+	TimerFree(pARMSOC->dri2_idle_timer);
+	pARMSOC->dri2_idle_timer = NULL;
+	pARMSOC->dri2_idle_armed = FALSE;
+
 	if (pARMSOC->swap_chain) {
 		unsigned int idx = pARMSOC->swap_chain_count % pARMSOC->swap_chain_size;
 		assert(!pARMSOC->swap_chain[idx]);
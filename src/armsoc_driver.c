@@ -41,10 +41,12 @@
 #include <sys/mman.h>
 
 #include <pixman.h>
+#include <X11/Xatom.h>
 
 #include "armsoc_driver.h"
 
 #include "micmap.h"
+#include "property.h"
 
 #include "xf86cmap.h"
 #include "xf86RandR12.h"
@@ -55,6 +57,10 @@
 
 #define DRM_DEVICE "/dev/dri/card%d"
 
+/* Back buffers of drawables swapped more recently than this survive
+ * eviction when DRI2IdleTimeout is unset */
+#define EVICT_DRI2_IDLE_MS 3000
+
 Bool armsocDebug;
 
 /*
@@ -112,6 +118,17 @@ enum {
 	OPTION_UMP_LOCK,
 	OPTION_NO_G2D,
 	OPTION_NO_HARDWARE_MOUSE,
+	OPTION_INIT_FROM_KMS,
+	OPTION_SCANOUT_HEADROOM,
+	OPTION_PIXMAP_MIGRATION,
+	OPTION_SMALL_PIXMAP_THRESHOLD,
+	OPTION_PIXMAP_SLABS,
+	OPTION_MAP_BUDGET,
+	OPTION_MEMORY_BUDGET,
+	OPTION_DRI2_IDLE_TIMEOUT,
+	OPTION_PERF_COUNTERS,
+	OPTION_TRACE_MARKER,
+	OPTION_PROFILE_FILE,
 };
 
 /** Supported options. */
@@ -126,6 +143,17 @@ static const OptionInfoRec ARMSOCOptions[] = {
 	{ OPTION_UMP_LOCK,   "UMP_LOCK",   OPTV_BOOLEAN, {0}, FALSE },
 	{ OPTION_NO_G2D,    "NoG2D",     OPTV_BOOLEAN,{ 0 }, FALSE },
 	{ OPTION_NO_HARDWARE_MOUSE,    "NoHardwareMouse",     OPTV_BOOLEAN,{ 0 }, FALSE },
+	{ OPTION_INIT_FROM_KMS, "InitFromKMS", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_SCANOUT_HEADROOM, "ScanoutHeadroom", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_PIXMAP_MIGRATION, "PixmapMigration", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_SMALL_PIXMAP_THRESHOLD, "SmallPixmapThreshold", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_PIXMAP_SLABS, "PixmapSlabs", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_MAP_BUDGET, "MapBudget", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_MEMORY_BUDGET, "MemoryBudget", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_DRI2_IDLE_TIMEOUT, "DRI2IdleTimeout", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_PERF_COUNTERS, "PerfCounters", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_TRACE_MARKER, "TraceMarker", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_PROFILE_FILE, "ProfileFile", OPTV_STRING, {0}, FALSE },
 	{ -1,                NULL,         OPTV_NONE,    {0}, FALSE }
 };
 
@@ -364,7 +392,7 @@ static Bool ARMSOCCopyFB(ScrnInfoPtr pScrn, const char *fb_dev)
 	pixman_bool_t pixman_ret;
 	Bool ret = FALSE;
 
-	dst = armsoc_bo_map(pARMSOC->scanout);
+	dst = armsoc_bo_map_prefault(pARMSOC->scanout);
 	if (!dst) {
 		ERROR_MSG("Couldn't map scanout bo");
 		goto exit;
@@ -486,6 +514,100 @@ exit:
 }
 
 
+/* Initialize the scanout from whatever KMS is displaying when the server
+ * starts. The current framebuffer is imported as a bo and copied with the
+ * EXA backend's blitter, which also converts between formats, falling back
+ * to the CPU if the backend can't do it.
+ */
+static Bool ARMSOCCopyKMSFB(ScrnInfoPtr pScrn)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCEXARec *pARMSOCEXA = pARMSOC->pARMSOCEXA;
+	struct armsoc_bo *src;
+	unsigned char *src_map, *dst_map;
+	int x, y, width, height;
+	int dst_width, dst_height, dst_bpp, dst_pitch;
+	pixman_bool_t pixman_ret;
+	Bool ret = FALSE;
+
+	src = drmmode_get_current_fb(pScrn, &x, &y, &width, &height);
+	if (!src) {
+		ERROR_MSG("No framebuffer to initialize from");
+		return FALSE;
+	}
+
+	dst_width = armsoc_bo_width(pARMSOC->scanout);
+	dst_height = armsoc_bo_height(pARMSOC->scanout);
+	dst_bpp = armsoc_bo_bpp(pARMSOC->scanout);
+	dst_pitch = armsoc_bo_pitch(pARMSOC->scanout);
+
+	width = min(width, dst_width);
+	height = min(height, dst_height);
+
+	/* clear any area not covered by the copy; usually free as the
+	 * scanout is still known to be zero
+	 */
+	if ((width < dst_width || height < dst_height) &&
+			armsoc_bo_clear(pARMSOC->scanout)) {
+		ERROR_MSG("Couldn't clear scanout bo");
+		goto exit;
+	}
+
+	dst_map = armsoc_bo_map(pARMSOC->scanout);
+	if (!dst_map) {
+		ERROR_MSG("Couldn't map scanout bo");
+		goto exit;
+	}
+
+	if (armsoc_bo_cpu_prep(pARMSOC->scanout, ARMSOC_GEM_WRITE)) {
+		ERROR_MSG("Couldn't synchronise access to scanout bo");
+		goto exit;
+	}
+
+	if (pARMSOCEXA && pARMSOCEXA->CopyBo &&
+			pARMSOCEXA->CopyBo(pScrn, src, x, y, pARMSOC->scanout,
+					0, 0, width, height)) {
+		ret = TRUE;
+		goto fini;
+	}
+
+	/* pixman_blt can't convert formats */
+	if (armsoc_bo_bpp(src) != dst_bpp ||
+			armsoc_bo_depth(src) != armsoc_bo_depth(pARMSOC->scanout)) {
+		ERROR_MSG("Format of current framebuffer does not match scanout buffer");
+		goto fini;
+	}
+
+	if (armsoc_bo_pitch(src) % sizeof(uint32_t) ||
+			dst_pitch % sizeof(uint32_t)) {
+		ERROR_MSG(
+				"Buffer strides need to be a multiple of 4 bytes to initialize from KMS");
+		goto fini;
+	}
+
+	src_map = armsoc_bo_map(src);
+	if (!src_map) {
+		ERROR_MSG("Couldn't map current framebuffer");
+		goto fini;
+	}
+
+	pixman_ret = pixman_blt((uint32_t *)src_map, (uint32_t *)dst_map,
+			armsoc_bo_pitch(src) / sizeof(uint32_t),
+			dst_pitch / sizeof(uint32_t),
+			dst_bpp, dst_bpp, x, y, 0, 0, width, height);
+	if (!pixman_ret) {
+		ERROR_MSG("Pixman failed to blit current framebuffer to scanout buffer");
+		goto fini;
+	}
+
+	ret = TRUE;
+
+fini:
+	armsoc_bo_cpu_fini(pARMSOC->scanout, 0);
+exit:
+	armsoc_bo_unreference(src);
+	return ret;
+}
 
 /** Let the XFree86 code know the Setup() function. */
 static MODULESETUPPROTO(ARMSOCSetup);
@@ -775,6 +897,11 @@ ARMSOCPreInit(ScrnInfoPtr pScrn, int flags)
 	rgb defaultMask = { 0, 0, 0 };
 	Gamma defaultGamma = { 0.0, 0.0, 0.0 };
 	int driNumBufs;
+	int smallPixmapThreshold;
+	int mapBudget;
+	int memoryBudget;
+	int dri2IdleTimeout;
+	const char *profileFile;
 
 	TRACE_ENTER();
 
@@ -851,7 +978,8 @@ ARMSOCPreInit(ScrnInfoPtr pScrn, int flags)
 
 	/* create DRM device instance: */
 	pARMSOC->dev = armsoc_device_new(pARMSOC->drmFD,
-			pARMSOC->drmmode_interface->create_custom_gem);
+			pARMSOC->drmmode_interface->create_custom_gem,
+			pARMSOC->drmmode_interface->get_pitch);
 
 	/* set chipset name: */
 	pScrn->chipset = (char *)ARMSOC_CHIPSET_NAME;
@@ -906,6 +1034,87 @@ ARMSOCPreInit(ScrnInfoPtr pScrn, int flags)
 		OPTION_NO_HARDWARE_MOUSE, FALSE);
 	INFO_MSG("Hardware Mouse is %s",
 		pARMSOC->NoHardwareMouse ? "Disabled" : "Enabled");
+	pARMSOC->ScanoutHeadroom = xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+		OPTION_SCANOUT_HEADROOM, FALSE);
+	INFO_MSG("Scanout headroom is %s",
+		pARMSOC->ScanoutHeadroom ? "Enabled" : "Disabled");
+	pARMSOC->PixmapMigration = xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+		OPTION_PIXMAP_MIGRATION, FALSE);
+	INFO_MSG("Pixmap migration is %s",
+		pARMSOC->PixmapMigration ? "Enabled" : "Disabled");
+	if (!xf86GetOptValInteger(pARMSOC->pOptionInfo,
+			OPTION_SMALL_PIXMAP_THRESHOLD, &smallPixmapThreshold) ||
+			smallPixmapThreshold < 0)
+		smallPixmapThreshold = 0;
+	pARMSOC->SmallPixmapThreshold = smallPixmapThreshold;
+	if (pARMSOC->SmallPixmapThreshold)
+		INFO_MSG("Pixmaps up to %u bytes are kept in system memory",
+			pARMSOC->SmallPixmapThreshold);
+	pARMSOC->PixmapSlabs = xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+		OPTION_PIXMAP_SLABS, FALSE);
+	if (pARMSOC->PixmapSlabs && pARMSOC->useUmplock) {
+		/* umplock identifies buffers by their flink name */
+		WARNING_MSG("PixmapSlabs can't be used with UMP_LOCK");
+		pARMSOC->PixmapSlabs = FALSE;
+	}
+	INFO_MSG("Pixmap slabs are %s",
+		pARMSOC->PixmapSlabs ? "Enabled" : "Disabled");
+	if (!xf86GetOptValInteger(pARMSOC->pOptionInfo, OPTION_MAP_BUDGET,
+			&mapBudget) || mapBudget < 0)
+		mapBudget = 0;
+	pARMSOC->MapBudget = mapBudget;
+	armsoc_device_set_map_budget(pARMSOC->dev,
+		(uint64_t)pARMSOC->MapBudget << 20);
+	if (pARMSOC->MapBudget)
+		INFO_MSG("Buffer mappings are limited to %u MB",
+			pARMSOC->MapBudget);
+	if (!xf86GetOptValInteger(pARMSOC->pOptionInfo, OPTION_MEMORY_BUDGET,
+			&memoryBudget) || memoryBudget < 0)
+		memoryBudget = 0;
+	pARMSOC->MemoryBudget = memoryBudget;
+	armsoc_device_set_budget(pARMSOC->dev,
+		(uint64_t)pARMSOC->MemoryBudget << 20);
+	if (pARMSOC->MemoryBudget)
+		INFO_MSG("Graphics memory budget is %u MB",
+			pARMSOC->MemoryBudget);
+	if (!xf86GetOptValInteger(pARMSOC->pOptionInfo,
+			OPTION_DRI2_IDLE_TIMEOUT, &dri2IdleTimeout) ||
+			dri2IdleTimeout < 0)
+		dri2IdleTimeout = 0;
+	pARMSOC->DRI2IdleTimeout = dri2IdleTimeout;
+	if (pARMSOC->DRI2IdleTimeout && pARMSOC->driNumBufs > 2)
+		INFO_MSG("Spare DRI2 back buffers are released after %u s without a swap",
+			pARMSOC->DRI2IdleTimeout);
+	pARMSOC->PerfCounters = xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+		OPTION_PERF_COUNTERS, FALSE);
+	if (pARMSOC->PerfCounters)
+		INFO_MSG("Performance counters are published in _ARMSOC_COUNTERS");
+	if (xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+			OPTION_TRACE_MARKER, FALSE)) {
+		int ret = armsoc_trace_open();
+
+		if (ret)
+			WARNING_MSG("Cannot open trace_marker: %s",
+					strerror(-ret));
+		else {
+			pARMSOC->TraceMarker = TRUE;
+			INFO_MSG("Trace points are written to trace_marker");
+		}
+	}
+	profileFile = xf86GetOptValString(pARMSOC->pOptionInfo,
+			OPTION_PROFILE_FILE);
+	if (profileFile) {
+		int ret = armsoc_profile_open(profileFile);
+
+		if (ret)
+			WARNING_MSG("Cannot profile pixmaps and bos: %s",
+					strerror(-ret));
+		else {
+			pARMSOC->Profile = TRUE;
+			INFO_MSG("Pixmap and bo profile is written to %s at exit and on SIGUSR2",
+					profileFile);
+		}
+	}
 	/*
 	 * Select the video modes:
 	 */
@@ -966,6 +1175,46 @@ fail:
 /**
  * Initialize EXA and DRI2
  */
+/* Fill hook for the bo layer, forwarded to the EXA backend */
+static int
+ARMSOCFillBo(void *data, struct armsoc_bo *bo, uint32_t color)
+{
+	ScrnInfoPtr pScrn = data;
+	struct ARMSOCEXARec *pARMSOCEXA = ARMSOCPTR(pScrn)->pARMSOCEXA;
+
+	if (!pARMSOCEXA || !pARMSOCEXA->FillBo ||
+			!pARMSOCEXA->FillBo(pScrn, bo, color))
+		return -1;
+	return 0;
+}
+
+/*
+ * Evict hook for the bo layer, called when allocations near
+ * MemoryBudget or one failed. Spare DRI2 back buffers of drawables not
+ * swapped for a while go first, as they are reallocated only if
+ * swapping needs them, then pixmaps nobody has used for a while move
+ * to system memory.
+ */
+static void
+ARMSOCEvict(void *data, uint64_t bytes)
+{
+	ScreenPtr pScreen = data;
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	CARD32 idle_ms = pARMSOC->DRI2IdleTimeout ?
+			pARMSOC->DRI2IdleTimeout * 1000 : EVICT_DRI2_IDLE_MS;
+	uint64_t freed = 0;
+
+	/* windows still drawing would only allocate their spares again */
+	if (pARMSOC->dri)
+		freed = ARMSOCDRI2ReleaseBackBuffers(pScreen, idle_ms);
+	if (freed < bytes)
+		freed += ARMSOCEvictPixmaps(pScreen, bytes - freed);
+
+	DEBUG_MSG("evicted %llu of %llu bytes", (unsigned long long)freed,
+			(unsigned long long)bytes);
+}
+
 static void
 ARMSOCAccelInit(ScreenPtr pScreen)
 {
@@ -980,6 +1229,12 @@ ARMSOCAccelInit(ScreenPtr pScreen)
 		pARMSOC->dri = ARMSOCDRI2ScreenInit(pScreen);
 	else
 		pARMSOC->dri = FALSE;
+
+	if (pARMSOC->pARMSOCEXA && pARMSOC->pARMSOCEXA->FillBo)
+		armsoc_device_set_fill(pARMSOC->dev, ARMSOCFillBo, pScrn);
+
+	if (pARMSOC->pARMSOCEXA)
+		armsoc_device_set_evict(pARMSOC->dev, ARMSOCEvict, pScreen);
 }
 
 /**
@@ -1000,6 +1255,8 @@ ARMSOCScreenInit(SCREEN_INIT_ARGS_DECL)
 	int j;
 	const char *fbdev;
 	int depth;
+	int width, height;
+	uint32_t old_fb_id;
 
 	TRACE_ENTER();
 
@@ -1017,19 +1274,39 @@ ARMSOCScreenInit(SCREEN_INIT_ARGS_DECL)
 	 */
 	depth = pScrn->bitsPerPixel;
 
+	/* With headroom the scanout is allocated big enough for any
+	 * configuration of the connected outputs, then re-described
+	 * in place on every resize.
+	 */
+	width = pScrn->virtualX;
+	height = pScrn->virtualY;
+	if (pARMSOC->ScanoutHeadroom) {
+		drmmode_get_max_size(pScrn, &width, &height);
+		width = max(width, pScrn->virtualX);
+		height = max(height, pScrn->virtualY);
+	}
+
 	/* Allocate initial scanout buffer.*/
 	DEBUG_MSG("allocating new scanout buffer: %dx%d %d %d",
-			pScrn->virtualX, pScrn->virtualY,
+			width, height,
 			depth, pScrn->bitsPerPixel);
 	assert(!pARMSOC->scanout);
 	/* Screen creates and takes a ref on the scanout bo */
-	pARMSOC->scanout = armsoc_bo_new_with_dim(pARMSOC->dev, pScrn->virtualX,
-			pScrn->virtualY, depth, pScrn->bitsPerPixel,
+	pARMSOC->scanout = armsoc_bo_new_with_dim(pARMSOC->dev, width,
+			height, depth, pScrn->bitsPerPixel,
 			ARMSOC_BO_SCANOUT);
 	if (!pARMSOC->scanout) {
 		ERROR_MSG("Cannot allocate scanout buffer\n");
 		goto fail1;
 	}
+	if ((width != pScrn->virtualX || height != pScrn->virtualY) &&
+			armsoc_bo_resize_fb(pARMSOC->scanout,
+				pScrn->virtualX, pScrn->virtualY, &old_fb_id)) {
+		ERROR_MSG("Cannot resize scanout buffer\n");
+		armsoc_bo_unreference(pARMSOC->scanout);
+		pARMSOC->scanout = NULL;
+		goto fail1;
+	}
 	pScrn->displayWidth = armsoc_bo_pitch(pARMSOC->scanout) /
 			((pScrn->bitsPerPixel+7) / 8);
 	xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
@@ -1116,7 +1393,14 @@ ARMSOCScreenInit(SCREEN_INIT_ARGS_DECL)
 
 	fbdev = xf86GetOptValString(pARMSOC->pOptionInfo,
 			OPTION_INIT_FROM_FBDEV);
-	if (fbdev && *fbdev != '\0') {
+	if (xf86ReturnOptValBool(pARMSOC->pOptionInfo,
+			OPTION_INIT_FROM_KMS, FALSE)) {
+		if (ARMSOCCopyKMSFB(pScrn)) {
+			/* Only allow None BG root if we initialized the scanout
+			 * buffer */
+			pScreen->canDoBGNoneRoot = TRUE;
+		}
+	} else if (fbdev && *fbdev != '\0') {
 		if (ARMSOCCopyFB(pScrn, fbdev)) {
 			/* Only allow None BG root if we initialized the scanout
 			 * buffer */
@@ -1176,13 +1460,26 @@ ARMSOCScreenInit(SCREEN_INIT_ARGS_DECL)
 	wrap(pARMSOC, pScreen, BlockHandler, ARMSOCBlockHandler);
 	drmmode_screen_init(pScrn);
 
+	if (pARMSOC->PerfCounters) {
+		static const char name[] = "_ARMSOC_COUNTERS";
+		static const char swap_name[] = "_ARMSOC_SWAP_STATS";
+
+		pARMSOC->perf_atom = MakeAtom(name, sizeof(name) - 1, TRUE);
+		pARMSOC->swap_atom = MakeAtom(swap_name,
+				sizeof(swap_name) - 1, TRUE);
+		/* publish on the first BlockHandler */
+		pARMSOC->perf_published = GetTimeInMillis() -
+				ARMSOC_PERF_PUBLISH_MS;
+		memset(pARMSOC->perf_last, 0xff, sizeof(pARMSOC->perf_last));
+	}
+
 	if (pARMSOC->useUmplock) {
-		pARMSOC->lockFD = open("/dev/umplock", O_RDWR);
+		pARMSOC->umplock = armsoc_umplock_open("/dev/umplock");
 
-		if (-1 == pARMSOC->lockFD)
+		if (!pARMSOC->umplock)
 			ERROR_MSG("Failed to open umplock device!");
 	} else {
-		pARMSOC->lockFD = -1;
+		pARMSOC->umplock = NULL;
 	}
 
 	TRACE_EXIT();
@@ -1204,6 +1501,8 @@ fail5:
 	if (pARMSOC->dri)
 		ARMSOCDRI2CloseScreen(pScreen);
 
+	armsoc_device_set_fill(pARMSOC->dev, NULL, NULL);
+	armsoc_device_set_evict(pARMSOC->dev, NULL, NULL);
 	if (pARMSOC->pARMSOCEXA)
 		if (pARMSOC->pARMSOCEXA->CloseScreen)
 			pARMSOC->pARMSOCEXA->CloseScreen(CLOSE_SCREEN_ARGS);
@@ -1257,6 +1556,7 @@ ARMSOCCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 {
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct armsoc_mem_stats mem;
 	Bool ret;
 
 	TRACE_ENTER();
@@ -1283,6 +1583,8 @@ ARMSOCCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 	if (pARMSOC->dri)
 		ARMSOCDRI2CloseScreen(pScreen);
 
+	armsoc_device_set_fill(pARMSOC->dev, NULL, NULL);
+	armsoc_device_set_evict(pARMSOC->dev, NULL, NULL);
 	if (pARMSOC->pARMSOCEXA)
 		if (pARMSOC->pARMSOCEXA->CloseScreen)
 			pARMSOC->pARMSOCEXA->CloseScreen(CLOSE_SCREEN_ARGS);
@@ -1299,9 +1601,25 @@ ARMSOCCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 
 	pScrn->vtSema = FALSE;
 
-	if (-1 != pARMSOC->lockFD) {
-		close(pARMSOC->lockFD);
-		pARMSOC->lockFD = -1;
+	armsoc_device_get_mem_stats(pARMSOC->dev, &mem);
+	INFO_MSG("Graphics memory peak %llu KB, %lu evictions freed %llu KB",
+		(unsigned long long)mem.peak >> 10, mem.evictions,
+		(unsigned long long)mem.evicted >> 10);
+
+	if (pARMSOC->Profile && armsoc_profile_write())
+		WARNING_MSG("Cannot write the pixmap and bo profile");
+
+	if (pARMSOC->umplock) {
+		struct armsoc_umplock_stats stats;
+
+		armsoc_umplock_get_stats(pARMSOC->umplock, &stats);
+		INFO_MSG("umplock: %lu locks, %lu nested, %lu contended, %lu failed, %lu items created, %llu us waiting (max %llu us)",
+			stats.acquires, stats.nested, stats.contended,
+			stats.failures, stats.creates,
+			(unsigned long long)stats.wait_us,
+			(unsigned long long)stats.max_wait_us);
+		armsoc_umplock_close(pARMSOC->umplock);
+		pARMSOC->umplock = NULL;
 	}
 
 	TRACE_EXIT();
@@ -1330,6 +1648,62 @@ ARMSOCCreateScreenResources(ScreenPtr pScreen)
 }
 
 
+/*
+ * With PerfCounters enabled, the counters in armsoc_perf.h and the bo
+ * memory by usage are published as "name value" lines in the
+ * _ARMSOC_COUNTERS property of the root window, at most once every
+ * ARMSOC_PERF_PUBLISH_MS and only when they changed. Read them with
+ * xprop -root _ARMSOC_COUNTERS.
+ */
+static void
+ARMSOCPublishCounters(ScreenPtr pScreen)
+{
+	static const char * const usage_names[ARMSOC_USAGE_COUNT] = {
+		[ARMSOC_USAGE_PIXMAP] = "mem_pixmap",
+		[ARMSOC_USAGE_SCANOUT] = "mem_scanout",
+		[ARMSOC_USAGE_DRI2] = "mem_dri2",
+		[ARMSOC_USAGE_CURSOR] = "mem_cursor",
+	};
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	char buf[(ARMSOC_PERF_COUNT + ARMSOC_USAGE_COUNT) * 48];
+	struct armsoc_mem_stats mem;
+	CARD32 now = GetTimeInMillis();
+	int len = 0;
+	int i;
+
+	if (now - pARMSOC->perf_published < ARMSOC_PERF_PUBLISH_MS ||
+			!memcmp(pARMSOC->perf_last, armsoc_perf,
+				sizeof(pARMSOC->perf_last)))
+		return;
+
+	for (i = 0; i < ARMSOC_PERF_COUNT; i++)
+		len += snprintf(buf + len, sizeof(buf) - len, "%s %llu\n",
+				armsoc_perf_name(i),
+				(unsigned long long)armsoc_perf[i]);
+
+	armsoc_device_get_mem_stats(pARMSOC->dev, &mem);
+	for (i = 0; i < ARMSOC_USAGE_COUNT; i++)
+		len += snprintf(buf + len, sizeof(buf) - len, "%s %llu\n",
+				usage_names[i],
+				(unsigned long long)mem.bytes[i]);
+
+	dixChangeWindowProperty(serverClient, pScreen->root,
+			pARMSOC->perf_atom, XA_STRING, 8, PropModeReplace,
+			len, buf, TRUE);
+
+	if (pARMSOC->swap_stats.latency.count) {
+		len = armsoc_swap_stats_format(&pARMSOC->swap_stats,
+				buf, sizeof(buf));
+		dixChangeWindowProperty(serverClient, pScreen->root,
+				pARMSOC->swap_atom, XA_STRING, 8,
+				PropModeReplace, len, buf, TRUE);
+	}
+
+	memcpy(pARMSOC->perf_last, armsoc_perf, sizeof(pARMSOC->perf_last));
+	pARMSOC->perf_published = now;
+}
+
 static void
 ARMSOCBlockHandler(BLOCKHANDLER_ARGS_DECL)
 {
@@ -1340,6 +1714,19 @@ ARMSOCBlockHandler(BLOCKHANDLER_ARGS_DECL)
 	swap(pARMSOC, pScreen, BlockHandler);
 	(*pScreen->BlockHandler) (BLOCKHANDLER_ARGS);
 	swap(pARMSOC, pScreen, BlockHandler);
+
+	if (pARMSOC->migrate_queue_len)
+		ARMSOCMigratePixmaps(pScreen);
+
+	/* destroy the bos freed while handling this batch of requests */
+	armsoc_device_flush_deferred(pARMSOC->dev);
+	armsoc_device_trim_maps(pARMSOC->dev);
+
+	if (pARMSOC->PerfCounters)
+		ARMSOCPublishCounters(pScreen);
+
+	if (pARMSOC->Profile)
+		armsoc_profile_poll();
 }
 
 
@@ -1459,6 +1846,12 @@ ARMSOCFreeScreen(FREE_SCREEN_ARGS_DECL)
 
 	armsoc_device_del(pARMSOC->dev);
 
+	if (pARMSOC->TraceMarker)
+		armsoc_trace_close();
+
+	if (pARMSOC->Profile)
+		armsoc_profile_close();
+
 	/* Free the driver's Screen-specific, "private" data structure and
 	 * NULL-out the ScrnInfoRec's driverPrivate field.
 	 */
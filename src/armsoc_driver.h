@@ -39,6 +39,10 @@
 #include "xf86drm.h"
 #include <errno.h>
 #include "armsoc_exa.h"
+#include "armsoc_umplock.h"
+#include "armsoc_perf.h"
+#include "armsoc_trace.h"
+#include "armsoc_profile.h"
 
 /* Apparently not used by X server */
 #define ARMSOC_VERSION		1000
@@ -121,6 +125,9 @@ extern _X_EXPORT Bool armsocDebug;
 #define DRI2_BUFFER_GET_AGE(flag) ((flag) & DRI2_BUFFER_AGE_MASK) >> 4
 #define DRI2_BUFFER_SET_AGE(flag, age) (flag) |= (((age) << 4) & DRI2_BUFFER_AGE_MASK);
 
+/* Most pixmaps waiting for migration at any one time */
+#define ARMSOC_MIGRATE_QUEUE_SIZE 16
+
 /** The driver's Screen-specific, "private" data structure. */
 struct ARMSOCRec {
 	/**
@@ -136,6 +143,16 @@ struct ARMSOCRec {
 	Bool				NoFlip;
 	Bool				NoG2D;
 	Bool				NoHardwareMouse;
+	Bool				ScanoutHeadroom;
+	Bool				PixmapMigration;
+	unsigned int			SmallPixmapThreshold;
+	Bool				PixmapSlabs;
+	unsigned int			MapBudget;
+	unsigned int			MemoryBudget;
+	unsigned int			DRI2IdleTimeout;
+	Bool				PerfCounters;
+	Bool				TraceMarker;
+	Bool				Profile;
 	unsigned			driNumBufs;
 
 	/** File descriptor of the connection with the DRM. */
@@ -170,8 +187,8 @@ struct ARMSOCRec {
 	int					crtcNum;
 
 	Bool				useUmplock;
-	/* File descriptor of the umplock*/
-	int					lockFD;
+	/* umplock device, NULL unless useUmplock */
+	struct armsoc_umplock		*umplock;
 
 	/* The Swap Chain stores the pending swap operations */
 	struct ARMSOCDRISwapCmd            **swap_chain;
@@ -183,6 +200,34 @@ struct ARMSOCRec {
 	/* Size of the swap chain. Set to 1 if DRI2SwapLimit unsupported,
 	 * driNumBufs if early display enabled, otherwise driNumBufs-1 */
 	unsigned int                       swap_chain_size;
+
+	/* Pixmaps whose bo should move to memory with a different caching
+	 * policy, migrated from the BlockHandler */
+	struct ARMSOCPixmapPrivRec *migrate_queue[ARMSOC_MIGRATE_QUEUE_SIZE];
+	int                                migrate_queue_len;
+
+	/* Pixmaps, most recently used first, for eviction */
+	struct ARMSOCPixmapPrivRec         *pixmap_lru_head;
+	struct ARMSOCPixmapPrivRec         *pixmap_lru_tail;
+
+	/* DRI2 back buffers, for releasing the spare pixmaps of */
+	struct ARMSOCDRI2BufferRec         *dri2_back_buffers;
+
+	/* Releases the spare pixmaps of idle DRI2 drawables. Only armed
+	 * while some exist, see DRI2IdleTimeout */
+	OsTimerPtr                         dri2_idle_timer;
+	Bool                               dri2_idle_armed;
+
+	/* Root window property the perf counters are published in, and
+	 * what was last published there, see PerfCounters */
+	Atom                               perf_atom;
+	CARD32                             perf_published;
+	uint64_t                           perf_last[ARMSOC_PERF_COUNT];
+
+	/* Frame pacing of all page flips, published in swap_atom on the
+	 * root window and per window by ARMSOCDRI2FlipComplete() */
+	struct armsoc_swap_stats           swap_stats;
+	Atom                               swap_atom;
 };
 
 /*
@@ -226,6 +271,10 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, int fd, int cpp);
 void drmmode_screen_init(ScrnInfoPtr pScrn);
 void drmmode_screen_fini(ScrnInfoPtr pScrn);
 void drmmode_adjust_frame(ScrnInfoPtr pScrn, int x, int y);
+void drmmode_get_max_size(ScrnInfoPtr pScrn, int *width, int *height);
+Bool drmmode_crtcs_shadowed(ScrnInfoPtr pScrn);
+struct armsoc_bo *drmmode_get_current_fb(ScrnInfoPtr pScrn, int *x, int *y,
+		int *width, int *height);
 Bool drmmode_page_flip(DrawablePtr draw, uint32_t fb_id, void *priv);
 void drmmode_wait_for_event(ScrnInfoPtr pScrn);
 Bool drmmode_cursor_init(ScreenPtr pScreen);
@@ -241,8 +290,11 @@ struct ARMSOCDRISwapCmd;
 Bool ARMSOCDRI2ScreenInit(ScreenPtr pScreen);
 void ARMSOCDRI2CloseScreen(ScreenPtr pScreen);
 void ARMSOCDRI2SwapComplete(struct ARMSOCDRISwapCmd *cmd);
+void ARMSOCDRI2FlipComplete(struct ARMSOCDRISwapCmd *cmd, unsigned int sequence,
+		unsigned int tv_sec, unsigned int tv_usec);
 void ARMSOCDRI2ResizeSwapChain(ScrnInfoPtr pScrn, struct armsoc_bo *old_bo, struct armsoc_bo *resized_bo);
 void ARMSOCDRI2VBlankHandler(unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec, void *user_data);
+uint64_t ARMSOCDRI2ReleaseBackBuffers(ScreenPtr pScreen, CARD32 idle_ms);
 
 /**
  * DRI2 util functions..
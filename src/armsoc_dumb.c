@@ -30,6 +30,7 @@
 #include <sys/mman.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <xorg-server.h>
@@ -38,15 +39,97 @@
 #include <xf86drmMode.h>
 
 #include "armsoc_dumb.h"
+#include "armsoc_perf.h"
+#include "armsoc_trace.h"
+#include "armsoc_profile.h"
 #include "drmmode_driver.h"
 
+/* older libdrm headers lack it */
+#ifndef DRM_RDWR
+#define DRM_RDWR O_RDWR
+#endif
+
 #define ALIGN(val, align)	(((val) + (align) - 1) & ~((align) - 1))
 
+/* A slab is a bo cut into SLAB_COLS x SLAB_ROWS square cells of one
+ * size, each holding one small bo.
+ */
+#define SLAB_COLS	8
+#define SLAB_ROWS	4
+#define SLAB_CELLS	(SLAB_COLS * SLAB_ROWS)
+
+static const uint32_t slab_cell_sizes[] = { 32, 64, 128 };
+
+/* Most bos waiting for armsoc_device_flush_deferred(). Past this the
+ * oldest is destroyed straight away, so a burst of frees can't hold on
+ * to an unbounded amount of memory.
+ */
+#define DEFERRED_FREE_MAX	64
+
+/* Most dma_buf fds kept open for bos that are not being synchronised
+ * on. Past this the least recently used are closed.
+ */
+#define DMABUF_FD_MAX		128
+
+/* With a mapping budget set, mappings unused for this long are dropped
+ * by armsoc_device_trim_maps() even within the budget.
+ */
+#define MAP_IDLE_MS		10000
+
+/* With a memory budget set, an allocation that would take the total
+ * past the high watermark asks for enough to be evicted to get back
+ * under the low one, so eviction doesn't run on every allocation.
+ */
+#define BUDGET_HIGH(b)		((b) - (b) / 10)
+#define BUDGET_LOW(b)		((b) - (b) / 4)
+
+struct armsoc_slab {
+	struct armsoc_slab *next;
+	/* the shared bo, owned by the slab */
+	struct armsoc_bo *bo;
+	uint32_t cell_size;
+	/* bit n set if cell n is in use */
+	uint32_t used;
+};
+
 struct armsoc_device {
 	int fd;
 	int (*create_custom_gem)(int fd, struct armsoc_create_gem *create_gem);
+	uint32_t (*get_pitch)(uint32_t width, uint32_t bpp);
+	/* optional accelerated fill of a whole bo, 0 on success */
+	int (*fill)(void *data, struct armsoc_bo *bo, uint32_t color);
+	void *fill_data;
 	Bool alpha_supported;
-
+	/* slabs with at least one cell in use */
+	struct armsoc_slab *slabs;
+	/* unreferenced bos waiting to be destroyed, oldest first */
+	struct armsoc_bo *deferred_head;
+	struct armsoc_bo *deferred_tail;
+	unsigned int deferred_count;
+	/* bos holding a dma_buf fd, most recently used first */
+	struct armsoc_bo *dmabuf_head;
+	struct armsoc_bo *dmabuf_tail;
+	unsigned int dmabuf_count;
+	/* mapped bos, most recently used first */
+	struct armsoc_bo *map_head;
+	struct armsoc_bo *map_tail;
+	uint64_t map_bytes;
+	/* 0 for no limit */
+	uint64_t map_budget;
+	/* bumped by every armsoc_device_trim_maps() */
+	unsigned int map_epoch;
+	/* bytes of bos not yet destroyed, by usage */
+	uint64_t bytes[ARMSOC_USAGE_COUNT];
+	uint64_t total_bytes;
+	uint64_t peak_bytes;
+	/* 0 for no limit */
+	uint64_t budget;
+	/* releases memory held by the driver, see armsoc_device_reclaim() */
+	void (*evict)(void *data, uint64_t bytes);
+	void *evict_data;
+	Bool evicting;
+	unsigned long evictions;
+	uint64_t evicted;
 };
 
 struct armsoc_bo {
@@ -61,12 +144,49 @@ struct armsoc_bo {
 	uint8_t bpp;
 	uint32_t pitch;
 	int refcnt;
+	/* dma_buf fd, kept for the life of the bo once exported unless
+	 * the fd budget runs out. CPU access waits on it while
+	 * dmabuf_sync is set, see armsoc_bo_set_dmabuf().
+	 */
 	int dmabuf;
+	Bool dmabuf_sync;
+	struct armsoc_bo *dmabuf_prev;
+	struct armsoc_bo *dmabuf_next;
 	/* initial size of backing memory. Used on resize to
 	 * check if the new size will fit
 	 */
 	uint32_t original_size;
+	/* pitch the backing memory was allocated with. Kept on resize
+	 * when the new width fits, so the contents stay where they are
+	 */
+	uint32_t original_pitch;
 	uint32_t name;
+	enum armsoc_cache_type cache_type;
+	/* contents are known to be all zero: memory fresh from the kernel,
+	 * or cleared since, and not written through a mapping, an export or
+	 * by acceleration. A clear is then a no-op.
+	 */
+	Bool known_zero;
+	/* set for bos carved out of a slab, which share the slab's handle
+	 * and pitch and start at origin_x, origin_y pixels into it
+	 */
+	struct armsoc_slab *slab;
+	int cell;
+	uint32_t origin_x;
+	uint32_t origin_y;
+	/* next bo in the device's deferred free list */
+	struct armsoc_bo *deferred_next;
+	/* place in the device's mapping LRU, and when it was last used */
+	struct armsoc_bo *map_prev;
+	struct armsoc_bo *map_next;
+	unsigned int map_epoch;
+	CARD32 map_used;
+	/* what original_size is accounted as; slab bos are accounted
+	 * with their slab
+	 */
+	enum armsoc_bo_usage usage;
+	/* when the bo was created, while profiling */
+	uint64_t created_us;
 };
 
 /* device related functions:
@@ -74,7 +194,8 @@ struct armsoc_bo {
 
 struct armsoc_device *armsoc_device_new(int fd,
 			int (*create_custom_gem)(int fd,
-				struct armsoc_create_gem *create_gem))
+				struct armsoc_create_gem *create_gem),
+			uint32_t (*get_pitch)(uint32_t width, uint32_t bpp))
 {
 	struct armsoc_device *new_dev = calloc(1, sizeof(*new_dev));
 	if (!new_dev)
@@ -82,76 +203,311 @@ struct armsoc_device *armsoc_device_new(int fd,
 
 	new_dev->fd = fd;
 	new_dev->create_custom_gem = create_custom_gem;
+	new_dev->get_pitch = get_pitch;
 	new_dev->alpha_supported = TRUE;
 	return new_dev;
 }
 
 void armsoc_device_del(struct armsoc_device *dev)
 {
+	armsoc_device_flush_deferred(dev);
+	/* every slab goes with its last bo */
+	assert(!dev->slabs);
 	free(dev);
 }
 
+/* Install (or with NULL remove) a hook that fills a bo without the CPU,
+ * used by armsoc_bo_clear(). It is provided by the EXA backend.
+ */
+void armsoc_device_set_fill(struct armsoc_device *dev,
+	int (*fill)(void *data, struct armsoc_bo *bo, uint32_t color),
+	void *data)
+{
+	dev->fill = fill;
+	dev->fill_data = data;
+}
+
+void armsoc_device_set_budget(struct armsoc_device *dev, uint64_t bytes)
+{
+	dev->budget = bytes;
+}
+
+/* Install (or with NULL remove) the hook asked to release at least
+ * 'bytes' of bos when the budget is exceeded or an allocation fails.
+ * It frees by unreferencing bos; they are destroyed on its return.
+ */
+void armsoc_device_set_evict(struct armsoc_device *dev,
+	void (*evict)(void *data, uint64_t bytes), void *data)
+{
+	dev->evict = evict;
+	dev->evict_data = data;
+}
+
+void armsoc_device_get_mem_stats(struct armsoc_device *dev,
+	struct armsoc_mem_stats *stats)
+{
+	memcpy(stats->bytes, dev->bytes, sizeof(stats->bytes));
+	stats->peak = dev->peak_bytes;
+	stats->evictions = dev->evictions;
+	stats->evicted = dev->evicted;
+}
+
 /* buffer-object related functions:
  */
 
+static void armsoc_bo_unmap(struct armsoc_bo *bo);
+
+static void armsoc_bo_account(struct armsoc_bo *bo, Bool add)
+{
+	struct armsoc_device *dev = bo->dev;
+
+	if (bo->slab)
+		return;
+
+	if (add) {
+		dev->bytes[bo->usage] += bo->original_size;
+		dev->total_bytes += bo->original_size;
+		if (dev->total_bytes > dev->peak_bytes)
+			dev->peak_bytes = dev->total_bytes;
+	} else {
+		assert(dev->bytes[bo->usage] >= bo->original_size);
+		dev->bytes[bo->usage] -= bo->original_size;
+		dev->total_bytes -= bo->original_size;
+	}
+}
+
+void armsoc_bo_set_usage(struct armsoc_bo *bo, enum armsoc_bo_usage usage)
+{
+	assert(bo->refcnt > 0);
+	assert(usage < ARMSOC_USAGE_COUNT);
+	armsoc_bo_account(bo, FALSE);
+	bo->usage = usage;
+	armsoc_bo_account(bo, TRUE);
+}
+
+/* Try to give back at least 'bytes': first the deferred bos, then
+ * whatever the evict hook releases. Returns TRUE if anything was freed.
+ */
+static Bool armsoc_device_reclaim(struct armsoc_device *dev, uint64_t bytes)
+{
+	uint64_t start = dev->total_bytes;
+
+	armsoc_device_flush_deferred(dev);
+	if (start - dev->total_bytes < bytes && dev->evict &&
+			!dev->evicting) {
+		/* the hook may allocate, e.g. system memory copies of
+		 * pixmaps, but must not end up back here */
+		dev->evicting = TRUE;
+		dev->evictions++;
+		dev->evict(dev->evict_data,
+			bytes - (start - dev->total_bytes));
+		dev->evicting = FALSE;
+		armsoc_device_flush_deferred(dev);
+	}
+	dev->evicted += start - dev->total_bytes;
+	return dev->total_bytes < start;
+}
+
+/* dma_buf fd LRU: pixmaps cycle through DRI2 wrapping many times, so
+ * the fd exported for the first cycle is kept and reused rather than
+ * exported again with PRIME_HANDLE_TO_FD each time.
+ */
+static void armsoc_dmabuf_lru_unlink(struct armsoc_bo *bo)
+{
+	struct armsoc_device *dev = bo->dev;
+
+	if (bo->dmabuf_prev)
+		bo->dmabuf_prev->dmabuf_next = bo->dmabuf_next;
+	else
+		dev->dmabuf_head = bo->dmabuf_next;
+	if (bo->dmabuf_next)
+		bo->dmabuf_next->dmabuf_prev = bo->dmabuf_prev;
+	else
+		dev->dmabuf_tail = bo->dmabuf_prev;
+	bo->dmabuf_prev = NULL;
+	bo->dmabuf_next = NULL;
+}
+
+static void armsoc_dmabuf_lru_push(struct armsoc_bo *bo)
+{
+	struct armsoc_device *dev = bo->dev;
+
+	bo->dmabuf_prev = NULL;
+	bo->dmabuf_next = dev->dmabuf_head;
+	if (dev->dmabuf_head)
+		dev->dmabuf_head->dmabuf_prev = bo;
+	else
+		dev->dmabuf_tail = bo;
+	dev->dmabuf_head = bo;
+}
+
+static void armsoc_dmabuf_close(struct armsoc_bo *bo)
+{
+	assert(bo->dmabuf >= 0 && !bo->dmabuf_sync);
+
+	armsoc_dmabuf_lru_unlink(bo);
+	close(bo->dmabuf);
+	bo->dmabuf = -1;
+	bo->dev->dmabuf_count--;
+}
+
+/* Close the least recently used fds not being synchronised on until
+ * at most max remain. Returns TRUE if any was closed.
+ */
+static Bool armsoc_dmabuf_trim(struct armsoc_device *dev, unsigned int max)
+{
+	struct armsoc_bo *bo = dev->dmabuf_tail;
+	Bool closed = FALSE;
+
+	while (bo && dev->dmabuf_count > max) {
+		struct armsoc_bo *prev = bo->dmabuf_prev;
+
+		if (!bo->dmabuf_sync) {
+			armsoc_dmabuf_close(bo);
+			closed = TRUE;
+		}
+		bo = prev;
+	}
+	return closed;
+}
+
 int armsoc_bo_set_dmabuf(struct armsoc_bo *bo)
 {
 	int res;
 	struct drm_prime_handle prime_handle;
+	struct armsoc_device *dev = bo->dev;
 
 	assert(bo->refcnt > 0);
 	assert(!armsoc_bo_has_dmabuf(bo));
 
-	/* Try to get dma_buf fd */
+	/* would export the whole slab */
+	if (bo->slab)
+		return -1;
+
+	/* others may write to it from now on */
+	bo->known_zero = FALSE;
+
+	if (bo->dmabuf >= 0) {
+		armsoc_dmabuf_lru_unlink(bo);
+		armsoc_dmabuf_lru_push(bo);
+		bo->dmabuf_sync = TRUE;
+		return 0;
+	}
+
+	armsoc_dmabuf_trim(dev, DMABUF_FD_MAX - 1);
+
+	/* Try to get dma_buf fd. It is cached and must not leak into
+	 * processes the server spawns; clients that get it through DRI2
+	 * may map it for writing, which kernels before 4.6 can't grant
+	 */
 	prime_handle.handle = bo->handle;
-	prime_handle.flags  = 0;
-	res  = drmIoctl(bo->dev->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD,
+	prime_handle.flags  = DRM_CLOEXEC | DRM_RDWR;
+	res  = drmIoctl(dev->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD,
+						&prime_handle);
+	if (res && errno == EINVAL) {
+		prime_handle.flags = DRM_CLOEXEC;
+		res = drmIoctl(dev->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD,
+						&prime_handle);
+	}
+	if (res && errno == EMFILE && armsoc_dmabuf_trim(dev, 0)) {
+		/* out of fds: retry with only those in use left open */
+		res = drmIoctl(dev->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD,
 						&prime_handle);
+	}
 	if (res)
-		res = errno;
-	else
-		bo->dmabuf = prime_handle.fd;
+		return errno;
 
-	return res;
+	bo->dmabuf = prime_handle.fd;
+	bo->dmabuf_sync = TRUE;
+	armsoc_dmabuf_lru_push(bo);
+	dev->dmabuf_count++;
+	return 0;
 }
 
+/* Stop synchronising CPU access on the dma_buf. The fd stays cached
+ * for the next armsoc_bo_set_dmabuf().
+ */
 void armsoc_bo_clear_dmabuf(struct armsoc_bo *bo)
 {
 	assert(bo->refcnt > 0);
 	assert(armsoc_bo_has_dmabuf(bo));
 
-	close(bo->dmabuf);
-	bo->dmabuf = -1;
+	bo->dmabuf_sync = FALSE;
 }
 
 int armsoc_bo_has_dmabuf(struct armsoc_bo *bo)
 {
 	assert(bo->refcnt > 0);
-	return bo->dmabuf >= 0;
+	return bo->dmabuf_sync;
+}
+
+int armsoc_bo_is_shared(struct armsoc_bo *bo)
+{
+	assert(bo->refcnt > 0);
+	return bo->refcnt > 1 || bo->name || bo->dmabuf >= 0 || bo->fb_id ||
+			bo->slab;
+}
+
+int armsoc_bo_is_slab(struct armsoc_bo *bo)
+{
+	assert(bo->refcnt > 0);
+	return bo->slab != NULL;
+}
+
+/* Position of the bo's first pixel within the bo its handle refers to:
+ * 0, 0 except for bos carved out of a slab.
+ */
+void armsoc_bo_origin(struct armsoc_bo *bo, uint32_t *x, uint32_t *y)
+{
+	assert(bo->refcnt > 0);
+	*x = bo->origin_x;
+	*y = bo->origin_y;
 }
 
 struct armsoc_bo *armsoc_bo_new_with_dim(struct armsoc_device *dev,
 			uint32_t width, uint32_t height, uint8_t depth,
 			uint8_t bpp, enum armsoc_buf_type buf_type)
+{
+	return armsoc_bo_new_with_cache(dev, width, height, depth, bpp,
+			buf_type, ARMSOC_CACHE_DEFAULT);
+}
+
+struct armsoc_bo *armsoc_bo_new_with_cache(struct armsoc_device *dev,
+			uint32_t width, uint32_t height, uint8_t depth,
+			uint8_t bpp, enum armsoc_buf_type buf_type,
+			enum armsoc_cache_type cache_type)
 {
 	struct armsoc_create_gem create_gem;
 	struct armsoc_bo *new_buf;
+	/* the backend picks the pitch, this is close enough */
+	uint64_t estimate = (uint64_t)width * height * ((bpp + 7) / 8);
 	int res;
 
 	new_buf = malloc(sizeof(*new_buf));
 	if (!new_buf)
 		return NULL;
 
+	if (dev->budget &&
+			dev->total_bytes + estimate > BUDGET_HIGH(dev->budget))
+		armsoc_device_reclaim(dev, dev->total_bytes + estimate -
+				BUDGET_LOW(dev->budget));
+
 	create_gem.buf_type = buf_type;
+	create_gem.cache_type = cache_type;
 	create_gem.height = height;
 	create_gem.width = width;
 	create_gem.bpp = bpp;
 	res = dev->create_custom_gem(dev->fd, &create_gem);
+	if (res && armsoc_device_reclaim(dev, estimate)) {
+		/* the memory may have been held by freed bos */
+		res = dev->create_custom_gem(dev->fd, &create_gem);
+	}
 	if (res) {
 		free(new_buf);
+		ARMSOC_PERF_INC(ARMSOC_PERF_BO_FAILED);
 		xf86DrvMsg(-1, X_ERROR,
-			"_CREATE_GEM({height: %d, width: %d, bpp: %d buf_type: 0x%X}) failed. errno: %d - %s\n",
-				height, width, bpp, buf_type,
+			"_CREATE_GEM({height: %d, width: %d, bpp: %d buf_type: 0x%X cache_type: %d}) failed. errno: %d - %s\n",
+				height, width, bpp, buf_type, cache_type,
 				errno, strerror(errno));
 		return NULL;
 	}
@@ -160,16 +516,218 @@ struct armsoc_bo *armsoc_bo_new_with_dim(struct armsoc_device *dev,
 	new_buf->handle = create_gem.handle;
 	new_buf->size = create_gem.size;
 	new_buf->map_addr = NULL;
+	new_buf->map_prev = NULL;
+	new_buf->map_next = NULL;
 	new_buf->fb_id = 0;
 	new_buf->pitch = create_gem.pitch;
 	new_buf->width = create_gem.width;
 	new_buf->height = create_gem.height;
 	new_buf->original_size = create_gem.size;
+	new_buf->original_pitch = create_gem.pitch;
 	new_buf->depth = depth;
 	new_buf->bpp = create_gem.bpp;
 	new_buf->refcnt = 1;
 	new_buf->dmabuf = -1;
+	new_buf->dmabuf_sync = FALSE;
+	new_buf->dmabuf_prev = NULL;
+	new_buf->dmabuf_next = NULL;
+	new_buf->name = 0;
+	new_buf->cache_type = cache_type;
+	/* the kernel hands out zeroed memory */
+	new_buf->known_zero = TRUE;
+	new_buf->slab = NULL;
+	new_buf->cell = -1;
+	new_buf->origin_x = 0;
+	new_buf->origin_y = 0;
+	new_buf->usage = buf_type == ARMSOC_BO_SCANOUT ?
+			ARMSOC_USAGE_SCANOUT : ARMSOC_USAGE_PIXMAP;
+	armsoc_bo_account(new_buf, TRUE);
+	ARMSOC_PERF_INC(buf_type == ARMSOC_BO_SCANOUT ?
+			ARMSOC_PERF_BO_SCANOUT : ARMSOC_PERF_BO_NON_SCANOUT);
+	ARMSOC_TRACE(bo_create, "bo=%p handle=%u %ux%u bpp=%u size=%u",
+			new_buf, new_buf->handle, new_buf->width,
+			new_buf->height, new_buf->bpp, new_buf->size);
+	new_buf->created_us = 0;
+	if (armsoc_profile_enabled) {
+		new_buf->created_us = armsoc_perf_now_us();
+		armsoc_profile_bo_new(new_buf->width, new_buf->height,
+				new_buf->size, FALSE);
+	}
+
+	return new_buf;
+}
+
+static struct armsoc_slab *armsoc_slab_new(struct armsoc_device *dev,
+			uint32_t cell_size, uint8_t depth, uint8_t bpp,
+			enum armsoc_cache_type cache_type)
+{
+	struct armsoc_slab *slab = calloc(1, sizeof(*slab));
+
+	if (!slab)
+		return NULL;
+
+	slab->bo = armsoc_bo_new_with_cache(dev, SLAB_COLS * cell_size,
+			SLAB_ROWS * cell_size, depth, bpp,
+			ARMSOC_BO_NON_SCANOUT, cache_type);
+	if (!slab->bo) {
+		free(slab);
+		return NULL;
+	}
+	slab->cell_size = cell_size;
+	slab->next = dev->slabs;
+	dev->slabs = slab;
+	return slab;
+}
+
+static void armsoc_slab_release(struct armsoc_device *dev,
+			struct armsoc_slab *slab, int cell)
+{
+	struct armsoc_slab **link;
+
+	assert(slab->used & (1u << cell));
+	slab->used &= ~(1u << cell);
+	if (slab->used)
+		return;
+
+	for (link = &dev->slabs; *link != slab; link = &(*link)->next)
+		;
+	*link = slab->next;
+	armsoc_bo_unreference(slab->bo);
+	free(slab);
+}
+
+/* Allocate a small non-scanout bo from a slab shared with other small
+ * bos of the same depth, bpp and caching type, saving a GEM object, an
+ * mmap and their page rounding per bo. Returns NULL if the size doesn't
+ * fit a slab cell or no slab could be allocated; the caller then falls
+ * back to armsoc_bo_new_with_cache(). Slab bos can't be exported or
+ * scanned out.
+ */
+struct armsoc_bo *armsoc_bo_new_from_slab(struct armsoc_device *dev,
+			uint32_t width, uint32_t height, uint8_t depth,
+			uint8_t bpp, enum armsoc_cache_type cache_type)
+{
+	struct armsoc_slab *slab;
+	struct armsoc_bo *new_buf;
+	uint32_t cell_size = 0;
+	unsigned int i;
+	int cell;
+
+	for (i = 0; i < sizeof(slab_cell_sizes) / sizeof(slab_cell_sizes[0]);
+			i++) {
+		if (width <= slab_cell_sizes[i] &&
+				height <= slab_cell_sizes[i]) {
+			cell_size = slab_cell_sizes[i];
+			break;
+		}
+	}
+	if (!cell_size)
+		return NULL;
+
+	for (slab = dev->slabs; slab; slab = slab->next) {
+		if (slab->cell_size == cell_size &&
+				slab->bo->depth == depth &&
+				slab->bo->bpp == bpp &&
+				slab->bo->cache_type == cache_type &&
+				slab->used != (uint32_t)((1ull << SLAB_CELLS) - 1))
+			break;
+	}
+
+	new_buf = malloc(sizeof(*new_buf));
+	if (!new_buf)
+		return NULL;
+
+	if (!slab) {
+		slab = armsoc_slab_new(dev, cell_size, depth, bpp, cache_type);
+		if (!slab) {
+			free(new_buf);
+			return NULL;
+		}
+	}
+
+	for (cell = 0; slab->used & (1u << cell); cell++)
+		;
+	slab->used |= 1u << cell;
+
+	*new_buf = *slab->bo;
+	/* always mapped through the slab */
+	new_buf->map_addr = NULL;
+	new_buf->map_prev = NULL;
+	new_buf->map_next = NULL;
+	new_buf->fb_id = 0;
+	new_buf->dmabuf = -1;
+	new_buf->dmabuf_sync = FALSE;
+	new_buf->dmabuf_prev = NULL;
+	new_buf->dmabuf_next = NULL;
+	new_buf->name = 0;
+	new_buf->width = width;
+	new_buf->height = height;
+	new_buf->depth = depth;
+	new_buf->size = (height - 1) * new_buf->pitch + width * ((bpp + 7) / 8);
+	new_buf->original_size = new_buf->size;
+	new_buf->refcnt = 1;
+	/* cells are recycled */
+	new_buf->known_zero = FALSE;
+	new_buf->slab = slab;
+	new_buf->cell = cell;
+	new_buf->origin_x = (cell % SLAB_COLS) * cell_size;
+	new_buf->origin_y = (cell / SLAB_COLS) * cell_size;
+	ARMSOC_PERF_INC(ARMSOC_PERF_BO_SLAB);
+	ARMSOC_TRACE(bo_create_slab, "bo=%p slab=%p cell=%d", new_buf, slab,
+			cell);
+	new_buf->created_us = 0;
+	if (armsoc_profile_enabled) {
+		new_buf->created_us = armsoc_perf_now_us();
+		armsoc_profile_bo_new(width, height,
+				cell_size * cell_size * ((bpp + 7) / 8), TRUE);
+	}
+
+	return new_buf;
+}
+
+/* Wrap a GEM handle obtained elsewhere, e.g. from drmModeGetFB(), in a
+ * bo. The bo takes ownership of the handle.
+ */
+struct armsoc_bo *armsoc_bo_from_handle(struct armsoc_device *dev,
+			uint32_t handle, uint32_t width, uint32_t height,
+			uint8_t depth, uint8_t bpp, uint32_t pitch)
+{
+	struct armsoc_bo *new_buf;
+
+	new_buf = malloc(sizeof(*new_buf));
+	if (!new_buf)
+		return NULL;
+
+	new_buf->dev = dev;
+	new_buf->handle = handle;
+	new_buf->size = pitch * height;
+	new_buf->map_addr = NULL;
+	new_buf->map_prev = NULL;
+	new_buf->map_next = NULL;
+	new_buf->fb_id = 0;
+	new_buf->pitch = pitch;
+	new_buf->width = width;
+	new_buf->height = height;
+	new_buf->original_size = new_buf->size;
+	new_buf->original_pitch = pitch;
+	new_buf->depth = depth;
+	new_buf->bpp = bpp;
+	new_buf->refcnt = 1;
+	new_buf->dmabuf = -1;
+	new_buf->dmabuf_sync = FALSE;
+	new_buf->dmabuf_prev = NULL;
+	new_buf->dmabuf_next = NULL;
 	new_buf->name = 0;
+	new_buf->cache_type = ARMSOC_CACHE_DEFAULT;
+	new_buf->known_zero = FALSE;
+	new_buf->slab = NULL;
+	new_buf->cell = -1;
+	new_buf->origin_x = 0;
+	new_buf->origin_y = 0;
+	/* only used to take over the console's framebuffer */
+	new_buf->usage = ARMSOC_USAGE_SCANOUT;
+	new_buf->created_us = 0;
+	armsoc_bo_account(new_buf, TRUE);
 
 	return new_buf;
 }
@@ -185,13 +743,27 @@ static void armsoc_bo_del(struct armsoc_bo *bo)
 	/* NB: name doesn't need cleanup */
 
 	assert(bo->refcnt == 0);
-	assert(bo->dmabuf < 0);
-
-	if (bo->map_addr) {
-		/* always map/unmap the full buffer for consistency */
-		munmap(bo->map_addr, bo->original_size);
+	assert(!bo->dmabuf_sync);
+
+	if (bo->dmabuf >= 0)
+		armsoc_dmabuf_close(bo);
+
+	armsoc_bo_account(bo, FALSE);
+	ARMSOC_PERF_INC(ARMSOC_PERF_BO_DESTROY);
+	ARMSOC_TRACE(bo_destroy, "bo=%p handle=%u", bo, bo->handle);
+	if (armsoc_profile_enabled && bo->created_us)
+		armsoc_profile_bo_del(armsoc_perf_now_us() - bo->created_us,
+				bo->slab != NULL);
+
+	if (bo->slab) {
+		/* the memory belongs to the slab */
+		armsoc_slab_release(bo->dev, bo->slab, bo->cell);
+		free(bo);
+		return;
 	}
 
+	armsoc_bo_unmap(bo);
+
 	if (bo->fb_id) {
 		res = drmModeRmFB(bo->dev->fd, bo->fb_id);
 		if (res)
@@ -207,6 +779,59 @@ static void armsoc_bo_del(struct armsoc_bo *bo)
 	free(bo);
 }
 
+/* Destroying a bo means munmap, drmModeRmFB and DESTROY_DUMB, which may
+ * free CMA pages in the kernel. When a window tree is torn down dozens
+ * of them happen in one request, so they are queued and destroyed from
+ * the BlockHandler instead. Slab bos only give back their cell.
+ */
+static void armsoc_bo_defer_del(struct armsoc_bo *bo)
+{
+	struct armsoc_device *dev = bo->dev;
+
+	if (bo->slab) {
+		armsoc_bo_del(bo);
+		return;
+	}
+
+	bo->deferred_next = NULL;
+	if (dev->deferred_tail)
+		dev->deferred_tail->deferred_next = bo;
+	else
+		dev->deferred_head = bo;
+	dev->deferred_tail = bo;
+
+	if (++dev->deferred_count > DEFERRED_FREE_MAX) {
+		struct armsoc_bo *oldest = dev->deferred_head;
+
+		dev->deferred_head = oldest->deferred_next;
+		dev->deferred_count--;
+		armsoc_bo_del(oldest);
+	}
+}
+
+/* Destroy every bo queued by armsoc_bo_unreference(). Returns the number
+ * of bos destroyed.
+ */
+unsigned int armsoc_device_flush_deferred(struct armsoc_device *dev)
+{
+	unsigned int count = dev->deferred_count;
+
+	while (dev->deferred_head) {
+		struct armsoc_bo *bo = dev->deferred_head;
+
+		dev->deferred_head = bo->deferred_next;
+		armsoc_bo_del(bo);
+	}
+	dev->deferred_tail = NULL;
+	dev->deferred_count = 0;
+	return count;
+}
+
+uint64_t armsoc_device_total_bytes(struct armsoc_device *dev)
+{
+	return dev->total_bytes;
+}
+
 void armsoc_bo_unreference(struct armsoc_bo *bo)
 {
 	if (!bo)
@@ -214,7 +839,7 @@ void armsoc_bo_unreference(struct armsoc_bo *bo)
 
 	assert(bo->refcnt > 0);
 	if (--bo->refcnt == 0)
-		armsoc_bo_del(bo);
+		armsoc_bo_defer_del(bo);
 }
 
 void armsoc_bo_reference(struct armsoc_bo *bo)
@@ -230,6 +855,9 @@ int armsoc_bo_get_name(struct armsoc_bo *bo, uint32_t *name)
 		struct drm_gem_flink flink;
 
 		assert(bo->refcnt > 0);
+		/* would export the whole slab */
+		if (bo->slab)
+			return -EINVAL;
 		flink.handle = bo->handle;
 
 		ret = drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_FLINK, &flink);
@@ -290,36 +918,208 @@ uint32_t armsoc_bo_pitch(struct armsoc_bo *bo)
 	return bo->pitch;
 }
 
-void *armsoc_bo_map(struct armsoc_bo *bo)
+/* The caching hint the bo was created with */
+enum armsoc_cache_type armsoc_bo_cache_type(struct armsoc_bo *bo)
 {
 	assert(bo->refcnt > 0);
-	if (!bo->map_addr) {
-		struct drm_mode_map_dumb map_dumb;
-		int res;
+	return bo->cache_type;
+}
+
+/* Mapping manager: every mapped bo sits on an LRU list. Mappings may be
+ * dropped by armsoc_device_trim_maps(), called from the BlockHandler,
+ * when they exceed the budget or have been idle, or when mmap() runs out
+ * of address space. Only mappings not used since the last trim are
+ * dropped, so pointers stay valid for the rest of the request batch
+ * they were obtained in. Bos with a framebuffer keep their mapping, as
+ * the scanout's is held by the screen pixmap.
+ */
+static void armsoc_map_lru_unlink(struct armsoc_bo *bo)
+{
+	struct armsoc_device *dev = bo->dev;
 
-		map_dumb.handle = bo->handle;
+	if (bo->map_prev)
+		bo->map_prev->map_next = bo->map_next;
+	else
+		dev->map_head = bo->map_next;
+	if (bo->map_next)
+		bo->map_next->map_prev = bo->map_prev;
+	else
+		dev->map_tail = bo->map_prev;
+	bo->map_prev = NULL;
+	bo->map_next = NULL;
+}
 
-		res = drmIoctl(bo->dev->fd, DRM_IOCTL_MODE_MAP_DUMB, &map_dumb);
-		if (res)
+static void armsoc_map_lru_touch(struct armsoc_bo *bo)
+{
+	struct armsoc_device *dev = bo->dev;
+
+	if (dev->map_head != bo) {
+		if (bo->map_prev || bo->map_next || dev->map_tail == bo)
+			armsoc_map_lru_unlink(bo);
+		bo->map_next = dev->map_head;
+		if (dev->map_head)
+			dev->map_head->map_prev = bo;
+		else
+			dev->map_tail = bo;
+		dev->map_head = bo;
+	}
+	bo->map_epoch = dev->map_epoch;
+	bo->map_used = GetTimeInMillis();
+}
+
+static void armsoc_bo_unmap(struct armsoc_bo *bo)
+{
+	if (!bo->map_addr)
+		return;
+
+	armsoc_map_lru_unlink(bo);
+	/* always map/unmap the full buffer for consistency */
+	munmap(bo->map_addr, bo->original_size);
+	bo->map_addr = NULL;
+	bo->dev->map_bytes -= bo->original_size;
+}
+
+static Bool armsoc_bo_map_evictable(struct armsoc_bo *bo)
+{
+	return !bo->fb_id && bo->map_epoch != bo->dev->map_epoch;
+}
+
+/* Drop the least recently used evictable mappings until at most
+ * target bytes are mapped. Returns TRUE if any was dropped.
+ */
+static Bool armsoc_device_evict_maps(struct armsoc_device *dev,
+			uint64_t target)
+{
+	struct armsoc_bo *bo = dev->map_tail;
+	Bool evicted = FALSE;
+
+	while (bo && dev->map_bytes > target) {
+		struct armsoc_bo *prev = bo->map_prev;
+
+		if (armsoc_bo_map_evictable(bo)) {
+			armsoc_bo_unmap(bo);
+			evicted = TRUE;
+		}
+		bo = prev;
+	}
+	return evicted;
+}
+
+void armsoc_device_set_map_budget(struct armsoc_device *dev,
+			uint64_t bytes)
+{
+	dev->map_budget = bytes;
+}
+
+/* Enforce the mapping budget and drop idle mappings. Must be called
+ * where no pointer returned by armsoc_bo_map() is still in use.
+ */
+void armsoc_device_trim_maps(struct armsoc_device *dev)
+{
+	CARD32 now = GetTimeInMillis();
+	struct armsoc_bo *bo;
+
+	dev->map_epoch++;
+	if (!dev->map_budget)
+		return;
+
+	armsoc_device_evict_maps(dev, dev->map_budget);
+
+	bo = dev->map_tail;
+	while (bo && (CARD32)(now - bo->map_used) > MAP_IDLE_MS) {
+		struct armsoc_bo *prev = bo->map_prev;
+
+		if (armsoc_bo_map_evictable(bo))
+			armsoc_bo_unmap(bo);
+		bo = prev;
+	}
+}
+
+static void *armsoc_bo_map_flags(struct armsoc_bo *bo, int flags)
+{
+	struct armsoc_device *dev = bo->dev;
+	struct drm_mode_map_dumb map_dumb;
+	int res;
+
+	assert(bo->refcnt > 0);
+
+	/* the caller may write through the mapping */
+	bo->known_zero = FALSE;
+
+	if (bo->slab) {
+		unsigned char *slab_map =
+			armsoc_bo_map_flags(bo->slab->bo, flags);
+
+		if (!slab_map)
 			return NULL;
+		return slab_map + bo->origin_y * bo->pitch +
+				bo->origin_x * ((bo->bpp + 7) / 8);
+	}
+
+	if (bo->map_addr) {
+		/* fault in the pages now rather than on first touch */
+		if (flags & MAP_POPULATE)
+			madvise(bo->map_addr, bo->original_size,
+					MADV_WILLNEED);
+		armsoc_map_lru_touch(bo);
+		return bo->map_addr;
+	}
+
+	map_dumb.handle = bo->handle;
+
+	res = drmIoctl(dev->fd, DRM_IOCTL_MODE_MAP_DUMB, &map_dumb);
+	if (res)
+		return NULL;
+
+	if (dev->map_budget &&
+			dev->map_bytes + bo->original_size > dev->map_budget)
+		armsoc_device_evict_maps(dev,
+			dev->map_budget > bo->original_size ?
+				dev->map_budget - bo->original_size : 0);
 
-		/* always map/unmap the full buffer for consistency */
+	/* always map/unmap the full buffer for consistency */
+	bo->map_addr = mmap(NULL, bo->original_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | flags,
+			dev->fd, map_dumb.offset);
+
+	if (bo->map_addr == MAP_FAILED && armsoc_device_evict_maps(dev, 0)) {
+		/* out of address space: retry with idle mappings gone */
 		bo->map_addr = mmap(NULL, bo->original_size,
-				PROT_READ | PROT_WRITE, MAP_SHARED,
-				bo->dev->fd, map_dumb.offset);
+				PROT_READ | PROT_WRITE, MAP_SHARED | flags,
+				dev->fd, map_dumb.offset);
+	}
 
-		if (bo->map_addr == MAP_FAILED)
-			bo->map_addr = NULL;
+	if (bo->map_addr == MAP_FAILED) {
+		bo->map_addr = NULL;
+		return NULL;
 	}
 
+	dev->map_bytes += bo->original_size;
+	armsoc_map_lru_touch(bo);
 	return bo->map_addr;
 }
 
+void *armsoc_bo_map(struct armsoc_bo *bo)
+{
+	return armsoc_bo_map_flags(bo, 0);
+}
+
+/* Map a bo that is about to be written in full, e.g. cleared or
+ * uploaded to, faulting all its pages in up front.
+ */
+void *armsoc_bo_map_prefault(struct armsoc_bo *bo)
+{
+	return armsoc_bo_map_flags(bo, MAP_POPULATE);
+}
+
 int armsoc_bo_cpu_prep(struct armsoc_bo *bo, enum armsoc_gem_op op)
 {
 	int ret = 0;
 
 	assert(bo->refcnt > 0);
+	if (op & ARMSOC_GEM_WRITE)
+		bo->known_zero = FALSE;
+
 	if (armsoc_bo_has_dmabuf(bo)) {
 		fd_set fds;
 		/* 10s before printing a msg */
@@ -346,6 +1146,12 @@ int armsoc_bo_cpu_prep(struct armsoc_bo *bo, enum armsoc_gem_op op)
 int armsoc_bo_cpu_fini(struct armsoc_bo *bo, enum armsoc_gem_op op)
 {
 	assert(bo->refcnt > 0);
+	/* msync() wants a page aligned address */
+	if (bo->slab)
+		return armsoc_bo_cpu_fini(bo->slab->bo, op);
+	/* nothing to write back if the mapping has been dropped */
+	if (!bo->map_addr)
+		return 0;
 	return msync(bo->map_addr, bo->size, MS_SYNC | MS_INVALIDATE);
 }
 
@@ -356,6 +1162,9 @@ int armsoc_bo_add_fb(struct armsoc_bo *bo)
 	assert(bo->refcnt > 0);
 	assert(bo->fb_id == 0);
 
+	if (bo->slab)
+		return -EINVAL;
+
 	if (bo->bpp == 32 && bo->depth == 32 && !bo->dev->alpha_supported)
 		depth = 24;
 
@@ -404,12 +1213,28 @@ uint32_t armsoc_bo_get_fb(struct armsoc_bo *bo)
 	return bo->fb_id;
 }
 
+void armsoc_bo_mark_dirty(struct armsoc_bo *bo)
+{
+	assert(bo->refcnt > 0);
+	bo->known_zero = FALSE;
+}
+
 int armsoc_bo_clear(struct armsoc_bo *bo)
 {
 	unsigned char *dst;
+	uint32_t y;
 
 	assert(bo->refcnt > 0);
-	dst = armsoc_bo_map(bo);
+	/* a bo shared by name may be written by other processes any time */
+	if (bo->known_zero && !bo->name)
+		return 0;
+
+	if (bo->dev->fill && !bo->dev->fill(bo->dev->fill_data, bo, 0)) {
+		bo->known_zero = TRUE;
+		return 0;
+	}
+
+	dst = armsoc_bo_map_prefault(bo);
 	if (!dst) {
 		xf86DrvMsg(-1, X_ERROR,
 				"Couldn't map scanout bo\n");
@@ -421,16 +1246,25 @@ int armsoc_bo_clear(struct armsoc_bo *bo)
 			__func__);
 		return -1;
 	}
-	memset(dst, 0x0, bo->size);
+	if (bo->slab) {
+		/* only our cell of the slab's rows */
+		for (y = 0; y < bo->height; y++)
+			memset(dst + y * bo->pitch, 0x0,
+				bo->width * ((bo->bpp + 7) / 8));
+	} else {
+		memset(dst, 0x0, bo->size);
+	}
 	(void)armsoc_bo_cpu_fini(bo, ARMSOC_GEM_WRITE);
+	bo->known_zero = TRUE;
 	return 0;
 }
 
-int armsoc_bo_resize(struct armsoc_bo *bo, uint32_t new_width,
-						uint32_t new_height)
+static int bo_resize(struct armsoc_bo *bo, uint32_t new_width,
+		uint32_t new_height, Bool keep_pitch)
 {
 	uint32_t new_size;
 	uint32_t new_pitch;
+	uint32_t cpp = (armsoc_bo_bpp(bo) + 7) / 8;
 
 	assert(bo != NULL);
 	assert(new_width > 0);
@@ -441,18 +1275,25 @@ int armsoc_bo_resize(struct armsoc_bo *bo, uint32_t new_width,
 	assert(bo->fb_id == 0);
 	assert(bo->refcnt > 0);
 
+	if (bo->slab)
+		return -1;
+
 	xf86DrvMsg(-1, X_INFO, "Resizing bo from %dx%d to %dx%d\n",
 			bo->width, bo->height, new_width, new_height);
 
-	/* TODO: MIDEGL-1563: Get pitch from DRM as
-	 * only DRM knows the ideal pitch and alignment
-	 * requirements
-	 * */
-	new_pitch  = new_width * ((armsoc_bo_bpp(bo)+7)/8);
-	/* Align pitch to 64 byte */
-	new_pitch  = ALIGN(new_pitch, 64);
+	/* When asked, keep the pitch the memory was allocated with if the
+	 * new width fits in it: that pitch is known to suit the DRM, and
+	 * rows keep their place so the existing contents are preserved.
+	 * Otherwise ask the backend what pitch it would use.
+	 */
+	if (keep_pitch && new_width * cpp <= bo->original_pitch)
+		new_pitch = bo->original_pitch;
+	else if (bo->dev->get_pitch)
+		new_pitch = bo->dev->get_pitch(new_width, armsoc_bo_bpp(bo));
+	else
+		new_pitch = ALIGN(new_width * cpp, 64);
 	new_size   = (((new_height-1) * new_pitch) +
-			(new_width * ((armsoc_bo_bpp(bo)+7)/8)));
+			(new_width * cpp));
 
 	if (new_size <= bo->original_size) {
 		bo->width  = new_width;
@@ -464,3 +1305,41 @@ int armsoc_bo_resize(struct armsoc_bo *bo, uint32_t new_width,
 	xf86DrvMsg(-1, X_ERROR, "Failed to resize buffer\n");
 	return -1;
 }
+
+int armsoc_bo_resize(struct armsoc_bo *bo, uint32_t new_width,
+						uint32_t new_height)
+{
+	return bo_resize(bo, new_width, new_height, FALSE);
+}
+
+/* Resize a bo in place, keeping its original pitch where the new width
+ * fits, and give it a new fb for the new size. The old fb may still be
+ * scanned out, so it is not removed but returned in old_fb_id (0 if the
+ * bo had none) for the caller to remove with drmModeRmFB() once the CRTCs
+ * have moved to the new one. On failure the bo is unchanged.
+ */
+int armsoc_bo_resize_fb(struct armsoc_bo *bo, uint32_t new_width,
+			uint32_t new_height, uint32_t *old_fb_id)
+{
+	struct armsoc_bo old = *bo;
+
+	assert(bo->refcnt > 0);
+
+	bo->fb_id = 0;
+	if (bo_resize(bo, new_width, new_height, TRUE))
+		goto fail;
+
+	if (old.fb_id && armsoc_bo_add_fb(bo))
+		goto fail;
+
+	*old_fb_id = old.fb_id;
+	return 0;
+
+fail:
+	bo->width = old.width;
+	bo->height = old.height;
+	bo->pitch = old.pitch;
+	bo->size = old.size;
+	bo->fb_id = old.fb_id;
+	return -1;
+}
@@ -40,6 +40,38 @@ enum armsoc_buf_type {
 	ARMSOC_BO_NON_SCANOUT
 };
 
+/* What a bo was allocated for, for the per-type memory accounting.
+ * Bos start as ARMSOC_USAGE_SCANOUT or ARMSOC_USAGE_PIXMAP by buf_type.
+ */
+enum armsoc_bo_usage {
+	ARMSOC_USAGE_PIXMAP,
+	ARMSOC_USAGE_SCANOUT,
+	ARMSOC_USAGE_DRI2,
+	ARMSOC_USAGE_CURSOR,
+	ARMSOC_USAGE_COUNT
+};
+
+struct armsoc_mem_stats {
+	/* bytes of live and deferred bos, by usage */
+	uint64_t bytes[ARMSOC_USAGE_COUNT];
+	uint64_t peak;
+	/* times the evict hook was called, and what it and
+	 * flushing the deferred bos gave back */
+	unsigned long evictions;
+	uint64_t evicted;
+};
+
+/* How the CPU mapping of a bo should be cached. This is a hint that
+ * each backend maps onto its GEM flags where it has any; DEFAULT keeps
+ * the backend's usual placement.
+ */
+enum armsoc_cache_type {
+	ARMSOC_CACHE_DEFAULT,
+	ARMSOC_CACHE_CACHED,
+	ARMSOC_CACHE_WRITECOMBINE,
+	ARMSOC_CACHE_UNCACHED
+};
+
 /*
  * Generic GEM object information used to abstract custom GEM creation
  * for every DRM driver.
@@ -50,6 +82,7 @@ struct armsoc_create_gem {
 	uint32_t width;
 	uint32_t bpp;
 	enum armsoc_buf_type buf_type;
+	enum armsoc_cache_type cache_type;
 	/* handle, pitch, size will be returned */
 	uint32_t handle;
 	uint32_t pitch;
@@ -57,11 +90,33 @@ struct armsoc_create_gem {
 };
 
 struct armsoc_device *armsoc_device_new(int fd,
-	int (*create_custom_gem)(int fd, struct armsoc_create_gem *create_gem));
+	int (*create_custom_gem)(int fd, struct armsoc_create_gem *create_gem),
+	uint32_t (*get_pitch)(uint32_t width, uint32_t bpp));
 void armsoc_device_del(struct armsoc_device *dev);
+void armsoc_device_set_fill(struct armsoc_device *dev,
+	int (*fill)(void *data, struct armsoc_bo *bo, uint32_t color),
+	void *data);
+/* Bos are destroyed lazily once unreferenced; this destroys them now */
+unsigned int armsoc_device_flush_deferred(struct armsoc_device *dev);
+/* Bytes of all bos not destroyed yet, deferred ones included */
+uint64_t armsoc_device_total_bytes(struct armsoc_device *dev);
+/* Soft limit on the bytes of all bos, 0 for none. Allocating past
+ * 90% of it, or a failed allocation, calls the evict hook to release
+ * some memory.
+ */
+void armsoc_device_set_budget(struct armsoc_device *dev, uint64_t bytes);
+void armsoc_device_set_evict(struct armsoc_device *dev,
+	void (*evict)(void *data, uint64_t bytes), void *data);
+void armsoc_device_get_mem_stats(struct armsoc_device *dev,
+	struct armsoc_mem_stats *stats);
+void armsoc_bo_set_usage(struct armsoc_bo *bo, enum armsoc_bo_usage usage);
 int armsoc_bo_get_name(struct armsoc_bo *bo, uint32_t *name);
 uint32_t armsoc_bo_handle(struct armsoc_bo *bo);
 void *armsoc_bo_map(struct armsoc_bo *bo);
+void *armsoc_bo_map_prefault(struct armsoc_bo *bo);
+void armsoc_device_set_map_budget(struct armsoc_device *dev,
+	uint64_t bytes);
+void armsoc_device_trim_maps(struct armsoc_device *dev);
 int armsoc_get_param(struct armsoc_device *dev, uint64_t param,
 			uint64_t *value);
 int armsoc_bo_add_fb(struct armsoc_bo *bo);
@@ -74,11 +129,23 @@ struct armsoc_bo *armsoc_bo_new_with_dim(struct armsoc_device *dev,
 			uint32_t width,
 			uint32_t height, uint8_t depth, uint8_t bpp,
 			enum armsoc_buf_type buf_type);
+struct armsoc_bo *armsoc_bo_new_with_cache(struct armsoc_device *dev,
+			uint32_t width,
+			uint32_t height, uint8_t depth, uint8_t bpp,
+			enum armsoc_buf_type buf_type,
+			enum armsoc_cache_type cache_type);
+struct armsoc_bo *armsoc_bo_new_from_slab(struct armsoc_device *dev,
+			uint32_t width, uint32_t height, uint8_t depth,
+			uint8_t bpp, enum armsoc_cache_type cache_type);
+struct armsoc_bo *armsoc_bo_from_handle(struct armsoc_device *dev,
+			uint32_t handle, uint32_t width, uint32_t height,
+			uint8_t depth, uint8_t bpp, uint32_t pitch);
 uint32_t armsoc_bo_width(struct armsoc_bo *bo);
 uint32_t armsoc_bo_height(struct armsoc_bo *bo);
 uint8_t armsoc_bo_depth(struct armsoc_bo *bo);
 uint32_t armsoc_bo_bpp(struct armsoc_bo *bo);
 uint32_t armsoc_bo_pitch(struct armsoc_bo *bo);
+enum armsoc_cache_type armsoc_bo_cache_type(struct armsoc_bo *bo);
 
 void armsoc_bo_reference(struct armsoc_bo *bo);
 void armsoc_bo_unreference(struct armsoc_bo *bo);
@@ -89,10 +156,22 @@ void armsoc_bo_unreference(struct armsoc_bo *bo);
 int armsoc_bo_set_dmabuf(struct armsoc_bo *bo);
 void armsoc_bo_clear_dmabuf(struct armsoc_bo *bo);
 int armsoc_bo_has_dmabuf(struct armsoc_bo *bo);
+/* True if anything besides a single owner can see the bo: it has a
+ * flink name, a dma_buf fd, a framebuffer or more than one reference.
+ */
+int armsoc_bo_is_shared(struct armsoc_bo *bo);
+int armsoc_bo_is_slab(struct armsoc_bo *bo);
+void armsoc_bo_origin(struct armsoc_bo *bo, uint32_t *x, uint32_t *y);
 int armsoc_bo_clear(struct armsoc_bo *bo);
+/* Must be called when a bo is written other than through its CPU mapping
+ * or an export, e.g. by a blitter, so a later clear isn't skipped.
+ */
+void armsoc_bo_mark_dirty(struct armsoc_bo *bo);
 int armsoc_bo_rm_fb(struct armsoc_bo *bo);
 int armsoc_bo_resize(struct armsoc_bo *bo, uint32_t new_width,
 						uint32_t new_height);
+int armsoc_bo_resize_fb(struct armsoc_bo *bo, uint32_t new_width,
+			uint32_t new_height, uint32_t *old_fb_id);
 
 
 #endif /* ARMSOC_DUMB_H_ */
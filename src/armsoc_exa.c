@@ -31,8 +31,7 @@
 
 #include "armsoc_exa.h"
 #include "armsoc_driver.h"
-#include "umplock/umplock_ioctl.h"
-#include <sys/ioctl.h>
+#include <string.h>
 #include <unistd.h>
 
 /* keep this here, instead of static-inline so submodule doesn't
@@ -59,6 +58,10 @@ ARMSOCPixmapExchange(PixmapPtr a, PixmapPtr b)
 	struct ARMSOCPixmapPrivRec *bpriv = exaGetPixmapDriverPrivate(b);
 	exchange(apriv->priv, bpriv->priv);
 	exchange(apriv->bo, bpriv->bo);
+	exchange(apriv->sysmem, bpriv->sysmem);
+	exchange(apriv->sysmem_size, bpriv->sysmem_size);
+	exchange(apriv->cpu_access_cnt, bpriv->cpu_access_cnt);
+	exchange(apriv->accel_access_cnt, bpriv->accel_access_cnt);
 
 	/* Ensure neither pixmap has a dmabuf fd attached to the bo if the
 	 * ext_access_cnt refcount is 0, as it will never be cleared. */
@@ -75,6 +78,495 @@ ARMSOCPixmapExchange(PixmapPtr a, PixmapPtr b)
 	}
 }
 
+/*
+ * Pixmaps the CPU renders to and reads back far more than anything
+ * else get cached memory: glyphs, which are composited in software,
+ * and the server's scratch pixmaps. Anything that may be scanned out
+ * or shared keeps the backend's default.
+ */
+static enum armsoc_cache_type
+ARMSOCCacheTypeForUsage(int usage_hint)
+{
+	if (usage_hint & ARMSOC_CREATE_PIXMAP_SCANOUT)
+		return ARMSOC_CACHE_DEFAULT;
+
+	switch (usage_hint) {
+	case CREATE_PIXMAP_USAGE_GLYPH_PICTURE:
+	case CREATE_PIXMAP_USAGE_SCRATCH:
+		return ARMSOC_CACHE_CACHED;
+	default:
+		return ARMSOC_CACHE_DEFAULT;
+	}
+}
+
+/*
+ * With PixmapMigration enabled, a pixmap's placement is reviewed every
+ * ARMSOC_ACCESS_WINDOW accesses. When CPU accesses outnumber accelerated
+ * operations by ARMSOC_MIGRATE_RATIO its bo is queued to move to cached
+ * memory, and the other way round back to the backend's default. The
+ * BlockHandler copies at most ARMSOC_MIGRATE_PER_BLOCK bos each time so
+ * a burst of migrations doesn't stall the server.
+ */
+#define ARMSOC_ACCESS_WINDOW		32
+#define ARMSOC_MIGRATE_RATIO		4
+#define ARMSOC_MIGRATE_PER_BLOCK	4
+
+static Bool
+ARMSOCPixmapCanMigrate(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	/* nobody else may hold on to the bo we replace */
+	return priv->bo && !priv->ext_access_cnt &&
+			!(priv->usage_hint & ARMSOC_CREATE_PIXMAP_SCANOUT) &&
+			priv->bo != pARMSOC->scanout &&
+			!armsoc_bo_is_shared(priv->bo);
+}
+
+static enum armsoc_cache_type
+ARMSOCPixmapWantedCacheType(struct ARMSOCPixmapPrivRec *priv)
+{
+	if (priv->cpu_access_cnt >
+			ARMSOC_MIGRATE_RATIO * priv->accel_access_cnt)
+		return ARMSOC_CACHE_CACHED;
+	if (priv->accel_access_cnt >
+			ARMSOC_MIGRATE_RATIO * priv->cpu_access_cnt)
+		return ARMSOC_CACHE_DEFAULT;
+	return armsoc_bo_cache_type(priv->bo);
+}
+
+static void
+ARMSOCPixmapReviewPlacement(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	if (!pARMSOC->PixmapMigration || !priv->bo)
+		return;
+
+	if (priv->cpu_access_cnt + priv->accel_access_cnt <
+			ARMSOC_ACCESS_WINDOW)
+		return;
+
+	if (!priv->migrate_queued &&
+			pARMSOC->migrate_queue_len < ARMSOC_MIGRATE_QUEUE_SIZE &&
+			ARMSOCPixmapWantedCacheType(priv) !=
+				armsoc_bo_cache_type(priv->bo) &&
+			ARMSOCPixmapCanMigrate(pARMSOC, priv)) {
+		pARMSOC->migrate_queue[pARMSOC->migrate_queue_len++] = priv;
+		priv->migrate_queued = TRUE;
+	}
+
+	priv->cpu_access_cnt /= 2;
+	priv->accel_access_cnt /= 2;
+}
+
+static void
+ARMSOCMigrateDequeue(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	int i;
+
+	for (i = 0; i < pARMSOC->migrate_queue_len; i++) {
+		if (pARMSOC->migrate_queue[i] == priv) {
+			pARMSOC->migrate_queue_len--;
+			memmove(&pARMSOC->migrate_queue[i],
+				&pARMSOC->migrate_queue[i + 1],
+				(pARMSOC->migrate_queue_len - i) *
+					sizeof(pARMSOC->migrate_queue[0]));
+			break;
+		}
+	}
+	priv->migrate_queued = FALSE;
+}
+
+/*
+ * Replace the pixmap's bo with a copy in memory of the other caching
+ * type. The pixmap's devKind isn't reachable from here, so the new bo
+ * must have the same pitch; backends pick the pitch from the width and
+ * bpp only, so in practice it always does.
+ */
+static Bool
+ARMSOCMigratePixmap(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	struct armsoc_bo *old_bo = priv->bo;
+	struct armsoc_bo *new_bo;
+	enum armsoc_cache_type cache_type;
+	void *src, *dst;
+
+	if (!ARMSOCPixmapCanMigrate(pARMSOC, priv))
+		return FALSE;
+
+	cache_type = armsoc_bo_cache_type(old_bo) == ARMSOC_CACHE_CACHED ?
+			ARMSOC_CACHE_DEFAULT : ARMSOC_CACHE_CACHED;
+
+	new_bo = armsoc_bo_new_with_cache(pARMSOC->dev,
+			armsoc_bo_width(old_bo), armsoc_bo_height(old_bo),
+			armsoc_bo_depth(old_bo), armsoc_bo_bpp(old_bo),
+			ARMSOC_BO_NON_SCANOUT, cache_type);
+	if (!new_bo)
+		return FALSE;
+
+	if (armsoc_bo_pitch(new_bo) != armsoc_bo_pitch(old_bo))
+		goto fail;
+
+	src = armsoc_bo_map(old_bo);
+	dst = armsoc_bo_map_prefault(new_bo);
+	if (!src || !dst)
+		goto fail;
+
+	if (armsoc_bo_cpu_prep(old_bo, ARMSOC_GEM_READ))
+		goto fail;
+	if (armsoc_bo_cpu_prep(new_bo, ARMSOC_GEM_WRITE)) {
+		armsoc_bo_cpu_fini(old_bo, ARMSOC_GEM_READ);
+		goto fail;
+	}
+
+	memcpy(dst, src,
+		armsoc_bo_pitch(old_bo) * armsoc_bo_height(old_bo));
+
+	armsoc_bo_cpu_fini(new_bo, ARMSOC_GEM_WRITE);
+	armsoc_bo_cpu_fini(old_bo, ARMSOC_GEM_READ);
+
+	priv->bo = new_bo;
+	armsoc_bo_unreference(old_bo);
+	return TRUE;
+
+fail:
+	armsoc_bo_unreference(new_bo);
+	return FALSE;
+}
+
+_X_EXPORT void
+ARMSOCMigratePixmaps(ScreenPtr pScreen)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR_FROM_SCREEN(pScreen);
+	int n = pARMSOC->migrate_queue_len;
+	int i;
+
+	if (n > ARMSOC_MIGRATE_PER_BLOCK)
+		n = ARMSOC_MIGRATE_PER_BLOCK;
+
+	for (i = 0; i < n; i++) {
+		struct ARMSOCPixmapPrivRec *priv = pARMSOC->migrate_queue[i];
+
+		priv->migrate_queued = FALSE;
+		ARMSOCMigratePixmap(pARMSOC, priv);
+	}
+
+	pARMSOC->migrate_queue_len -= n;
+	memmove(&pARMSOC->migrate_queue[0], &pARMSOC->migrate_queue[n],
+		pARMSOC->migrate_queue_len * sizeof(pARMSOC->migrate_queue[0]));
+}
+
+static void
+ARMSOCPixmapLruUnlink(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	if (priv->lru_prev)
+		priv->lru_prev->lru_next = priv->lru_next;
+	else
+		pARMSOC->pixmap_lru_head = priv->lru_next;
+	if (priv->lru_next)
+		priv->lru_next->lru_prev = priv->lru_prev;
+	else
+		pARMSOC->pixmap_lru_tail = priv->lru_prev;
+	priv->lru_prev = NULL;
+	priv->lru_next = NULL;
+}
+
+static void
+ARMSOCPixmapLruPush(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	priv->lru_prev = NULL;
+	priv->lru_next = pARMSOC->pixmap_lru_head;
+	if (pARMSOC->pixmap_lru_head)
+		pARMSOC->pixmap_lru_head->lru_prev = priv;
+	else
+		pARMSOC->pixmap_lru_tail = priv;
+	pARMSOC->pixmap_lru_head = priv;
+}
+
+static void
+ARMSOCPixmapTouch(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	priv->last_used = GetTimeInMillis();
+
+	/* only pixmaps ModifyPixmapHeader has seen are on the list */
+	if (!priv->pixmap || pARMSOC->pixmap_lru_head == priv)
+		return;
+
+	ARMSOCPixmapLruUnlink(pARMSOC, priv);
+	ARMSOCPixmapLruPush(pARMSOC, priv);
+}
+
+_X_EXPORT void
+ARMSOCPixmapAccelAccess(PixmapPtr pPixmap)
+{
+	struct ARMSOCPixmapPrivRec *priv = exaGetPixmapDriverPrivate(pPixmap);
+	struct ARMSOCRec *pARMSOC;
+
+	if (!priv)
+		return;
+
+	pARMSOC = ARMSOCPTR_FROM_SCREEN(pPixmap->drawable.pScreen);
+	ARMSOCPixmapTouch(pARMSOC, priv);
+	priv->accel_access_cnt++;
+	priv->accel_access_total++;
+	priv->accel_counted = TRUE;
+	ARMSOCPixmapReviewPlacement(pARMSOC, priv);
+}
+
+/*
+ * A refused operation is done by the CPU instead. The PrepareAccess of
+ * that fallback says nothing about how the pixmap is used, and counting
+ * it would keep a cached pixmap the blitter refuses from ever getting
+ * enough accelerated operations ahead to migrate back.
+ */
+_X_EXPORT void
+ARMSOCPixmapAccelDone(PixmapPtr pPixmap, Bool accepted)
+{
+	struct ARMSOCPixmapPrivRec *priv;
+
+	if (!pPixmap)
+		return;
+
+	priv = exaGetPixmapDriverPrivate(pPixmap);
+	if (!priv)
+		return;
+
+	priv->fallback_pending = priv->accel_counted && !accepted;
+	priv->accel_counted = FALSE;
+}
+
+/*
+ * Pixmaps of at most SmallPixmapThreshold bytes that will never be
+ * scanned out (1x1 fill sources, icons, glyphs) are kept in malloc'd
+ * memory, saving the GEM allocation, mmap and destroy ioctls. EXA's
+ * driver mode only lets the driver hand out pixmap memory through
+ * PrepareAccess, so they still report offscreen and PrepareAccess
+ * points them at the malloc'd copy.
+ */
+static uint32_t
+ARMSOCSysmemPitch(int width, int bitsPerPixel)
+{
+	return ((width * bitsPerPixel + 31) / 32) * 4;
+}
+
+static Bool
+ARMSOCPixmapWantsSysmem(struct ARMSOCRec *pARMSOC, int usage_hint,
+		int width, int height, int bitsPerPixel)
+{
+	return pARMSOC->SmallPixmapThreshold &&
+			!(usage_hint & ARMSOC_CREATE_PIXMAP_SCANOUT) &&
+			ARMSOCSysmemPitch(width, bitsPerPixel) * height <=
+				pARMSOC->SmallPixmapThreshold;
+}
+
+static Bool
+ARMSOCPixmapAllocSysmem(struct ARMSOCPixmapPrivRec *priv,
+		int width, int height, int bitsPerPixel)
+{
+	uint32_t size = ARMSOCSysmemPitch(width, bitsPerPixel) * height;
+
+	if (priv->sysmem && size <= priv->sysmem_size)
+		return TRUE;
+
+	free(priv->sysmem);
+	/* zeroed, like memory fresh from the kernel */
+	priv->sysmem = calloc(1, size);
+	priv->sysmem_size = priv->sysmem ? size : 0;
+	return priv->sysmem != NULL;
+}
+
+static void
+ARMSOCPixmapFreeSysmem(struct ARMSOCPixmapPrivRec *priv)
+{
+	free(priv->sysmem);
+	priv->sysmem = NULL;
+	priv->sysmem_size = 0;
+}
+
+_X_EXPORT Bool
+ARMSOCPixmapPromote(PixmapPtr pPixmap)
+{
+	struct ARMSOCPixmapPrivRec *priv = exaGetPixmapDriverPrivate(pPixmap);
+	ScrnInfoPtr pScrn = pix2scrn(pPixmap);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	uint32_t src_pitch, dst_pitch, row_bytes;
+	struct armsoc_bo *old_bo;
+	struct armsoc_bo *bo;
+	unsigned char *src, *dst;
+	int y;
+
+	if (!priv)
+		return FALSE;
+
+	old_bo = priv->bo;
+	if (old_bo && !armsoc_bo_is_slab(old_bo)) {
+		/* about to be shared: keep it where it is from now on */
+		if (priv->migrate_queued)
+			ARMSOCMigrateDequeue(pARMSOC, priv);
+		if (armsoc_bo_cache_type(old_bo) != ARMSOC_CACHE_CACHED)
+			return TRUE;
+		/* other devices wouldn't see CPU writes still sitting in
+		 * the cache, and once shared the bo can't move back */
+		return ARMSOCMigratePixmap(pARMSOC, priv);
+	}
+	if (!old_bo && !priv->sysmem)
+		return FALSE;
+
+	/* promoted to be exported or used by the blitter, so it gets
+	 * the backend's default memory whatever its usage */
+	bo = armsoc_bo_new_with_cache(pARMSOC->dev,
+			pPixmap->drawable.width, pPixmap->drawable.height,
+			pPixmap->drawable.depth, pPixmap->drawable.bitsPerPixel,
+			ARMSOC_BO_NON_SCANOUT, ARMSOC_CACHE_DEFAULT);
+	if (!bo) {
+		ERROR_MSG("failed to promote %dx%d pixmap to a bo",
+				pPixmap->drawable.width,
+				pPixmap->drawable.height);
+		return FALSE;
+	}
+
+	if (old_bo) {
+		/* leaving a slab */
+		src = armsoc_bo_map(old_bo);
+		src_pitch = armsoc_bo_pitch(old_bo);
+		if (!src || armsoc_bo_cpu_prep(old_bo, ARMSOC_GEM_READ))
+			goto fail;
+	} else {
+		src = priv->sysmem;
+		src_pitch = ARMSOCSysmemPitch(pPixmap->drawable.width,
+				pPixmap->drawable.bitsPerPixel);
+	}
+
+	dst = armsoc_bo_map_prefault(bo);
+	if (!dst || armsoc_bo_cpu_prep(bo, ARMSOC_GEM_WRITE)) {
+		if (old_bo)
+			armsoc_bo_cpu_fini(old_bo, ARMSOC_GEM_READ);
+		goto fail;
+	}
+
+	dst_pitch = armsoc_bo_pitch(bo);
+	row_bytes = (pPixmap->drawable.width *
+			pPixmap->drawable.bitsPerPixel + 7) / 8;
+	for (y = 0; y < pPixmap->drawable.height; y++)
+		memcpy(dst + y * dst_pitch, src + y * src_pitch, row_bytes);
+
+	armsoc_bo_cpu_fini(bo, ARMSOC_GEM_WRITE);
+
+	if (old_bo) {
+		armsoc_bo_cpu_fini(old_bo, ARMSOC_GEM_READ);
+		armsoc_bo_unreference(old_bo);
+	}
+	ARMSOCPixmapFreeSysmem(priv);
+	priv->bo = bo;
+	pPixmap->devKind = dst_pitch;
+	return TRUE;
+
+fail:
+	armsoc_bo_unreference(bo);
+	return FALSE;
+}
+
+/*
+ * Under memory pressure, pixmaps unused for ARMSOC_COLD_PIXMAP_MS move
+ * from their bo to system memory, least recently used first, the same
+ * way small pixmaps start out. ARMSOCPixmapPromote() gives them a bo
+ * again when the blitter or a client needs one.
+ */
+#define ARMSOC_COLD_PIXMAP_MS	5000
+
+static uint32_t
+ARMSOCPixmapDemote(struct ARMSOCRec *pARMSOC,
+		struct ARMSOCPixmapPrivRec *priv)
+{
+	PixmapPtr pPixmap = priv->pixmap;
+	struct armsoc_bo *bo = priv->bo;
+	uint32_t src_pitch, dst_pitch, row_bytes, size;
+	unsigned char *src, *dst;
+	int y;
+
+	/* not while the CPU has it mapped, see PrepareAccess */
+	if (!ARMSOCPixmapCanMigrate(pARMSOC, priv) ||
+			pPixmap->devPrivate.ptr)
+		return 0;
+
+	src = armsoc_bo_map(bo);
+	if (!src || armsoc_bo_cpu_prep(bo, ARMSOC_GEM_READ))
+		return 0;
+
+	if (!ARMSOCPixmapAllocSysmem(priv, pPixmap->drawable.width,
+			pPixmap->drawable.height,
+			pPixmap->drawable.bitsPerPixel)) {
+		armsoc_bo_cpu_fini(bo, ARMSOC_GEM_READ);
+		return 0;
+	}
+
+	src_pitch = armsoc_bo_pitch(bo);
+	dst = priv->sysmem;
+	dst_pitch = ARMSOCSysmemPitch(pPixmap->drawable.width,
+			pPixmap->drawable.bitsPerPixel);
+	row_bytes = (pPixmap->drawable.width *
+			pPixmap->drawable.bitsPerPixel + 7) / 8;
+	for (y = 0; y < pPixmap->drawable.height; y++)
+		memcpy(dst + y * dst_pitch, src + y * src_pitch, row_bytes);
+
+	armsoc_bo_cpu_fini(bo, ARMSOC_GEM_READ);
+
+	if (priv->migrate_queued)
+		ARMSOCMigrateDequeue(pARMSOC, priv);
+
+	size = armsoc_bo_size(bo);
+	priv->bo = NULL;
+	/* pixmap drops ref on its bo */
+	armsoc_bo_unreference(bo);
+	pPixmap->devKind = dst_pitch;
+	return size;
+}
+
+_X_EXPORT uint64_t
+ARMSOCEvictPixmaps(ScreenPtr pScreen, uint64_t bytes)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR_FROM_SCREEN(pScreen);
+	struct ARMSOCPixmapPrivRec *priv, *prev;
+	CARD32 now = GetTimeInMillis();
+	uint64_t freed = 0;
+
+	for (priv = pARMSOC->pixmap_lru_tail; priv && freed < bytes;
+			priv = prev) {
+		prev = priv->lru_prev;
+		if (now - priv->last_used < ARMSOC_COLD_PIXMAP_MS)
+			break;
+		freed += ARMSOCPixmapDemote(pARMSOC, priv);
+	}
+
+	return freed;
+}
+
+/*
+ * With PixmapSlabs enabled, non-scanout pixmaps small enough to fit a
+ * slab cell share a bo with others of the same bpp and caching type,
+ * see armsoc_bo_new_from_slab(). ARMSOCPixmapPromote() moves them out
+ * before they are exported.
+ */
+static struct armsoc_bo *
+ARMSOCPixmapBoNew(struct ARMSOCRec *pARMSOC, int width, int height,
+		int depth, int bitsPerPixel, enum armsoc_buf_type buf_type,
+		enum armsoc_cache_type cache_type)
+{
+	struct armsoc_bo *bo = NULL;
+
+	if (pARMSOC->PixmapSlabs && buf_type == ARMSOC_BO_NON_SCANOUT)
+		bo = armsoc_bo_new_from_slab(pARMSOC->dev, width, height,
+				depth, bitsPerPixel, cache_type);
+	if (!bo)
+		bo = armsoc_bo_new_with_cache(pARMSOC->dev, width, height,
+				depth, bitsPerPixel, buf_type, cache_type);
+	return bo;
+}
+
 _X_EXPORT void *
 ARMSOCCreatePixmap2(ScreenPtr pScreen, int width, int height,
 		int depth, int usage_hint, int bitsPerPixel,
@@ -91,13 +583,20 @@ ARMSOCCreatePixmap2(ScreenPtr pScreen, int width, int height,
 	if (usage_hint & ARMSOC_CREATE_PIXMAP_SCANOUT)
 		buf_type = ARMSOC_BO_SCANOUT;
 
-	if (width > 0 && height > 0 && depth > 0 && bitsPerPixel > 0) {
+	if (width > 0 && height > 0 && depth > 0 && bitsPerPixel > 0 &&
+			ARMSOCPixmapWantsSysmem(pARMSOC, usage_hint,
+				width, height, bitsPerPixel) &&
+			ARMSOCPixmapAllocSysmem(priv, width, height,
+				bitsPerPixel)) {
+		*new_fb_pitch = ARMSOCSysmemPitch(width, bitsPerPixel);
+	} else if (width > 0 && height > 0 && depth > 0 && bitsPerPixel > 0) {
 		/* Pixmap creates and takes a ref on its bo */
-		priv->bo = armsoc_bo_new_with_dim(pARMSOC->dev,
+		priv->bo = ARMSOCPixmapBoNew(pARMSOC,
 				width,
 				height,
 				depth,
-				bitsPerPixel, buf_type);
+				bitsPerPixel, buf_type,
+				ARMSOCCacheTypeForUsage(usage_hint));
 
 		if ((!priv->bo) && ARMSOC_BO_SCANOUT == buf_type) {
 			/* Tried to create a scanout but failed. Attempt to
@@ -130,6 +629,15 @@ ARMSOCCreatePixmap2(ScreenPtr pScreen, int width, int height,
 	 * parameter, beware of any unexpected values!
 	 */
 	priv->usage_hint = usage_hint;
+	priv->last_used = GetTimeInMillis();
+
+	if (armsoc_profile_enabled) {
+		priv->created_us = armsoc_perf_now_us();
+		armsoc_profile_pixmap_new(width, height, bitsPerPixel,
+				usage_hint & ~ARMSOC_CREATE_PIXMAP_SCANOUT,
+				buf_type == ARMSOC_BO_SCANOUT,
+				priv->sysmem != NULL);
+	}
 
 	return priv;
 }
@@ -138,9 +646,24 @@ _X_EXPORT void
 ARMSOCDestroyPixmap(ScreenPtr pScreen, void *driverPriv)
 {
 	struct ARMSOCPixmapPrivRec *priv = driverPriv;
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR_FROM_SCREEN(pScreen);
 
 	assert(!priv->ext_access_cnt);
 
+	if (priv->migrate_queued)
+		ARMSOCMigrateDequeue(pARMSOC, priv);
+
+	if (priv->pixmap)
+		ARMSOCPixmapLruUnlink(pARMSOC, priv);
+
+	if (armsoc_profile_enabled && priv->created_us)
+		armsoc_profile_pixmap_del(
+				armsoc_perf_now_us() - priv->created_us,
+				priv->cpu_access_total,
+				priv->accel_access_total);
+
+	free(priv->sysmem);
+
 	/* If ModifyPixmapHeader failed, it's possible we don't have a bo
 	 * backing this pixmap. */
 	if (priv->bo) {
@@ -162,6 +685,11 @@ ARMSOCModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 	enum armsoc_buf_type buf_type = ARMSOC_BO_NON_SCANOUT;
 
+	if (!priv->pixmap) {
+		priv->pixmap = pPixmap;
+		ARMSOCPixmapLruPush(pARMSOC, priv);
+	}
+
     /* Only modify specified fields, keeping all others intact. */
 	if (pPixData)
 		pPixmap->devPrivate.ptr = pPixData;
@@ -179,6 +707,7 @@ ARMSOCModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
 		 * Pixmap drops ref on its old bo */
 		armsoc_bo_unreference(priv->bo);
 		priv->bo = NULL;
+		ARMSOCPixmapFreeSysmem(priv);
 
 		/* Returning FALSE calls miModifyPixmapHeader */
 		return FALSE;
@@ -191,6 +720,7 @@ ARMSOCModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
 		priv->bo = pARMSOC->scanout;
 		/* pixmap takes a ref on its new bo */
 		armsoc_bo_reference(priv->bo);
+		ARMSOCPixmapFreeSysmem(priv);
 
 		if (old_bo) {
 			/* We are detaching the old_bo so clear it now. */
@@ -225,18 +755,36 @@ ARMSOCModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
 	if (!pPixmap->drawable.width || !pPixmap->drawable.height)
 		return TRUE;
 
-	assert(priv->bo);
-	if (armsoc_bo_width(priv->bo) != pPixmap->drawable.width ||
+	/* evicted pixmaps stay in system memory until promoted */
+	if (!priv->bo && (priv->sysmem ||
+			ARMSOCPixmapWantsSysmem(pARMSOC, priv->usage_hint,
+				pPixmap->drawable.width,
+				pPixmap->drawable.height,
+				pPixmap->drawable.bitsPerPixel)) &&
+			ARMSOCPixmapAllocSysmem(priv, pPixmap->drawable.width,
+				pPixmap->drawable.height,
+				pPixmap->drawable.bitsPerPixel)) {
+		pPixmap->devKind = ARMSOCSysmemPitch(pPixmap->drawable.width,
+				pPixmap->drawable.bitsPerPixel);
+		return TRUE;
+	}
+
+	/* too big for system memory, or there was no memory for it */
+	ARMSOCPixmapFreeSysmem(priv);
+
+	if (!priv->bo ||
+	    armsoc_bo_width(priv->bo) != pPixmap->drawable.width ||
 	    armsoc_bo_height(priv->bo) != pPixmap->drawable.height ||
 	    armsoc_bo_bpp(priv->bo) != pPixmap->drawable.bitsPerPixel) {
 		/* pixmap drops ref on its old bo */
 		armsoc_bo_unreference(priv->bo);
 		/* pixmap creates new bo and takes ref on it */
-		priv->bo = armsoc_bo_new_with_dim(pARMSOC->dev,
+		priv->bo = ARMSOCPixmapBoNew(pARMSOC,
 				pPixmap->drawable.width,
 				pPixmap->drawable.height,
 				pPixmap->drawable.depth,
-				pPixmap->drawable.bitsPerPixel, buf_type);
+				pPixmap->drawable.bitsPerPixel, buf_type,
+				ARMSOCCacheTypeForUsage(priv->usage_hint));
 
 		if ((!priv->bo) && ARMSOC_BO_SCANOUT == buf_type) {
 			/* Tried to create a scanout but failed. Attempt to
@@ -331,10 +879,26 @@ ARMSOCPrepareAccess(PixmapPtr pPixmap, int index)
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 	uint32_t dmabuf_name = 0;
-	_lock_item_s item;
+	uint64_t start = 0, waited;
+	Bool sync;
 	int ret;
 	struct ARMSOCPixmapPrivRec *priv = exaGetPixmapDriverPrivate(pPixmap);
 
+	ARMSOC_PERF_INC(ARMSOC_PERF_ACCESS);
+	ARMSOCPixmapTouch(pARMSOC, priv);
+	priv->cpu_access_total++;
+
+	if (priv->sysmem) {
+		pPixmap->devPrivate.ptr = priv->sysmem;
+		return TRUE;
+	}
+
+	if (priv->fallback_pending)
+		priv->fallback_pending = FALSE;
+	else
+		priv->cpu_access_cnt++;
+	ARMSOCPixmapReviewPlacement(pARMSOC, priv);
+
 	pPixmap->devPrivate.ptr = armsoc_bo_map(priv->bo);
 	if (!pPixmap->devPrivate.ptr) {
 		xf86DrvMsg(-1, X_ERROR, "%s: Failed to map buffer\n", __func__);
@@ -353,7 +917,15 @@ ARMSOCPrepareAccess(PixmapPtr pPixmap, int index)
 		}
 	}
 
-	if (-1 != pARMSOC->lockFD) {
+	/* only a umplock or a dma_buf can make us wait for another
+	 * device */
+	sync = pARMSOC->umplock || armsoc_bo_has_dmabuf(priv->bo);
+	if (sync) {
+		ARMSOC_PERF_INC(ARMSOC_PERF_ACCESS_SYNC);
+		start = armsoc_perf_now_us();
+	}
+
+	if (pARMSOC->umplock) {
 		ret = armsoc_bo_get_name(priv->bo, &dmabuf_name);
 
 		if (ret) {
@@ -361,23 +933,11 @@ ARMSOCPrepareAccess(PixmapPtr pPixmap, int index)
 			return FALSE;
 		}
 
-		item.secure_id = dmabuf_name;
-		item.usage = _LOCK_ACCESS_CPU_WRITE;
-
-		if (ioctl(pARMSOC->lockFD,  LOCK_IOCTL_CREATE, &item) < 0) {
-			ERROR_MSG("Unable to create lock item\n");
-			return FALSE;
-		}
-		if (ioctl(pARMSOC->lockFD, LOCK_IOCTL_PROCESS, &item) < 0) {
-			int max_retries = 5;
-			ERROR_MSG("Unable to process lock item with ID 0x%x - throttling\n", item.secure_id);
-			while ((ioctl(pARMSOC->lockFD, LOCK_IOCTL_PROCESS, &item) < 0) && max_retries) {
-				usleep(2000);
-				max_retries--;
-			}
-			if (max_retries == 0)
-				ERROR_MSG("Warning: Max retries == 0\n");
-		}
+		/* Failing here would make EXA migrate the pixmap out, which
+		 * it can't, so on error access goes ahead unlocked as it
+		 * always has. The failure is logged and counted.
+		 */
+		armsoc_umplock_acquire(pARMSOC->umplock, dmabuf_name);
 	} else {
 		if (armsoc_bo_cpu_prep(priv->bo, idx2op(index))) {
 			xf86DrvMsg(-1, X_ERROR,
@@ -386,6 +946,12 @@ ARMSOCPrepareAccess(PixmapPtr pPixmap, int index)
 			return FALSE;
 		}
 	}
+
+	waited = sync ? armsoc_perf_now_us() - start : 0;
+	ARMSOC_PERF_ADD(ARMSOC_PERF_ACCESS_WAIT_US, waited);
+	ARMSOC_PERF_MAX(ARMSOC_PERF_ACCESS_MAX_WAIT_US, waited);
+	ARMSOC_TRACE(prepare_access, "pixmap=%p index=%d wait_us=%llu",
+			pPixmap, index, (unsigned long long)waited);
 	return TRUE;
 }
 
@@ -406,9 +972,16 @@ ARMSOCFinishAccess(PixmapPtr pPixmap, int index)
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	struct ARMSOCPixmapPrivRec *priv = exaGetPixmapDriverPrivate(pPixmap);
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
-	if (-1 != pARMSOC->lockFD){
+
+	if (priv->sysmem) {
+		pPixmap->devPrivate.ptr = NULL;
+		return;
+	}
+
+	ARMSOC_TRACE(finish_access, "pixmap=%p index=%d", pPixmap, index);
+
+	if (pARMSOC->umplock) {
 		uint32_t dmabuf_name = 0;
-		_lock_item_s item;
 		int ret;
 
 		pPixmap->devPrivate.ptr = NULL;
@@ -417,9 +990,7 @@ ARMSOCFinishAccess(PixmapPtr pPixmap, int index)
 			ERROR_MSG("could not get buffer name");
 			return ;
 		}
-		item.secure_id = dmabuf_name;
-		item.usage = _LOCK_ACCESS_CPU_WRITE;
-		ioctl(pARMSOC->lockFD, LOCK_IOCTL_RELEASE, &item);
+		armsoc_umplock_release(pARMSOC->umplock, dmabuf_name);
 	}else{
 		/* NOTE: can we use EXA migration module to track which parts of the
 		 * buffer was accessed by sw, and pass that info down to kernel to
@@ -454,7 +1025,7 @@ ARMSOCPixmapIsOffscreen(PixmapPtr pPixmap)
 	 * wrap this function.
 	 */
 	struct ARMSOCPixmapPrivRec *priv = exaGetPixmapDriverPrivate(pPixmap);
-	return priv && priv->bo;
+	return priv && (priv->bo || priv->sysmem);
 }
 
 void ARMSOCRegisterExternalAccess(PixmapPtr pPixmap)
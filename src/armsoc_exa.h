@@ -60,6 +60,24 @@ struct ARMSOCEXARec {
 
 	/* add new fields here at end, to preserve ABI */
 
+	/**
+	 * Optional. Copy a rectangle between two bos, converting between
+	 * their formats if they differ, without going through pixmaps (so it
+	 * can be used at ScreenInit). Returns FALSE if the copy could not be
+	 * done, in which case the caller falls back to the CPU.
+	 */
+	Bool (*CopyBo)(ScrnInfoPtr pScrn, struct armsoc_bo *src,
+			int src_x, int src_y, struct armsoc_bo *dst,
+			int dst_x, int dst_y, int width, int height);
+
+	/**
+	 * Optional. Fill a whole bo with a solid color. Used by the bo layer
+	 * to clear buffers without touching them with the CPU. Returns FALSE
+	 * if the fill could not be done.
+	 */
+	Bool (*FillBo)(ScrnInfoPtr pScrn, struct armsoc_bo *bo,
+			uint32_t color);
+
 };
 
 /**
@@ -104,6 +122,39 @@ struct ARMSOCPixmapPrivRec {
 	int ext_access_cnt;
 	struct armsoc_bo *bo;
 	int usage_hint;
+	/* CPU accesses (PrepareAccess) and accelerated operations seen
+	 * since the placement of the bo was last reviewed. Halved on every
+	 * review so they follow the recent access pattern.
+	 */
+	unsigned int cpu_access_cnt;
+	unsigned int accel_access_cnt;
+	/* The operation being prepared was counted as accelerated, and
+	 * once refused, the PrepareAccess of its CPU fallback is not to be
+	 * counted, see ARMSOCPixmapAccelDone().
+	 */
+	Bool accel_counted;
+	Bool fallback_pending;
+	/* bo is waiting in the migration queue */
+	Bool migrate_queued;
+	/* Small pixmaps are kept in malloc'd memory instead of a bo until
+	 * they are exported or accelerated, see ARMSOCPixmapPromote().
+	 * At most one of bo and sysmem is set.
+	 */
+	void *sysmem;
+	uint32_t sysmem_size;
+	/* The pixmap, once ModifyPixmapHeader has seen it, and its place
+	 * in the screen's LRU used to find cold pixmaps to evict.
+	 */
+	PixmapPtr pixmap;
+	struct ARMSOCPixmapPrivRec *lru_prev;
+	struct ARMSOCPixmapPrivRec *lru_next;
+	CARD32 last_used;
+	/* For the ProfileFile: when the pixmap was created, and all its
+	 * CPU accesses and accelerated operations.
+	 */
+	uint64_t created_us;
+	unsigned int cpu_access_total;
+	unsigned int accel_access_total;
 };
 
 
@@ -131,6 +182,27 @@ ARMSOCPixmapBo(PixmapPtr pPixmap)
 
 void ARMSOCPixmapExchange(PixmapPtr a, PixmapPtr b);
 
+/* Count an accelerated operation on the pixmap. Called by EXA
+ * submodules from their Prepare hooks, whether or not the hardware
+ * ends up accepting the pixmap.
+ */
+void ARMSOCPixmapAccelAccess(PixmapPtr pPixmap);
+/* Tell whether the operation the Prepare hook counted was accepted.
+ * Called by EXA submodules once their Prepare hook has returned.
+ */
+void ARMSOCPixmapAccelDone(PixmapPtr pPixmap, Bool accepted);
+/* Move queued pixmaps to memory matching their access pattern. */
+void ARMSOCMigratePixmaps(ScreenPtr pScreen);
+/* Move a pixmap kept in system memory, in a slab or in a cached bo
+ * into an uncached bo of its own, so it can be shared or accelerated.
+ * Returns TRUE if the pixmap has such a bo.
+ */
+Bool ARMSOCPixmapPromote(PixmapPtr pPixmap);
+/* Move pixmaps not used for a while from their bo to system memory
+ * until about 'bytes' have been released. Returns the bytes released.
+ */
+uint64_t ARMSOCEvictPixmaps(ScreenPtr pScreen, uint64_t bytes);
+
 /* Register that the pixmap can be accessed externally, so
  * CPU access must be synchronised. */
 void ARMSOCRegisterExternalAccess(PixmapPtr pPixmap);
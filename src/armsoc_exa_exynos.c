@@ -59,6 +59,11 @@ struct ARMSOCNullEXARec {
 	int xdir;
 	int ydir;
 	uint32_t fillColor;
+	// Composite state, see PrepareComposite
+	struct g2d_image compositeSrc;
+	struct g2d_image compositeDst;
+	PictTransform compositeTransform;
+	PictTransform compositeInverse;
 };
 
 
@@ -83,6 +88,57 @@ struct ARMSOCNullEXARec {
 #define GXset                   0xf             /* 1 */
 #endif
 
+/*
+* Describe a buffer object as a G2D image.
+* Returns FALSE if G2D can't handle the bo's format.
+* A bo carved out of a slab is described as the whole slab up to the
+* far corner of the bo, so coordinates must be moved by its origin,
+* see armsoc_bo_origin().
+*/
+static Bool
+BoToG2DImage(struct armsoc_bo* bo, struct g2d_image* image)
+{
+	uint32_t originX, originY;
+
+
+	memset(image, 0, sizeof(*image));
+
+	// G2D doesn't see CPU writes still in the cache
+	if (armsoc_bo_cache_type(bo) == ARMSOC_CACHE_CACHED)
+	{
+		return FALSE;
+	}
+
+	switch (armsoc_bo_depth(bo))
+	{
+	case 32:
+		image->color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
+		break;
+
+	case 24:
+		image->color_mode = G2D_COLOR_FMT_XRGB8888 | G2D_ORDER_AXRGB;
+		break;
+
+	case 16:
+		image->color_mode = G2D_COLOR_FMT_RGB565;
+		break;
+
+	default:
+		// Not supported
+		return FALSE;
+	}
+
+	armsoc_bo_origin(bo, &originX, &originY);
+	image->width = originX + armsoc_bo_width(bo);
+	image->height = originY + armsoc_bo_height(bo);
+	image->stride = armsoc_bo_pitch(bo);
+
+	image->buf_type = G2D_IMGBUF_GEM;
+	image->bo[0] = armsoc_bo_handle(bo);
+
+	return TRUE;
+}
+
 /*
 * The alu raster op is one of the GX*
 * graphics functions listed in X.h
@@ -109,8 +165,9 @@ PrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_color)
 		return FALSE;
 	}
 
-	// Only GXset operation is supported
-	if (alu != GXset)
+	// Only fills that don't read the destination, of all planes
+	if ((alu != GXcopy && alu != GXset) ||
+		!EXA_PM_IS_SOLID(&pPixmap->drawable, planemask))
 	{
 		return FALSE;
 	}
@@ -121,6 +178,16 @@ PrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_color)
 		return FALSE;
 	}
 
+	// Counted before the cache check, so a cached pixmap the blitter
+	// keeps asking for can migrate back
+	ARMSOCPixmapAccelAccess(pPixmap);
+
+	// Cached buffer objects are left to the CPU
+	if (armsoc_bo_cache_type(dstPriv->bo) == ARMSOC_CACHE_CACHED)
+	{
+		return FALSE;
+	}
+
 	// If bpp is not 32 or 16, fallback
 	dstBpp = armsoc_bo_bpp(dstPriv->bo);
 
@@ -129,8 +196,8 @@ PrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_color)
 		return FALSE;
 	}
 
-	// Save required information for later
-	nullExaRec->fillColor = (uint32_t)fill_color;
+	// Save required information for later. GXset ignores the colour
+	nullExaRec->fillColor = alu == GXset ? ~0 : (uint32_t)fill_color;
 
 	return TRUE;
 
@@ -146,46 +213,23 @@ Solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
 	struct ARMSOCPixmapPrivRec* dstPriv = exaGetPixmapDriverPrivate(pPixmap);
 
 	struct g2d_image dstImage;
+	uint32_t dstOriginX, dstOriginY;
 	int ret;
 
 
-	memset(&dstImage, 0, sizeof(dstImage));
-
-
-	// Source
-	switch (armsoc_bo_depth(dstPriv->bo))
+	if (!BoToG2DImage(dstPriv->bo, &dstImage))
 	{
-	case 32:
-		dstImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 24:
-		dstImage.color_mode = G2D_COLOR_FMT_XRGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 16:
-		dstImage.color_mode = G2D_COLOR_FMT_RGB565;
-		break;
-
-	default:
 		// Not supported
 		ERROR_MSG("EXA Solid: dstImage bpp not supported. (%d)", armsoc_bo_bpp(dstPriv->bo));
-		break;
 	}
 
-	//srcImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-	dstImage.width = armsoc_bo_width(dstPriv->bo);
-	dstImage.height = armsoc_bo_height(dstPriv->bo);
-	dstImage.stride = armsoc_bo_pitch(dstPriv->bo);
 	dstImage.color = nullExaRec->fillColor;
-	
-	dstImage.buf_type = G2D_IMGBUF_GEM;
-	dstImage.bo[0] = armsoc_bo_handle(dstPriv->bo);
+	armsoc_bo_origin(dstPriv->bo, &dstOriginX, &dstOriginY);
 
 
 	ret = g2d_solid_fill(nullExaRec->ctx,
 		&dstImage,
-		x1, y1,
+		dstOriginX + x1, dstOriginY + y1,
 		x2 - x1, y2 - y1);
 
 	if (ret < 0)
@@ -196,6 +240,7 @@ Solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
 	}
 
 	g2d_exec(nullExaRec->ctx);
+	armsoc_bo_mark_dirty(dstPriv->bo);
 }
 
 static void
@@ -238,12 +283,39 @@ PrepareCopy(PixmapPtr pSrc, PixmapPtr pDst, int xdir, int ydir,
 		return FALSE;
 	}
 
+	// Counted first: it also marks both as in use, so the allocation
+	// a promotion makes can't evict the other side
+	ARMSOCPixmapAccelAccess(pSrc);
+	ARMSOCPixmapAccelAccess(pDst);
+
+	// Small pixmaps are kept in system memory. Between two of them the
+	// CPU is quicker, so only give them a buffer object when the other
+	// side already has one
+	if (srcPriv->bo || dstPriv->bo)
+	{
+		if (srcPriv->sysmem)
+		{
+			ARMSOCPixmapPromote(pSrc);
+		}
+		if (dstPriv->sysmem)
+		{
+			ARMSOCPixmapPromote(pDst);
+		}
+	}
+
 	// If there are no buffer objects, fallback
 	if (!srcPriv->bo || !dstPriv->bo)
 	{
 		return FALSE;
 	}
 
+	// Cached buffer objects are left to the CPU
+	if (armsoc_bo_cache_type(srcPriv->bo) == ARMSOC_CACHE_CACHED ||
+		armsoc_bo_cache_type(dstPriv->bo) == ARMSOC_CACHE_CACHED)
+	{
+		return FALSE;
+	}
+
 	// If bpp is not 32 or 16, fallback
 	srcBpp = armsoc_bo_bpp(srcPriv->bo);
 	dstBpp = armsoc_bo_bpp(dstPriv->bo);
@@ -276,79 +348,40 @@ static void Copy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY,
 
 	struct g2d_image srcImage;
 	struct g2d_image dstImage;
+	uint32_t srcOriginX, srcOriginY;
+	uint32_t dstOriginX, dstOriginY;
 	int ret;
 
 
-	memset(&srcImage, 0, sizeof(srcImage));
-	memset(&dstImage, 0, sizeof(dstImage));
-
-
 	// Source
-	switch (armsoc_bo_depth(srcPriv->bo))
+	if (!BoToG2DImage(srcPriv->bo, &srcImage))
 	{
-	case 32:
-		srcImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 24:
-		srcImage.color_mode = G2D_COLOR_FMT_XRGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 16:
-		srcImage.color_mode = G2D_COLOR_FMT_RGB565;
-		break;
-
-	default:
 		// Not supported
 		ERROR_MSG("EXA Copy: srcImage bpp not supported. (%d)", armsoc_bo_bpp(srcPriv->bo));
-		break;
 	}
 
-	//srcImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-	srcImage.width = armsoc_bo_width(srcPriv->bo);
-	srcImage.height = armsoc_bo_height(srcPriv->bo);
-	srcImage.stride = armsoc_bo_pitch(srcPriv->bo);
 	srcImage.x_dir = (nullExaRec->xdir < 1);
 	srcImage.y_dir = (nullExaRec->ydir < 1);
 
-	srcImage.buf_type = G2D_IMGBUF_GEM;
-	srcImage.bo[0] = armsoc_bo_handle(srcPriv->bo);
-
 
 	// Destination
-	switch (armsoc_bo_depth(dstPriv->bo))
+	if (!BoToG2DImage(dstPriv->bo, &dstImage))
 	{
-	case 32:
-		dstImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 24:
-		dstImage.color_mode = G2D_COLOR_FMT_XRGB8888 | G2D_ORDER_AXRGB;
-		break;
-
-	case 16:
-		dstImage.color_mode = G2D_COLOR_FMT_RGB565;
-		break;
-
-	default:
 		// Not supported
 		ERROR_MSG("EXA Copy: dstImage bpp not supported. (%d)", armsoc_bo_bpp(dstPriv->bo));
-		break;
 	}
 
-	//dstImage.color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
-	dstImage.width = armsoc_bo_width(dstPriv->bo);
-	dstImage.height = armsoc_bo_height(dstPriv->bo);
-	dstImage.stride = armsoc_bo_pitch(dstPriv->bo);
 	dstImage.x_dir = (nullExaRec->xdir < 1);
 	dstImage.y_dir = (nullExaRec->ydir < 1);
 
-	dstImage.buf_type = G2D_IMGBUF_GEM;
-	dstImage.bo[0] = armsoc_bo_handle(dstPriv->bo);
-
 
 	// Copy
-	ret = g2d_copy(nullExaRec->ctx, &srcImage, &dstImage, srcX, srcY, dstX, dstY, width, height);
+	armsoc_bo_origin(srcPriv->bo, &srcOriginX, &srcOriginY);
+	armsoc_bo_origin(dstPriv->bo, &dstOriginX, &dstOriginY);
+
+	ret = g2d_copy(nullExaRec->ctx, &srcImage, &dstImage,
+		srcOriginX + srcX, srcOriginY + srcY,
+		dstOriginX + dstX, dstOriginY + dstY, width, height);
 	if (ret < 0)
 	{
 		//xf86DrvMsg(-1, X_ERROR, "g2d_copy: srcX=%d, srcY=%d, dstX=%d, dstY=%d, width=%d, height=%d | src_bpp=%d, dst_bpp=%d (ret=%d)\n",
@@ -365,6 +398,7 @@ static void Copy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY,
 	}
 
 	ret = g2d_exec(nullExaRec->ctx);
+	armsoc_bo_mark_dirty(dstPriv->bo);
 }
 
 static void DoneCopy(PixmapPtr pDstPixmap)
@@ -378,19 +412,583 @@ static void DoneCopy(PixmapPtr pDstPixmap)
 #endif
 }
 
+/*
+* Copy a rectangle between two buffer objects, converting between
+* their formats if they differ. Used before any pixmaps exist, e.g.
+* to inherit the boot framebuffer at ScreenInit.
+*/
 static Bool
-CheckCompositeFail(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
-		PicturePtr pDstPicture)
+CopyBo(ScrnInfoPtr pScrn, struct armsoc_bo* src, int srcX, int srcY,
+	struct armsoc_bo* dst, int dstX, int dstY, int width, int height)
 {
+	struct ARMSOCRec* pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCNullEXARec* nullExaRec = (struct ARMSOCNullEXARec*)pARMSOC->pARMSOCEXA;
+	struct g2d_image srcImage;
+	struct g2d_image dstImage;
+	uint32_t srcOriginX, srcOriginY;
+	uint32_t dstOriginX, dstOriginY;
+
+
+	// Check if G2D is disabled
+	if (!nullExaRec->ctx)
+	{
+		return FALSE;
+	}
+
+	if (!BoToG2DImage(src, &srcImage) ||
+		!BoToG2DImage(dst, &dstImage))
+	{
+		return FALSE;
+	}
+
+	armsoc_bo_origin(src, &srcOriginX, &srcOriginY);
+	armsoc_bo_origin(dst, &dstOriginX, &dstOriginY);
+	armsoc_bo_mark_dirty(dst);
+
+	if (g2d_copy(nullExaRec->ctx, &srcImage, &dstImage,
+		srcOriginX + srcX, srcOriginY + srcY,
+		dstOriginX + dstX, dstOriginY + dstY, width, height) < 0)
+	{
+		return FALSE;
+	}
+
+	return g2d_exec(nullExaRec->ctx) == 0;
+}
+
+/*
+* Fill a whole buffer object, e.g. to clear a new scanout
+* without writing 32MB through an uncached CPU mapping. Like the
+* CPU clear this covers the padding at the end of each row too,
+* as the bo is then known to be zero and later resizes may keep
+* the pitch and bring that padding into view.
+*/
+static Bool
+FillBo(ScrnInfoPtr pScrn, struct armsoc_bo* bo, uint32_t color)
+{
+	struct ARMSOCRec* pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCNullEXARec* nullExaRec = (struct ARMSOCNullEXARec*)pARMSOC->pARMSOCEXA;
+	struct g2d_image dstImage;
+	uint32_t originX, originY;
+	uint32_t cpp, pitch, width, rows, tail;
+
+
+	// Check if G2D is disabled
+	if (!nullExaRec->ctx)
+	{
+		return FALSE;
+	}
+
+	if (!BoToG2DImage(bo, &dstImage))
+	{
+		return FALSE;
+	}
+
+	dstImage.color = color;
+	armsoc_bo_origin(bo, &originX, &originY);
+
+	if (armsoc_bo_is_slab(bo))
+	{
+		// Only our cell of the slab's rows
+		width = armsoc_bo_width(bo);
+		rows = armsoc_bo_height(bo);
+		tail = 0;
+	}
+	else
+	{
+		// Every byte of the bo: whole rows up to the pitch, then
+		// what is left of the last row after a resize
+		cpp = (armsoc_bo_bpp(bo) + 7) / 8;
+		pitch = armsoc_bo_pitch(bo);
+		if (pitch % cpp)
+		{
+			return FALSE;
+		}
+
+		width = pitch / cpp;
+		rows = armsoc_bo_size(bo) / pitch;
+		tail = (armsoc_bo_size(bo) % pitch) / cpp;
+		dstImage.width = width;
+		dstImage.height = rows + (tail ? 1 : 0);
+	}
+
+	if (rows && g2d_solid_fill(nullExaRec->ctx, &dstImage, originX, originY,
+		width, rows) < 0)
+	{
+		return FALSE;
+	}
+
+	if (tail && g2d_solid_fill(nullExaRec->ctx, &dstImage, originX, originY + rows,
+		tail, 1) < 0)
+	{
+		return FALSE;
+	}
+
+	return g2d_exec(nullExaRec->ctx) == 0;
+}
+
+/*
+* G2D starts and ends a scaled blit on whole source pixels, so the
+* blit is widened to where source and destination pixel boundaries
+* meet and clipped back, see Composite. Scales where they meet less
+* often than every this many destination pixels are left to the CPU.
+*/
+#define G2D_SCALE_PERIOD_MAX	16
+
+/*
+* How often, in destination pixels, the source pixel boundaries of a
+* scale meet destination ones. The scale is in source pixels per
+* destination pixel, like a transform's xx and yy.
+*/
+static int
+ScalePeriod(pixman_fixed_t scale)
+{
+	uint32_t n = scale < 0 ? -scale : scale;
+	int period = pixman_fixed_1;
+
+
+	while (period > 1 && !(n & 1))
+	{
+		n >>= 1;
+		period >>= 1;
+	}
+
+	return period;
+}
+
+/*
+* Work out how G2D has to walk and sample the source for a picture's
+* transform: rotations by multiples of 90 degrees and reflections, as
+* used to redisplay rotated CRTCs, and scales with optional reflection,
+* as used by scaled CRTCs, all with an integer translation. Returns
+* FALSE for anything else, including scales G2D can't sample exactly.
+*/
+static Bool
+TransformToG2DImage(PicturePtr pPicture, struct g2d_image* image)
+{
+	PictTransformPtr transform = pPicture->transform;
+	pixman_fixed_t xx, xy, yx, yy;
+
+
+	image->rotate_90 = 0;
+	image->x_dir = 0;
+	image->y_dir = 0;
+	image->scale_mode = G2D_SCALE_MODE_NONE;
+
+	// Filters other than these need more than 2x2 source pixels
+	switch (pPicture->filter)
+	{
+	case PictFilterNearest:
+	case PictFilterFast:
+	case PictFilterBilinear:
+	case PictFilterGood:
+	case PictFilterBest:
+		break;
+
+	default:
+		return FALSE;
+	}
+
+	if (!transform)
+	{
+		return TRUE;
+	}
+
+	if (transform->matrix[2][0] != 0 ||
+		transform->matrix[2][1] != 0 ||
+		transform->matrix[2][2] != pixman_fixed_1)
+	{
+		return FALSE;
+	}
+
+	// G2D can't start a blit between source pixels
+	if (pixman_fixed_frac(transform->matrix[0][2]) ||
+		pixman_fixed_frac(transform->matrix[1][2]))
+	{
+		return FALSE;
+	}
+
+	xx = transform->matrix[0][0];
+	xy = transform->matrix[0][1];
+	yx = transform->matrix[1][0];
+	yy = transform->matrix[1][1];
+
+	if (xy == 0 && yx == 0 && xx != 0 && yy != 0)
+	{
+		image->x_dir = (xx < 0);
+		image->y_dir = (yy < 0);
+
+		if ((xx == pixman_fixed_1 || xx == -pixman_fixed_1) &&
+			(yy == pixman_fixed_1 || yy == -pixman_fixed_1))
+		{
+			// Exact copies sample pixel centres, so all filters agree
+			return TRUE;
+		}
+
+		if (ScalePeriod(xx) > G2D_SCALE_PERIOD_MAX ||
+			ScalePeriod(yy) > G2D_SCALE_PERIOD_MAX)
+		{
+			return FALSE;
+		}
+
+		switch (pPicture->filter)
+		{
+		case PictFilterNearest:
+		case PictFilterFast:
+			image->scale_mode = G2D_SCALE_MODE_NEAREST;
+			break;
+
+		default:
+			image->scale_mode = G2D_SCALE_MODE_BILINEAR;
+			break;
+		}
+
+		return TRUE;
+	}
+
+	if (xx == 0 && yy == 0 &&
+		(xy == pixman_fixed_1 || xy == -pixman_fixed_1) &&
+		(yx == pixman_fixed_1 || yx == -pixman_fixed_1))
+	{
+		// G2D mirrors the source and then rotates it clockwise
+		image->rotate_90 = 1;
+		image->x_dir = (xy < 0);
+		image->y_dir = (yx > 0);
+		return TRUE;
+	}
+
 	return FALSE;
 }
 
+/*
+* Map the corners of a box through an axis-aligned transform.
+*/
+static void
+TransformBox(PictTransformPtr transform, const BoxRec* in, BoxRec* out)
+{
+	struct pixman_vector v1 = {{ pixman_int_to_fixed(in->x1),
+		pixman_int_to_fixed(in->y1), pixman_fixed_1 }};
+	struct pixman_vector v2 = {{ pixman_int_to_fixed(in->x2),
+		pixman_int_to_fixed(in->y2), pixman_fixed_1 }};
+
+
+	pixman_transform_point_3d(transform, &v1);
+	pixman_transform_point_3d(transform, &v2);
+
+	out->x1 = pixman_fixed_to_int(min(v1.vector[0], v2.vector[0]));
+	out->y1 = pixman_fixed_to_int(min(v1.vector[1], v2.vector[1]));
+	out->x2 = pixman_fixed_to_int(pixman_fixed_ceil(max(v1.vector[0], v2.vector[0])));
+	out->y2 = pixman_fixed_to_int(pixman_fixed_ceil(max(v1.vector[1], v2.vector[1])));
+}
+
 static Bool
-PrepareCompositeFail(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+CheckPictFormat(PictFormatShort format)
+{
+	switch (format)
+	{
+	case PICT_a8r8g8b8:
+	case PICT_x8r8g8b8:
+	case PICT_r5g6b5:
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+/*
+* Only PictOpSrc blits without a mask are accelerated, through the
+* transforms TransformToG2DImage() takes; no transform at all is the
+* simplest of those. This is what the server's shadow redisplay of
+* rotated and scaled CRTCs does for each damaged box.
+*/
+static Bool
+CheckComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture)
+{
+	struct g2d_image image;
+
+
+	if (op != PictOpSrc || pMaskPicture)
+	{
+		return FALSE;
+	}
+
+	// Solid and gradient sources
+	if (!pSrcPicture->pDrawable)
+	{
+		return FALSE;
+	}
+
+	if (pSrcPicture->alphaMap || pDstPicture->alphaMap ||
+		pSrcPicture->repeat)
+	{
+		return FALSE;
+	}
+
+	if (!CheckPictFormat(pSrcPicture->format) ||
+		!CheckPictFormat(pDstPicture->format))
+	{
+		return FALSE;
+	}
+
+	// G2D can't make up an alpha channel
+	if (PICT_FORMAT_A(pDstPicture->format) &&
+		!PICT_FORMAT_A(pSrcPicture->format))
+	{
+		return FALSE;
+	}
+
+	return TransformToG2DImage(pSrcPicture, &image);
+}
+
+static Bool
+PrepareComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
 		PicturePtr pDstPicture, PixmapPtr pSrc,
 		PixmapPtr pMask, PixmapPtr pDst)
 {
-	return FALSE;
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pDst->drawable.pScreen);
+	struct ARMSOCRec* pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCNullEXARec* nullExaRec = (struct ARMSOCNullEXARec*)pARMSOC->pARMSOCEXA;
+
+	struct ARMSOCPixmapPrivRec* srcPriv = exaGetPixmapDriverPrivate(pSrc);
+	struct ARMSOCPixmapPrivRec* dstPriv = exaGetPixmapDriverPrivate(pDst);
+
+
+	// Check if G2D is disabled
+	if (!nullExaRec->ctx)
+	{
+		return FALSE;
+	}
+
+	if (!srcPriv->bo || !dstPriv->bo)
+	{
+		return FALSE;
+	}
+
+	ARMSOCPixmapAccelAccess(pSrc);
+	ARMSOCPixmapAccelAccess(pDst);
+
+	// Composite clips against the image size, which for slab bos
+	// isn't the pixmap's. Transformed sources are CRTC sized anyway
+	if (armsoc_bo_is_slab(srcPriv->bo) || armsoc_bo_is_slab(dstPriv->bo))
+	{
+		return FALSE;
+	}
+
+	if (!BoToG2DImage(srcPriv->bo, &nullExaRec->compositeSrc) ||
+		!BoToG2DImage(dstPriv->bo, &nullExaRec->compositeDst))
+	{
+		return FALSE;
+	}
+
+	if (!TransformToG2DImage(pSrcPicture, &nullExaRec->compositeSrc))
+	{
+		return FALSE;
+	}
+
+	if (pSrcPicture->transform)
+	{
+		nullExaRec->compositeTransform = *pSrcPicture->transform;
+	}
+	else
+	{
+		pixman_transform_init_identity(&nullExaRec->compositeTransform);
+	}
+
+	if (!pixman_transform_invert(&nullExaRec->compositeInverse,
+		&nullExaRec->compositeTransform))
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+* a mod b, for positive b, that is never negative
+*/
+static int
+Modulo(int a, int b)
+{
+	int m = a % b;
+
+
+	return m < 0 ? m + b : m;
+}
+
+static void
+Composite(PixmapPtr pDst, int srcX, int srcY, int maskX, int maskY,
+	int dstX, int dstY, int width, int height)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pDst->drawable.pScreen);
+	struct ARMSOCRec* pARMSOC = ARMSOCPTR(pScrn);
+	struct ARMSOCNullEXARec* nullExaRec = (struct ARMSOCNullEXARec*)pARMSOC->pARMSOCEXA;
+	struct ARMSOCPixmapPrivRec* dstPriv = exaGetPixmapDriverPrivate(pDst);
+	struct g2d_image* srcImage = &nullExaRec->compositeSrc;
+	struct g2d_image* dstImage = &nullExaRec->compositeDst;
+	PictTransformPtr transform = &nullExaRec->compositeTransform;
+	int periodX = ScalePeriod(transform->matrix[0][0]);
+	int periodY = ScalePeriod(transform->matrix[1][1]);
+	int offsetX = dstX - srcX;
+	int offsetY = dstY - srcY;
+	BoxRec box;
+	BoxRec srcBox;
+	BoxRec clipBox;
+	BoxRec blitBox;
+	int ret;
+
+
+	box.x1 = srcX;
+	box.y1 = srcY;
+	box.x2 = srcX + width;
+	box.y2 = srcY + height;
+
+	TransformBox(transform, &box, &srcBox);
+
+	// Source pixels outside the pixmap read as transparent black
+	clipBox.x1 = max(srcBox.x1, 0);
+	clipBox.y1 = max(srcBox.y1, 0);
+	clipBox.x2 = min(srcBox.x2, (int)srcImage->width);
+	clipBox.y2 = min(srcBox.y2, (int)srcImage->height);
+
+	armsoc_bo_mark_dirty(dstPriv->bo);
+
+	if (clipBox.x1 != srcBox.x1 || clipBox.y1 != srcBox.y1 ||
+		clipBox.x2 != srcBox.x2 || clipBox.y2 != srcBox.y2)
+	{
+		dstImage->color = 0;
+		g2d_solid_fill(nullExaRec->ctx, dstImage, dstX, dstY, width, height);
+
+		// Destination area still covered by the source, which
+		// rounding must not grow beyond the original box
+		TransformBox(&nullExaRec->compositeInverse, &clipBox, &clipBox);
+		box.x1 = max(clipBox.x1, box.x1);
+		box.y1 = max(clipBox.y1, box.y1);
+		box.x2 = min(clipBox.x2, box.x2);
+		box.y2 = min(clipBox.y2, box.y2);
+
+		if (box.x1 >= box.x2 || box.y1 >= box.y2)
+		{
+			g2d_exec(nullExaRec->ctx);
+			return;
+		}
+	}
+
+	// Widen scaled blits to where source and destination pixel
+	// boundaries meet. The source rectangle then starts and ends on
+	// whole pixels and G2D's scale is exactly the transform's, so
+	// every box samples the source where the transform says, however
+	// the damage is split. The clipping window keeps the blit to the box
+	blitBox.x1 = box.x1 - Modulo(box.x1, periodX);
+	blitBox.y1 = box.y1 - Modulo(box.y1, periodY);
+	blitBox.x2 = box.x2 + Modulo(-box.x2, periodX);
+	blitBox.y2 = box.y2 + Modulo(-box.y2, periodY);
+	TransformBox(transform, &blitBox, &srcBox);
+
+	// G2D can't start a blit at a negative position, and a mirrored
+	// blit must not be cut short by the destination's edge. Neither
+	// happens when redisplaying a CRTC, where source and destination
+	// positions match. Otherwise use the box's own source rectangle,
+	// rounded out to whole pixels
+	if (blitBox.x1 + offsetX < 0 || blitBox.y1 + offsetY < 0 ||
+		srcBox.x1 < 0 || srcBox.y1 < 0 ||
+		(srcImage->x_dir && blitBox.x2 + offsetX > (int)dstImage->width) ||
+		(srcImage->y_dir && blitBox.y2 + offsetY > (int)dstImage->height))
+	{
+		blitBox = box;
+		TransformBox(transform, &blitBox, &srcBox);
+		srcBox.x1 = max(srcBox.x1, 0);
+		srcBox.y1 = max(srcBox.y1, 0);
+		srcBox.x2 = min(srcBox.x2, (int)srcImage->width);
+		srcBox.y2 = min(srcBox.y2, (int)srcImage->height);
+	}
+
+	dstImage->cw_en = 1;
+	dstImage->cw_x1 = box.x1 + offsetX;
+	dstImage->cw_y1 = box.y1 + offsetY;
+	dstImage->cw_x2 = box.x2 + offsetX;
+	dstImage->cw_y2 = box.y2 + offsetY;
+	dstX = blitBox.x1 + offsetX;
+	dstY = blitBox.y1 + offsetY;
+	width = blitBox.x2 - blitBox.x1;
+	height = blitBox.y2 - blitBox.y1;
+
+	ret = g2d_copy_with_scale(nullExaRec->ctx, srcImage, dstImage,
+		srcBox.x1, srcBox.y1, srcBox.x2 - srcBox.x1, srcBox.y2 - srcBox.y1,
+		dstX, dstY, width, height, 0);
+	if (ret < 0)
+	{
+		xf86DrvMsg(-1, X_ERROR, "g2d_copy_with_scale: src=%d,%d %dx%d dst=%d,%d %dx%d "
+			"rotate_90=%d x_dir=%d y_dir=%d scale_mode=%d (ret=%d)\n",
+			srcBox.x1, srcBox.y1, srcBox.x2 - srcBox.x1, srcBox.y2 - srcBox.y1,
+			dstX, dstY, width, height,
+			srcImage->rotate_90, srcImage->x_dir, srcImage->y_dir,
+			srcImage->scale_mode, ret);
+	}
+
+	g2d_exec(nullExaRec->ctx);
+}
+
+static void
+DoneComposite(PixmapPtr pDst)
+{
+}
+
+/*
+* Count what the blitter takes and what is left to the CPU,
+* see armsoc_perf.h, and tell the pixmaps' migration which
+* CPU accesses are only fallbacks
+*/
+static Bool
+PrepareSolidCounted(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_color)
+{
+	Bool ret = PrepareSolid(pPixmap, alu, planemask, fill_color);
+
+
+	ARMSOCPixmapAccelDone(pPixmap, ret);
+	ARMSOC_PERF_INC(ret ? ARMSOC_PERF_SOLID_ACCEL : ARMSOC_PERF_SOLID_FALLBACK);
+	return ret;
+}
+
+static Bool
+PrepareCopyCounted(PixmapPtr pSrc, PixmapPtr pDst, int xdir, int ydir,
+		int alu, Pixel planemask)
+{
+	Bool ret = PrepareCopy(pSrc, pDst, xdir, ydir, alu, planemask);
+
+
+	ARMSOCPixmapAccelDone(pSrc, ret);
+	ARMSOCPixmapAccelDone(pDst, ret);
+	ARMSOC_PERF_INC(ret ? ARMSOC_PERF_COPY_ACCEL : ARMSOC_PERF_COPY_FALLBACK);
+	return ret;
+}
+
+static Bool
+CheckCompositeCounted(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture)
+{
+	Bool ret = CheckComposite(op, pSrcPicture, pMaskPicture, pDstPicture);
+
+
+	if (!ret)
+	{
+		ARMSOC_PERF_INC(ARMSOC_PERF_COMPOSITE_FALLBACK);
+	}
+	return ret;
+}
+
+static Bool
+PrepareCompositeCounted(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst)
+{
+	Bool ret = PrepareComposite(op, pSrcPicture, pMaskPicture, pDstPicture,
+		pSrc, pMask, pDst);
+
+
+	ARMSOCPixmapAccelDone(pSrc, ret);
+	ARMSOCPixmapAccelDone(pDst, ret);
+	ARMSOC_PERF_INC(ret ? ARMSOC_PERF_COMPOSITE_ACCEL : ARMSOC_PERF_COMPOSITE_FALLBACK);
+	return ret;
 }
 
 /**
@@ -469,14 +1067,16 @@ InitNullEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd)
 	/* Always fallback for software operations */
 	//exa->PrepareCopy = PrepareCopyFail;
 	//exa->PrepareSolid = PrepareSolidFail;
-	exa->CheckComposite = CheckCompositeFail;
-	exa->PrepareComposite = PrepareCompositeFail;
+	exa->CheckComposite = CheckCompositeCounted;
+	exa->PrepareComposite = PrepareCompositeCounted;
+	exa->Composite = Composite;
+	exa->DoneComposite = DoneComposite;
 
-	exa->PrepareCopy = PrepareCopy;
+	exa->PrepareCopy = PrepareCopyCounted;
 	exa->Copy = Copy;
 	exa->DoneCopy = DoneCopy;
 
-	exa->PrepareSolid = PrepareSolid;
+	exa->PrepareSolid = PrepareSolidCounted;
 	exa->Solid = Solid;
 	exa->DoneSolid = DoneSolid;
 
@@ -487,6 +1087,8 @@ InitNullEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd)
 
 	armsoc_exa->CloseScreen = CloseScreen;
 	armsoc_exa->FreeScreen = FreeScreen;
+	armsoc_exa->CopyBo = CopyBo;
+	armsoc_exa->FillBo = FillBo;
 
 
 	// Initialize a G2D context
@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <time.h>
+
+#include "armsoc_perf.h"
+
+uint64_t armsoc_perf[ARMSOC_PERF_COUNT];
+
+static const char * const armsoc_perf_names[ARMSOC_PERF_COUNT] = {
+	[ARMSOC_PERF_SOLID_ACCEL] = "solid_accel",
+	[ARMSOC_PERF_SOLID_FALLBACK] = "solid_fallback",
+	[ARMSOC_PERF_COPY_ACCEL] = "copy_accel",
+	[ARMSOC_PERF_COPY_FALLBACK] = "copy_fallback",
+	[ARMSOC_PERF_COMPOSITE_ACCEL] = "composite_accel",
+	[ARMSOC_PERF_COMPOSITE_FALLBACK] = "composite_fallback",
+	[ARMSOC_PERF_G2D_CMDLIST] = "g2d_cmdlist",
+	[ARMSOC_PERF_G2D_EXEC] = "g2d_exec",
+	[ARMSOC_PERF_G2D_ERRORS] = "g2d_errors",
+	[ARMSOC_PERF_ACCESS] = "access",
+	[ARMSOC_PERF_ACCESS_SYNC] = "access_sync",
+	[ARMSOC_PERF_ACCESS_WAIT_US] = "access_wait_us",
+	[ARMSOC_PERF_ACCESS_MAX_WAIT_US] = "access_max_wait_us",
+	[ARMSOC_PERF_SWAP_FLIP] = "swap_flip",
+	[ARMSOC_PERF_SWAP_EXCHANGE] = "swap_exchange",
+	[ARMSOC_PERF_SWAP_BLIT] = "swap_blit",
+	[ARMSOC_PERF_BO_SCANOUT] = "bo_scanout",
+	[ARMSOC_PERF_BO_NON_SCANOUT] = "bo_non_scanout",
+	[ARMSOC_PERF_BO_SLAB] = "bo_slab",
+	[ARMSOC_PERF_BO_FAILED] = "bo_failed",
+	[ARMSOC_PERF_BO_DESTROY] = "bo_destroy",
+};
+
+uint64_t armsoc_perf_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *armsoc_perf_name(enum armsoc_perf_counter counter)
+{
+	return armsoc_perf_names[counter];
+}
+
+void armsoc_hist_add(struct armsoc_hist *hist, uint64_t value)
+{
+	int i = 0;
+
+	while (i < ARMSOC_HIST_BUCKETS - 1 && value >> (i + 1))
+		i++;
+
+	hist->bucket[i]++;
+	hist->count++;
+	hist->sum += value;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+void armsoc_swap_stats_flip(struct armsoc_swap_stats *stats, int queued,
+		uint64_t scheduled_us, uint64_t flip_us, unsigned int sequence)
+{
+	armsoc_hist_add(&stats->latency,
+			flip_us > scheduled_us ? flip_us - scheduled_us : 0);
+
+	if (stats->flips) {
+		armsoc_hist_add(&stats->interval,
+				flip_us > stats->last_flip_us ?
+				flip_us - stats->last_flip_us : 0);
+
+		/* A flip queued behind the previous one should land on the
+		 * very next vblank; one that was not queued may simply have
+		 * had nothing to show.
+		 */
+		if (queued && sequence - stats->last_sequence > 1)
+			stats->missed_vblanks +=
+					sequence - stats->last_sequence - 1;
+	}
+
+	stats->flips++;
+	stats->last_flip_us = flip_us;
+	stats->last_sequence = sequence;
+}
+
+void armsoc_swap_stats_copy(struct armsoc_swap_stats *stats, int exchange,
+		uint64_t scheduled_us, uint64_t done_us)
+{
+	armsoc_hist_add(&stats->latency,
+			done_us > scheduled_us ? done_us - scheduled_us : 0);
+
+	if (exchange)
+		stats->exchanges++;
+	else
+		stats->blits++;
+}
+
+int armsoc_hist_format(const struct armsoc_hist *hist, const char *name,
+		char *buf, int size)
+{
+	int len, i;
+
+	len = snprintf(buf, size, "%s count=%u mean=%llu max=%llu", name,
+			hist->count, hist->count ?
+			(unsigned long long)(hist->sum / hist->count) : 0ULL,
+			(unsigned long long)hist->max);
+
+	/* only the buckets in use, by their lower bound */
+	for (i = 0; i < ARMSOC_HIST_BUCKETS && len < size; i++)
+		if (hist->bucket[i])
+			len += snprintf(buf + len, size - len, " %llu:%u",
+					i ? 1ULL << i : 0ULL, hist->bucket[i]);
+
+	if (len < size)
+		len += snprintf(buf + len, size - len, "\n");
+
+	return len < size ? len : size - 1;
+}
+
+int armsoc_swap_stats_format(const struct armsoc_swap_stats *stats,
+		char *buf, int size)
+{
+	int len;
+
+	len = snprintf(buf, size,
+			"flips %u\nblits %u\nexchanges %u\nqueued %u\n"
+			"early_display %u\nmissed_vblanks %u\ntoo_fast %u\n",
+			stats->flips, stats->blits, stats->exchanges,
+			stats->queued, stats->early_display,
+			stats->missed_vblanks, stats->too_fast);
+	if (len >= size)
+		return size - 1;
+
+	len += armsoc_hist_format(&stats->latency, "latency_us",
+			buf + len, size - len);
+	len += armsoc_hist_format(&stats->interval, "interval_us",
+			buf + len, size - len);
+
+	return len;
+}
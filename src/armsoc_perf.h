@@ -0,0 +1,135 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ARMSOC_PERF_H_
+#define ARMSOC_PERF_H_
+
+#include <stdint.h>
+
+/* Counters of what the driver does, kept for the life of the server.
+ * Increments are a plain add, cheap enough for every operation. With
+ * the PerfCounters option they are published on the root window, see
+ * ARMSOCPublishCounters().
+ */
+enum armsoc_perf_counter {
+	/* EXA operations taken by the blitter, and declined */
+	ARMSOC_PERF_SOLID_ACCEL,
+	ARMSOC_PERF_SOLID_FALLBACK,
+	ARMSOC_PERF_COPY_ACCEL,
+	ARMSOC_PERF_COPY_FALLBACK,
+	ARMSOC_PERF_COMPOSITE_ACCEL,
+	ARMSOC_PERF_COMPOSITE_FALLBACK,
+	/* G2D ioctls */
+	ARMSOC_PERF_G2D_CMDLIST,
+	ARMSOC_PERF_G2D_EXEC,
+	ARMSOC_PERF_G2D_ERRORS,
+	/* PrepareAccess calls, those that synchronised with other users
+	 * of the bo, and the time spent doing so */
+	ARMSOC_PERF_ACCESS,
+	ARMSOC_PERF_ACCESS_SYNC,
+	ARMSOC_PERF_ACCESS_WAIT_US,
+	ARMSOC_PERF_ACCESS_MAX_WAIT_US,
+	/* how DRI2 swaps were done */
+	ARMSOC_PERF_SWAP_FLIP,
+	ARMSOC_PERF_SWAP_EXCHANGE,
+	ARMSOC_PERF_SWAP_BLIT,
+	/* bo allocations by kind, failures and destructions */
+	ARMSOC_PERF_BO_SCANOUT,
+	ARMSOC_PERF_BO_NON_SCANOUT,
+	ARMSOC_PERF_BO_SLAB,
+	ARMSOC_PERF_BO_FAILED,
+	ARMSOC_PERF_BO_DESTROY,
+	ARMSOC_PERF_COUNT
+};
+
+extern uint64_t armsoc_perf[ARMSOC_PERF_COUNT];
+
+/* Least time between two updates of the published counters */
+#define ARMSOC_PERF_PUBLISH_MS	1000
+
+#define ARMSOC_PERF_INC(c)	(armsoc_perf[c]++)
+#define ARMSOC_PERF_ADD(c, n)	(armsoc_perf[c] += (n))
+#define ARMSOC_PERF_MAX(c, n) \
+	do { \
+		if ((uint64_t)(n) > armsoc_perf[c]) \
+			armsoc_perf[c] = (n); \
+	} while (0)
+
+/* CLOCK_MONOTONIC in microseconds, for timing operations */
+uint64_t armsoc_perf_now_us(void);
+const char *armsoc_perf_name(enum armsoc_perf_counter counter);
+
+/* Log2 histogram of durations, sizes or counts: bucket i counts values
+ * from 2^i up to 2^(i+1), bucket 0 also takes 0 and the last one
+ * everything larger.
+ */
+#define ARMSOC_HIST_BUCKETS	32
+
+struct armsoc_hist {
+	uint32_t bucket[ARMSOC_HIST_BUCKETS];
+	uint32_t count;
+	uint64_t sum;
+	uint64_t max;
+};
+
+void armsoc_hist_add(struct armsoc_hist *hist, uint64_t value);
+/* Write a line with the name, count, mean, max and the buckets in use
+ * to buf. Returns the length written.
+ */
+int armsoc_hist_format(const struct armsoc_hist *hist, const char *name,
+		char *buf, int size);
+
+/* Frame pacing of DRI2 swaps, kept per DRI2 drawable and for the screen */
+struct armsoc_swap_stats {
+	/* ScheduleSwap to the flip event, or to the end of a blit or
+	 * exchange
+	 */
+	struct armsoc_hist latency;
+	/* between two flip events */
+	struct armsoc_hist interval;
+	uint32_t flips;
+	uint32_t blits;
+	uint32_t exchanges;
+	/* flips scheduled while another was still pending */
+	uint32_t queued;
+	/* flips that took the extra swap chain slot of early display */
+	uint32_t early_display;
+	/* vblanks without a new frame between two queued flips */
+	uint32_t missed_vblanks;
+	/* flips that found their swap chain slot still in use */
+	uint32_t too_fast;
+	uint64_t last_flip_us;
+	unsigned int last_sequence;
+};
+
+void armsoc_swap_stats_flip(struct armsoc_swap_stats *stats, int queued,
+		uint64_t scheduled_us, uint64_t flip_us, unsigned int sequence);
+/* A blit or an exchange, which completes within ScheduleSwap */
+void armsoc_swap_stats_copy(struct armsoc_swap_stats *stats, int exchange,
+		uint64_t scheduled_us, uint64_t done_us);
+/* "name value" lines, as for the counters. Returns the length written */
+int armsoc_swap_stats_format(const struct armsoc_swap_stats *stats,
+		char *buf, int size);
+
+#endif /* ARMSOC_PERF_H_ */
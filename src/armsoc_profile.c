@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "armsoc_perf.h"
+#include "armsoc_profile.h"
+
+/* usage hints above this are counted together */
+#define PROFILE_USAGE_MAX	8
+
+static const int profile_bpps[] = { 1, 8, 16, 24, 32 };
+#define PROFILE_BPPS	(sizeof(profile_bpps) / sizeof(profile_bpps[0]))
+
+struct armsoc_profile {
+	char *path;
+
+	uint64_t pixmaps_created;
+	uint64_t pixmaps_destroyed;
+	uint64_t pixmaps_empty;
+	uint64_t pixmaps_sysmem;
+	uint64_t pixmaps_scanout;
+	struct armsoc_hist pixmap_width;
+	struct armsoc_hist pixmap_height;
+	struct armsoc_hist pixmap_bytes;
+	uint64_t pixmap_bpp[PROFILE_BPPS + 1];
+	uint64_t pixmap_usage[PROFILE_USAGE_MAX + 1];
+	struct armsoc_hist pixmap_lifetime_ms;
+	struct armsoc_hist pixmap_cpu;
+	struct armsoc_hist pixmap_accel;
+	/* never accessed, CPU only, accelerated only, both */
+	uint64_t pixmap_access[4];
+
+	uint64_t bos_created;
+	uint64_t bos_destroyed;
+	uint64_t bos_slab;
+	struct armsoc_hist bo_width;
+	struct armsoc_hist bo_height;
+	struct armsoc_hist bo_size;
+	struct armsoc_hist bo_lifetime_ms;
+	struct armsoc_hist slab_lifetime_ms;
+};
+
+int armsoc_profile_enabled;
+static struct armsoc_profile *profile;
+static volatile sig_atomic_t profile_requested;
+static struct sigaction profile_old_action;
+
+static void profile_print(FILE *f, const char *name,
+		const struct armsoc_hist *hist)
+{
+	char buf[1024];
+
+	armsoc_hist_format(hist, name, buf, sizeof(buf));
+	fputs(buf, f);
+}
+
+static void profile_signal(int sig)
+{
+	profile_requested = 1;
+}
+
+int armsoc_profile_open(const char *path)
+{
+	struct sigaction action;
+
+	if (profile)
+		return -EBUSY;
+
+	profile = calloc(1, sizeof(*profile));
+	if (!profile)
+		return -ENOMEM;
+	profile->path = strdup(path);
+	if (!profile->path) {
+		free(profile);
+		profile = NULL;
+		return -ENOMEM;
+	}
+
+	/* the handler only flags the request, the BlockHandler writes */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = profile_signal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &action, &profile_old_action);
+
+	armsoc_profile_enabled = 1;
+	return 0;
+}
+
+void armsoc_profile_close(void)
+{
+	if (!profile)
+		return;
+
+	armsoc_profile_write();
+	sigaction(SIGUSR2, &profile_old_action, NULL);
+	armsoc_profile_enabled = 0;
+	free(profile->path);
+	free(profile);
+	profile = NULL;
+}
+
+void armsoc_profile_poll(void)
+{
+	if (!profile_requested)
+		return;
+
+	profile_requested = 0;
+	armsoc_profile_write();
+}
+
+int armsoc_profile_write(void)
+{
+	static const char * const access_names[4] = {
+		"none", "cpu", "accel", "both"
+	};
+	FILE *f;
+	unsigned int i;
+
+	if (!profile)
+		return -EINVAL;
+
+	f = fopen(profile->path, "w");
+	if (!f)
+		return -errno;
+
+	fprintf(f, "pixmaps_created %llu\n",
+			(unsigned long long)profile->pixmaps_created);
+	fprintf(f, "pixmaps_destroyed %llu\n",
+			(unsigned long long)profile->pixmaps_destroyed);
+	fprintf(f, "pixmaps_empty %llu\n",
+			(unsigned long long)profile->pixmaps_empty);
+	fprintf(f, "pixmaps_sysmem %llu\n",
+			(unsigned long long)profile->pixmaps_sysmem);
+	fprintf(f, "pixmaps_scanout %llu\n",
+			(unsigned long long)profile->pixmaps_scanout);
+	profile_print(f, "pixmap_width", &profile->pixmap_width);
+	profile_print(f, "pixmap_height", &profile->pixmap_height);
+	profile_print(f, "pixmap_bytes", &profile->pixmap_bytes);
+	fprintf(f, "pixmap_bpp");
+	for (i = 0; i < PROFILE_BPPS; i++)
+		fprintf(f, " %d:%llu", profile_bpps[i],
+			(unsigned long long)profile->pixmap_bpp[i]);
+	fprintf(f, " other:%llu\n",
+			(unsigned long long)profile->pixmap_bpp[PROFILE_BPPS]);
+	fprintf(f, "pixmap_usage_hint");
+	for (i = 0; i < PROFILE_USAGE_MAX; i++)
+		fprintf(f, " %u:%llu", i,
+			(unsigned long long)profile->pixmap_usage[i]);
+	fprintf(f, " other:%llu\n", (unsigned long long)
+			profile->pixmap_usage[PROFILE_USAGE_MAX]);
+	profile_print(f, "pixmap_lifetime_ms", &profile->pixmap_lifetime_ms);
+	profile_print(f, "pixmap_cpu_accesses", &profile->pixmap_cpu);
+	profile_print(f, "pixmap_accel_accesses", &profile->pixmap_accel);
+	fprintf(f, "pixmap_access");
+	for (i = 0; i < 4; i++)
+		fprintf(f, " %s:%llu", access_names[i],
+			(unsigned long long)profile->pixmap_access[i]);
+	fprintf(f, "\n");
+
+	fprintf(f, "bos_created %llu\n",
+			(unsigned long long)profile->bos_created);
+	fprintf(f, "bos_destroyed %llu\n",
+			(unsigned long long)profile->bos_destroyed);
+	fprintf(f, "bos_slab %llu\n",
+			(unsigned long long)profile->bos_slab);
+	profile_print(f, "bo_width", &profile->bo_width);
+	profile_print(f, "bo_height", &profile->bo_height);
+	profile_print(f, "bo_size", &profile->bo_size);
+	profile_print(f, "bo_lifetime_ms", &profile->bo_lifetime_ms);
+	profile_print(f, "slab_bo_lifetime_ms", &profile->slab_lifetime_ms);
+
+	if (fclose(f))
+		return -errno;
+
+	return 0;
+}
+
+void armsoc_profile_pixmap_new(int width, int height, int bpp,
+		int usage_hint, int scanout, int sysmem)
+{
+	unsigned int i;
+
+	profile->pixmaps_created++;
+
+	/* EXA creates most pixmaps empty and sizes them in
+	 * ModifyPixmapHeader
+	 */
+	if (width <= 0 || height <= 0 || bpp <= 0) {
+		profile->pixmaps_empty++;
+		return;
+	}
+
+	if (sysmem)
+		profile->pixmaps_sysmem++;
+	if (scanout)
+		profile->pixmaps_scanout++;
+
+	armsoc_hist_add(&profile->pixmap_width, width);
+	armsoc_hist_add(&profile->pixmap_height, height);
+	armsoc_hist_add(&profile->pixmap_bytes,
+			(uint64_t)width * height * ((bpp + 7) / 8));
+
+	for (i = 0; i < PROFILE_BPPS && profile_bpps[i] != bpp; i++)
+		;
+	profile->pixmap_bpp[i]++;
+
+	profile->pixmap_usage[usage_hint >= 0 &&
+			usage_hint < PROFILE_USAGE_MAX ?
+			usage_hint : PROFILE_USAGE_MAX]++;
+}
+
+void armsoc_profile_pixmap_del(uint64_t lifetime_us, unsigned int cpu,
+		unsigned int accel)
+{
+	profile->pixmaps_destroyed++;
+	armsoc_hist_add(&profile->pixmap_lifetime_ms, lifetime_us / 1000);
+	armsoc_hist_add(&profile->pixmap_cpu, cpu);
+	armsoc_hist_add(&profile->pixmap_accel, accel);
+	profile->pixmap_access[(cpu ? 1 : 0) | (accel ? 2 : 0)]++;
+}
+
+void armsoc_profile_bo_new(uint32_t width, uint32_t height,
+		uint32_t size, int slab)
+{
+	profile->bos_created++;
+	if (slab)
+		profile->bos_slab++;
+	armsoc_hist_add(&profile->bo_width, width);
+	armsoc_hist_add(&profile->bo_height, height);
+	armsoc_hist_add(&profile->bo_size, size);
+}
+
+void armsoc_profile_bo_del(uint64_t lifetime_us, int slab)
+{
+	profile->bos_destroyed++;
+	armsoc_hist_add(slab ? &profile->slab_lifetime_ms :
+			&profile->bo_lifetime_ms, lifetime_us / 1000);
+}
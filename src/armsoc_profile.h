@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ARMSOC_PROFILE_H_
+#define ARMSOC_PROFILE_H_
+
+#include <stdint.h>
+
+/* Optional profile of pixmap and bo sizes, lifetimes and accesses, for
+ * sizing the bo cache, the slabs and SmallPixmapThreshold from real
+ * workloads. Everything is folded into log2 histograms as it happens,
+ * so the profile stays a few KB however long the server runs. It is
+ * written to the ProfileFile at CloseScreen and on SIGUSR2.
+ *
+ * The hooks cost a not-taken branch while profiling is off.
+ */
+extern int armsoc_profile_enabled;
+
+/* Start profiling into path. Returns 0 or -errno */
+int armsoc_profile_open(const char *path);
+/* Write the profile one last time and stop */
+void armsoc_profile_close(void);
+/* Write the profile if SIGUSR2 asked for it, from the BlockHandler */
+void armsoc_profile_poll(void);
+int armsoc_profile_write(void);
+
+void armsoc_profile_pixmap_new(int width, int height, int bpp,
+		int usage_hint, int scanout, int sysmem);
+void armsoc_profile_pixmap_del(uint64_t lifetime_us, unsigned int cpu,
+		unsigned int accel);
+void armsoc_profile_bo_new(uint32_t width, uint32_t height,
+		uint32_t size, int slab);
+void armsoc_profile_bo_del(uint64_t lifetime_us, int slab);
+
+#endif /* ARMSOC_PROFILE_H_ */
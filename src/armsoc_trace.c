@@ -0,0 +1,103 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "armsoc_trace.h"
+
+int armsoc_trace_fd = -1;
+static int armsoc_trace_refs;
+
+static const char * const trace_marker_paths[] = {
+	"/sys/kernel/tracing/trace_marker",
+	"/sys/kernel/debug/tracing/trace_marker",
+};
+
+int armsoc_trace_open(void)
+{
+	int err = -ENOENT;
+	unsigned int i;
+
+	if (armsoc_trace_refs) {
+		armsoc_trace_refs++;
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(trace_marker_paths) /
+			sizeof(trace_marker_paths[0]); i++) {
+		int fd = open(trace_marker_paths[i], O_WRONLY | O_CLOEXEC);
+
+		if (fd >= 0) {
+			armsoc_trace_fd = fd;
+			armsoc_trace_refs = 1;
+			return 0;
+		}
+		if (errno != ENOENT)
+			err = -errno;
+	}
+
+	return err;
+}
+
+void armsoc_trace_close(void)
+{
+	if (!armsoc_trace_refs || --armsoc_trace_refs)
+		return;
+
+	close(armsoc_trace_fd);
+	armsoc_trace_fd = -1;
+}
+
+void armsoc_trace_marker(const char *fmt, ...)
+{
+	static const char prefix[] = "armsoc: ";
+	char buf[256];
+	va_list ap;
+	int len;
+
+	memcpy(buf, prefix, sizeof(prefix) - 1);
+	va_start(ap, fmt);
+	len = vsnprintf(buf + sizeof(prefix) - 1,
+			sizeof(buf) - sizeof(prefix) + 1, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+
+	len += sizeof(prefix) - 1;
+	if (len > (int)sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+
+	/* a dropped marker is not worth reporting */
+	if (write(armsoc_trace_fd, buf, len) < 0)
+		return;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ARMSOC_TRACE_H_
+#define ARMSOC_TRACE_H_
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define ARMSOC_TRACE_PROBE(name, ...) STAP_PROBEV(armsoc, name, ##__VA_ARGS__)
+#else
+#define ARMSOC_TRACE_PROBE(name, ...) do { } while (0)
+#endif
+
+/* Trace points on the hot paths, for lining up what the driver does
+ * with kernel DRM and GPU activity in one perf or trace-cmd capture.
+ * Each is a USDT probe armsoc:<name> when built with <sys/sdt.h> and,
+ * with the TraceMarker option, an "armsoc: <name> <args>" line written to
+ * ftrace's trace_marker. With neither in use a trace point costs a
+ * not-taken branch; its arguments must be cheap to evaluate.
+ */
+#define ARMSOC_TRACE(name, fmt, ...) \
+	do { \
+		ARMSOC_TRACE_PROBE(name, ##__VA_ARGS__); \
+		if (armsoc_trace_fd >= 0) \
+			armsoc_trace_marker(#name " " fmt, ##__VA_ARGS__); \
+	} while (0)
+
+extern int armsoc_trace_fd;
+
+/* Open trace_marker, once for all screens. Returns 0 or -errno */
+int armsoc_trace_open(void);
+void armsoc_trace_close(void);
+void armsoc_trace_marker(const char *fmt, ...)
+		__attribute__((format(printf, 1, 2)));
+
+#endif /* ARMSOC_TRACE_H_ */
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xorg-server.h>
+#include <xf86.h>
+
+#include "armsoc_umplock.h"
+#include "umplock/umplock_ioctl.h"
+
+/* Ids of the lock items created in the kernel, so CREATE is issued
+ * once per buffer rather than on every access. Direct mapped: an id
+ * evicted by a collision is simply created again.
+ */
+#define UMPLOCK_CREATED_CACHE	512
+/* Locks held at once. EXA prepares at most EXA_NUM_PREPARE_INDICES
+ * pixmaps per operation.
+ */
+#define UMPLOCK_MAX_HELD	16
+/* How long to wait for another process to release a lock */
+#define UMPLOCK_TIMEOUT_US	1000000
+#define UMPLOCK_CONTENDED_US	1000
+
+struct armsoc_umplock_held {
+	uint32_t id;
+	unsigned int count;
+};
+
+struct armsoc_umplock {
+	int fd;
+	uint32_t created[UMPLOCK_CREATED_CACHE];
+	struct armsoc_umplock_held held[UMPLOCK_MAX_HELD];
+	int num_held;
+	struct armsoc_umplock_stats stats;
+};
+
+static uint64_t umplock_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct armsoc_umplock_held *umplock_find_held(
+		struct armsoc_umplock *lock, uint32_t id)
+{
+	int i;
+
+	for (i = 0; i < lock->num_held; i++) {
+		if (lock->held[i].id == id)
+			return &lock->held[i];
+	}
+	return NULL;
+}
+
+static int umplock_create(struct armsoc_umplock *lock, _lock_item_s *item,
+		Bool force)
+{
+	uint32_t *slot = &lock->created[item->secure_id % UMPLOCK_CREATED_CACHE];
+
+	if (!force && *slot == item->secure_id)
+		return 0;
+
+	if (ioctl(lock->fd, LOCK_IOCTL_CREATE, item) < 0) {
+		xf86DrvMsg(-1, X_ERROR,
+			"Unable to create lock item 0x%x: %s\n",
+			item->secure_id, strerror(errno));
+		return -1;
+	}
+	*slot = item->secure_id;
+	lock->stats.creates++;
+	return 0;
+}
+
+struct armsoc_umplock *armsoc_umplock_open(const char *path)
+{
+	struct armsoc_umplock *lock = calloc(1, sizeof(*lock));
+
+	if (!lock)
+		return NULL;
+
+	lock->fd = open(path, O_RDWR | O_CLOEXEC);
+	if (lock->fd < 0) {
+		free(lock);
+		return NULL;
+	}
+	return lock;
+}
+
+void armsoc_umplock_close(struct armsoc_umplock *lock)
+{
+	_lock_item_s item;
+
+	if (!lock)
+		return;
+
+	item.usage = _LOCK_ACCESS_CPU_WRITE;
+	while (lock->num_held) {
+		item.secure_id = lock->held[--lock->num_held].id;
+		ioctl(lock->fd, LOCK_IOCTL_RELEASE, &item);
+	}
+	close(lock->fd);
+	free(lock);
+}
+
+/* Take the CPU access lock for a buffer, waiting for other processes
+ * to release it. Nested acquires of a lock already held only count.
+ * The kernel call blocks until the lock is free, so it is only repeated
+ * when a signal interrupts it, up to UMPLOCK_TIMEOUT_US in total, and
+ * once more after recreating an item the kernel no longer knows.
+ * Returns 0 once the lock is held.
+ */
+int armsoc_umplock_acquire(struct armsoc_umplock *lock, uint32_t secure_id)
+{
+	struct armsoc_umplock_held *held;
+	_lock_item_s item;
+	uint64_t start, waited;
+	Bool recreated = FALSE;
+	int ret;
+
+	held = umplock_find_held(lock, secure_id);
+	if (held) {
+		held->count++;
+		lock->stats.nested++;
+		return 0;
+	}
+
+	if (lock->num_held == UMPLOCK_MAX_HELD) {
+		lock->stats.failures++;
+		return -ENOSPC;
+	}
+
+	item.secure_id = secure_id;
+	item.usage = _LOCK_ACCESS_CPU_WRITE;
+
+	if (umplock_create(lock, &item, FALSE)) {
+		lock->stats.failures++;
+		return -1;
+	}
+
+	start = umplock_now_us();
+	while ((ret = ioctl(lock->fd, LOCK_IOCTL_PROCESS, &item)) < 0) {
+		if (umplock_now_us() - start >= UMPLOCK_TIMEOUT_US)
+			break;
+		if (errno == EINTR || errno == EAGAIN)
+			continue;
+		if (recreated || umplock_create(lock, &item, TRUE))
+			break;
+		recreated = TRUE;
+	}
+
+	waited = umplock_now_us() - start;
+	lock->stats.wait_us += waited;
+	if (waited > lock->stats.max_wait_us)
+		lock->stats.max_wait_us = waited;
+	if (waited > UMPLOCK_CONTENDED_US)
+		lock->stats.contended++;
+
+	if (ret < 0) {
+		xf86DrvMsg(-1, X_ERROR,
+			"Unable to process lock item 0x%x after %u us: %s\n",
+			secure_id, (unsigned int)waited, strerror(errno));
+		lock->stats.failures++;
+		return -1;
+	}
+
+	held = &lock->held[lock->num_held++];
+	held->id = secure_id;
+	held->count = 1;
+	lock->stats.acquires++;
+	return 0;
+}
+
+/* Drop one hold on a lock taken with armsoc_umplock_acquire(). The
+ * kernel lock is released with the last one. Locks that were never
+ * acquired are ignored.
+ */
+void armsoc_umplock_release(struct armsoc_umplock *lock, uint32_t secure_id)
+{
+	struct armsoc_umplock_held *held = umplock_find_held(lock, secure_id);
+	_lock_item_s item;
+
+	if (!held || --held->count)
+		return;
+
+	item.secure_id = secure_id;
+	item.usage = _LOCK_ACCESS_CPU_WRITE;
+	if (ioctl(lock->fd, LOCK_IOCTL_RELEASE, &item) < 0)
+		xf86DrvMsg(-1, X_ERROR,
+			"Unable to release lock item 0x%x: %s\n",
+			secure_id, strerror(errno));
+
+	*held = lock->held[--lock->num_held];
+}
+
+void armsoc_umplock_get_stats(struct armsoc_umplock *lock,
+		struct armsoc_umplock_stats *stats)
+{
+	*stats = lock->stats;
+}
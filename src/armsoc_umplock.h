@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ARMSOC_UMPLOCK_H_
+#define ARMSOC_UMPLOCK_H_
+
+#include <stdint.h>
+
+/* Cross-process CPU access locking through the Mali umplock device.
+ * Lock items are identified by the flink name of the bo.
+ */
+struct armsoc_umplock;
+
+struct armsoc_umplock_stats {
+	/* locks taken from the kernel */
+	unsigned long acquires;
+	/* acquires satisfied by a lock this process already held */
+	unsigned long nested;
+	/* acquires that waited more than a millisecond */
+	unsigned long contended;
+	/* acquires given up on at the deadline or on an error */
+	unsigned long failures;
+	/* lock items created in the kernel */
+	unsigned long creates;
+	/* time spent waiting for locks, in microseconds */
+	uint64_t wait_us;
+	uint64_t max_wait_us;
+};
+
+struct armsoc_umplock *armsoc_umplock_open(const char *path);
+void armsoc_umplock_close(struct armsoc_umplock *lock);
+int armsoc_umplock_acquire(struct armsoc_umplock *lock, uint32_t secure_id);
+void armsoc_umplock_release(struct armsoc_umplock *lock, uint32_t secure_id);
+void armsoc_umplock_get_stats(struct armsoc_umplock *lock,
+		struct armsoc_umplock_stats *stats);
+
+#endif /* ARMSOC_UMPLOCK_H_ */
@@ -0,0 +1,813 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * armsoc-bench: time the driver's EXA paths without a board or a server.
+ *
+ * armsoc_exa.c, armsoc_exa_exynos.c, exynos_fimg2d.c and armsoc_dumb.c
+ * are linked against stub_drm.c, which serves dumb buffers from memory
+ * and counts ioctls, and stub_server.c, which stands in for the few
+ * server entry points they call. Each workload calls the ExaDriverRec
+ * hooks the way EXA does, including the CPU fallback through
+ * PrepareAccess/FinishAccess when a Prepare hook declines, and reports
+ * ops/s, how many ops were accelerated and the ioctls they took.
+ *
+ * G2D command lists are run by the software blitter of stub_g2d.c, so
+ * accelerated times include drawing on the CPU; the registers written
+ * per list are reported alongside. With -c every accelerated op is
+ * redone through the CPU path and the pixels compared.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "armsoc_driver.h"
+#include "armsoc_exa.h"
+
+#include "picturestr.h"
+
+#include "bench.h"
+#include "stub_drm.h"
+
+struct bench {
+	ScrnInfoPtr pScrn;
+	ScreenPtr pScreen;
+	struct ARMSOCRec *pARMSOC;
+
+	int width;
+	int height;
+	int depth;
+	int bpp;
+	int overlap;
+	int check;
+
+	/* of the last run */
+	unsigned long accel;
+	unsigned long fallback;
+	unsigned long mismatches;
+};
+
+/* The destination before an accelerated op, and what it drew */
+struct bench_check {
+	uint8_t *before;
+	uint8_t *accel;
+};
+
+struct bench_test {
+	const char *name;
+	void (*run)(struct bench *bench, int iterations);
+};
+
+static void
+bench_fail(const char *what)
+{
+	fprintf(stderr, "armsoc-bench: %s\n", what);
+	exit(1);
+}
+
+static uint8_t *
+bench_access(PixmapPtr pPixmap, int index)
+{
+	if (!bench_exa->PrepareAccess(pPixmap, index))
+		bench_fail("PrepareAccess failed");
+	return pPixmap->devPrivate.ptr;
+}
+
+static void
+bench_finish(PixmapPtr pPixmap, int index)
+{
+	bench_exa->FinishAccess(pPixmap, index);
+}
+
+/* Something for copies to move around */
+static void
+bench_pattern(PixmapPtr pPixmap)
+{
+	uint8_t *bits = bench_access(pPixmap, EXA_PREPARE_DEST);
+	int size = pPixmap->devKind * pPixmap->drawable.height;
+	uint32_t seed = 0x12345678;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		bits[i] = seed >> 16;
+	}
+	bench_finish(pPixmap, EXA_PREPARE_DEST);
+}
+
+static PixmapPtr
+bench_pixmap_new(struct bench *bench, int width, int height)
+{
+	struct bench_pixmap *bpix = calloc(1, sizeof(*bpix));
+	PixmapPtr pPixmap = &bpix->base;
+	int pitch = 0;
+
+	if (!bpix)
+		bench_fail("out of memory");
+
+	/* as exaCreatePixmapWithPrivate() does */
+	bpix->driver_priv = bench_exa->CreatePixmap2(bench->pScreen,
+			width, height, bench->depth, 0, bench->bpp, &pitch);
+	if (!bpix->driver_priv)
+		bench_fail("CreatePixmap2 failed");
+
+	pPixmap->drawable.type = DRAWABLE_PIXMAP;
+	pPixmap->drawable.pScreen = bench->pScreen;
+	pPixmap->refcnt = 1;
+	if (!bench_exa->ModifyPixmapHeader(pPixmap, width, height,
+			bench->depth, bench->bpp, pitch, NULL))
+		bench_fail("ModifyPixmapHeader failed");
+
+	if (bench->check)
+		bench_pattern(pPixmap);
+
+	return pPixmap;
+}
+
+static void
+bench_pixmap_del(struct bench *bench, PixmapPtr pPixmap)
+{
+	struct bench_pixmap *bpix = (struct bench_pixmap *)pPixmap;
+
+	bench_exa->DestroyPixmap(bench->pScreen, bpix->driver_priv);
+	free(bpix);
+}
+
+static uint8_t *
+bench_save(PixmapPtr pPixmap)
+{
+	size_t size = pPixmap->devKind * pPixmap->drawable.height;
+	uint8_t *copy = malloc(size);
+
+	if (!copy)
+		bench_fail("out of memory");
+	memcpy(copy, bench_access(pPixmap, EXA_PREPARE_SRC), size);
+	bench_finish(pPixmap, EXA_PREPARE_SRC);
+	return copy;
+}
+
+static void
+bench_restore(PixmapPtr pPixmap, const uint8_t *copy)
+{
+	memcpy(bench_access(pPixmap, EXA_PREPARE_DEST), copy,
+			pPixmap->devKind * pPixmap->drawable.height);
+	bench_finish(pPixmap, EXA_PREPARE_DEST);
+}
+
+static void
+bench_check_begin(struct bench *bench, PixmapPtr pDst,
+		struct bench_check *check)
+{
+	check->before = bench->check ? bench_save(pDst) : NULL;
+	check->accel = NULL;
+}
+
+/*
+ * After an accelerated op, keep what it drew and put the destination
+ * back for the CPU path. Returns whether to run that too.
+ */
+static Bool
+bench_check_accel(PixmapPtr pDst, struct bench_check *check)
+{
+	if (!check->before)
+		return FALSE;
+
+	check->accel = bench_save(pDst);
+	bench_restore(pDst, check->before);
+	return TRUE;
+}
+
+/* Compare what the CPU drew with what the blitter did */
+static void
+bench_check_end(struct bench *bench, const char *name, PixmapPtr pDst,
+		struct bench_check *check)
+{
+	int cpp = pDst->drawable.bitsPerPixel / 8;
+	/* the padding byte of depth 24 is anyone's */
+	uint32_t mask = pDst->drawable.depth == 24 ? 0x00ffffff : ~0;
+	uint8_t *bits;
+	int x, y;
+
+	if (check->accel) {
+		bits = bench_access(pDst, EXA_PREPARE_SRC);
+		for (y = 0; y < pDst->drawable.height; y++) {
+			for (x = 0; x < pDst->drawable.width; x++) {
+				uint32_t cpu = 0, accel = 0;
+				int offset = y * pDst->devKind + x * cpp;
+
+				memcpy(&cpu, bits + offset, cpp);
+				memcpy(&accel, check->accel + offset, cpp);
+				if (!((cpu ^ accel) & mask))
+					continue;
+
+				if (!bench->mismatches)
+					fprintf(stderr, "armsoc-bench: %s: "
+						"%d,%d is %08x, the CPU "
+						"draws %08x\n", name, x, y,
+						accel, cpu);
+				bench->mismatches++;
+			}
+		}
+		bench_finish(pDst, EXA_PREPARE_SRC);
+	}
+
+	free(check->accel);
+	free(check->before);
+}
+
+/* What fb does when EXA falls back */
+static void
+bench_cpu_fill(PixmapPtr pPixmap, int x, int y, int width, int height,
+		uint32_t color)
+{
+	uint8_t *bits = bench_access(pPixmap, EXA_PREPARE_DEST);
+
+	pixman_fill((uint32_t *)bits, pPixmap->devKind / 4,
+			pPixmap->drawable.bitsPerPixel, x, y, width, height,
+			color);
+	bench_finish(pPixmap, EXA_PREPARE_DEST);
+}
+
+static void
+bench_cpu_copy(PixmapPtr pSrc, PixmapPtr pDst, int sx, int sy,
+		int dx, int dy, int width, int height)
+{
+	int cpp = pDst->drawable.bitsPerPixel / 8;
+	uint8_t *src, *dst;
+	int i;
+
+	src = bench_access(pSrc, EXA_PREPARE_SRC);
+	dst = pSrc == pDst ? src : bench_access(pDst, EXA_PREPARE_DEST);
+
+	/* bottom up when the rows overlap that way */
+	for (i = 0; i < height; i++) {
+		int row = (pSrc == pDst && dy > sy) ? height - 1 - i : i;
+
+		memmove(dst + (dy + row) * pDst->devKind + dx * cpp,
+			src + (sy + row) * pSrc->devKind + sx * cpp,
+			width * cpp);
+	}
+
+	if (pSrc != pDst)
+		bench_finish(pDst, EXA_PREPARE_DEST);
+	bench_finish(pSrc, EXA_PREPARE_SRC);
+}
+
+static void
+bench_solid_alu(struct bench *bench, int iterations, int alu)
+{
+	PixmapPtr pDst = bench_pixmap_new(bench, bench->width,
+			bench->height);
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		uint32_t color = 0xff000000 | (i * 0x010203);
+		/* fb only looks at the colour for GXcopy */
+		uint32_t fill = alu == GXset ? ~0 : color;
+		struct bench_check check;
+
+		bench_check_begin(bench, pDst, &check);
+		if (bench_exa->PrepareSolid(pDst, alu, ~0, color)) {
+			bench_exa->Solid(pDst, 0, 0, bench->width,
+					bench->height);
+			bench_exa->DoneSolid(pDst);
+			bench->accel++;
+			if (bench_check_accel(pDst, &check))
+				bench_cpu_fill(pDst, 0, 0, bench->width,
+						bench->height, fill);
+		} else {
+			bench_cpu_fill(pDst, 0, 0, bench->width,
+					bench->height, fill);
+			bench->fallback++;
+		}
+		bench_check_end(bench, "solid", pDst, &check);
+	}
+
+	bench_pixmap_del(bench, pDst);
+}
+
+/* GXcopy is what a default GC asks for */
+static void
+bench_solid(struct bench *bench, int iterations)
+{
+	bench_solid_alu(bench, iterations, GXcopy);
+}
+
+static void
+bench_solid_set(struct bench *bench, int iterations)
+{
+	bench_solid_alu(bench, iterations, GXset);
+}
+
+static void
+bench_copy_between(struct bench *bench, int iterations, PixmapPtr pSrc,
+		PixmapPtr pDst, int dx, int dy)
+{
+	int width = bench->width - dx;
+	int height = bench->height - dy;
+	int xdir = dx > 0 && pSrc == pDst ? -1 : 1;
+	int ydir = dy > 0 && pSrc == pDst ? -1 : 1;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		struct bench_check check;
+
+		bench_check_begin(bench, pDst, &check);
+		if (bench_exa->PrepareCopy(pSrc, pDst, xdir, ydir, GXcopy,
+				~0)) {
+			bench_exa->Copy(pDst, 0, 0, dx, dy, width, height);
+			bench_exa->DoneCopy(pDst);
+			bench->accel++;
+			if (bench_check_accel(pDst, &check))
+				bench_cpu_copy(pSrc, pDst, 0, 0, dx, dy,
+						width, height);
+		} else {
+			bench_cpu_copy(pSrc, pDst, 0, 0, dx, dy, width,
+					height);
+			bench->fallback++;
+		}
+		bench_check_end(bench, "copy", pDst, &check);
+	}
+}
+
+static void
+bench_copy(struct bench *bench, int iterations)
+{
+	PixmapPtr pSrc = bench_pixmap_new(bench, bench->width,
+			bench->height);
+	PixmapPtr pDst = bench_pixmap_new(bench, bench->width,
+			bench->height);
+
+	bench_copy_between(bench, iterations, pSrc, pDst, 0, 0);
+
+	bench_pixmap_del(bench, pDst);
+	bench_pixmap_del(bench, pSrc);
+}
+
+/* Scrolling: a copy within one pixmap, moved by the overlap */
+static void
+bench_copy_overlap(struct bench *bench, int iterations)
+{
+	PixmapPtr pPixmap = bench_pixmap_new(bench, bench->width,
+			bench->height);
+	int shift = min(bench->overlap, min(bench->width, bench->height) - 1);
+
+	bench_copy_between(bench, iterations, pPixmap, pPixmap, shift, shift);
+
+	bench_pixmap_del(bench, pPixmap);
+}
+
+static PictFormatShort
+bench_pict_format(struct bench *bench)
+{
+	switch (bench->depth) {
+	case 32:
+		return PICT_a8r8g8b8;
+	case 16:
+		return PICT_r5g6b5;
+	default:
+		return PICT_x8r8g8b8;
+	}
+}
+
+static void
+bench_cpu_composite(PicturePtr pSrcPicture, PixmapPtr pSrc, PixmapPtr pDst,
+		int width, int height)
+{
+	pixman_format_code_t format = pSrcPicture->format;
+	pixman_image_t *src, *dst;
+	uint8_t *src_bits, *dst_bits;
+
+	src_bits = bench_access(pSrc, EXA_PREPARE_SRC);
+	dst_bits = bench_access(pDst, EXA_PREPARE_DEST);
+
+	src = pixman_image_create_bits(format, pSrc->drawable.width,
+			pSrc->drawable.height, (uint32_t *)src_bits,
+			pSrc->devKind);
+	dst = pixman_image_create_bits(format, pDst->drawable.width,
+			pDst->drawable.height, (uint32_t *)dst_bits,
+			pDst->devKind);
+	pixman_image_set_transform(src, pSrcPicture->transform);
+	pixman_image_set_filter(src, PIXMAN_FILTER_NEAREST, NULL, 0);
+	pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, dst,
+			0, 0, 0, 0, 0, 0, width, height);
+	pixman_image_unref(dst);
+	pixman_image_unref(src);
+
+	bench_finish(pDst, EXA_PREPARE_DEST);
+	bench_finish(pSrc, EXA_PREPARE_SRC);
+}
+
+/*
+ * A PictOpSrc blit through a transform, as the shadow redisplay of a
+ * scaled or rotated CRTC does. The destination is width x height.
+ */
+static void
+bench_composite_transform(struct bench *bench, int iterations,
+		PictTransform *transform, int src_width, int src_height)
+{
+	PixmapPtr pSrc = bench_pixmap_new(bench, src_width, src_height);
+	PixmapPtr pDst = bench_pixmap_new(bench, bench->width,
+			bench->height);
+	PictureRec src, dst;
+	int i;
+
+	memset(&src, 0, sizeof(src));
+	src.pDrawable = &pSrc->drawable;
+	src.format = bench_pict_format(bench);
+	src.transform = transform;
+	src.filter = PictFilterNearest;
+
+	memset(&dst, 0, sizeof(dst));
+	dst.pDrawable = &pDst->drawable;
+	dst.format = bench_pict_format(bench);
+	dst.filter = PictFilterNearest;
+
+	for (i = 0; i < iterations; i++) {
+		struct bench_check check;
+
+		bench_check_begin(bench, pDst, &check);
+		if (bench_exa->CheckComposite(PictOpSrc, &src, NULL, &dst) &&
+				bench_exa->PrepareComposite(PictOpSrc, &src,
+					NULL, &dst, pSrc, NULL, pDst)) {
+			bench_exa->Composite(pDst, 0, 0, 0, 0, 0, 0,
+					bench->width, bench->height);
+			bench_exa->DoneComposite(pDst);
+			bench->accel++;
+			if (bench_check_accel(pDst, &check))
+				bench_cpu_composite(&src, pSrc, pDst,
+						bench->width, bench->height);
+		} else {
+			bench_cpu_composite(&src, pSrc, pDst, bench->width,
+					bench->height);
+			bench->fallback++;
+		}
+		bench_check_end(bench, "composite", pDst, &check);
+	}
+
+	bench_pixmap_del(bench, pDst);
+	bench_pixmap_del(bench, pSrc);
+}
+
+/* Downscale from twice the size */
+static void
+bench_composite_scale(struct bench *bench, int iterations)
+{
+	PictTransform transform;
+
+	pixman_transform_init_scale(&transform, pixman_int_to_fixed(2),
+			pixman_int_to_fixed(2));
+	bench_composite_transform(bench, iterations, &transform,
+			bench->width * 2, bench->height * 2);
+}
+
+/* Rotate by 90 degrees */
+static void
+bench_composite_rotate(struct bench *bench, int iterations)
+{
+	PictTransform transform;
+
+	pixman_transform_init_identity(&transform);
+	transform.matrix[0][0] = 0;
+	transform.matrix[0][1] = pixman_fixed_1;
+	transform.matrix[1][0] = -pixman_fixed_1;
+	transform.matrix[1][1] = 0;
+	transform.matrix[1][2] = pixman_int_to_fixed(bench->width);
+	bench_composite_transform(bench, iterations, &transform,
+			bench->height, bench->width);
+}
+
+/* CPU access to a pixmap the blitter draws to in between */
+static void
+bench_access_cycle(struct bench *bench, int iterations)
+{
+	PixmapPtr pPixmap = bench_pixmap_new(bench, bench->width,
+			bench->height);
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		uint8_t *bits = bench_access(pPixmap, EXA_PREPARE_DEST);
+
+		bits[0] = i;
+		bench_finish(pPixmap, EXA_PREPARE_DEST);
+		bench->fallback++;
+	}
+
+	bench_pixmap_del(bench, pPixmap);
+}
+
+/* Pixmap churn, through the bo cache and slabs */
+static void
+bench_pixmaps(struct bench *bench, int iterations)
+{
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		bench_pixmap_del(bench, bench_pixmap_new(bench, bench->width,
+				bench->height));
+		/* what the BlockHandler does between requests */
+		armsoc_device_flush_deferred(bench->pARMSOC->dev);
+	}
+}
+
+static const struct bench_test bench_tests[] = {
+	{ "solid", bench_solid },
+	{ "solid-set", bench_solid_set },
+	{ "copy", bench_copy },
+	{ "copy-overlap", bench_copy_overlap },
+	{ "composite-scale", bench_composite_scale },
+	{ "composite-rotate", bench_composite_rotate },
+	{ "access", bench_access_cycle },
+	{ "pixmaps", bench_pixmaps },
+};
+
+#define BENCH_TESTS (sizeof(bench_tests) / sizeof(bench_tests[0]))
+
+static int
+bench_create_gem(int fd, struct armsoc_create_gem *create_gem)
+{
+	struct drm_mode_create_dumb create_dumb;
+	int ret;
+
+	memset(&create_dumb, 0, sizeof(create_dumb));
+	create_dumb.width = create_gem->width;
+	create_dumb.height = create_gem->height;
+	create_dumb.bpp = create_gem->bpp;
+
+	ret = drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create_dumb);
+	if (ret)
+		return ret;
+
+	create_gem->handle = create_dumb.handle;
+	create_gem->pitch = create_dumb.pitch;
+	create_gem->size = create_dumb.size;
+	return 0;
+}
+
+static uint32_t
+bench_get_pitch(uint32_t width, uint32_t bpp)
+{
+	return (width * ((bpp + 7) / 8) + 63) & ~63;
+}
+
+/* What the blitter was asked to do since before */
+static void
+bench_report_g2d(const struct stub_g2d_stats *before)
+{
+	const struct stub_g2d_stats *now = &stub_g2d_stats;
+	uint64_t lists = now->lists - before->lists;
+	int i;
+
+	if (!lists && now->rejected == before->rejected)
+		return;
+
+	printf("%-16s g2d: %llu lists of %.1f registers, %.1f of them "
+			"base addresses, %.1f unchanged from the list before\n",
+			"", (unsigned long long)lists,
+			lists ? (double)(now->regs - before->regs) / lists : 0.0,
+			lists ? (double)(now->base_regs - before->base_regs) /
+				lists : 0.0,
+			lists ? (double)(now->unchanged - before->unchanged) /
+				lists : 0.0);
+	printf("%-16s g2d: %llu fills, %llu blits, %llu blends, "
+			"%llu scaled, %llu rotated, %llu unsupported, "
+			"%llu rejected, %.1f Mpixels\n", "",
+			(unsigned long long)(now->fills - before->fills),
+			(unsigned long long)(now->blits - before->blits),
+			(unsigned long long)(now->blends - before->blends),
+			(unsigned long long)(now->scaled - before->scaled),
+			(unsigned long long)(now->rotated - before->rotated),
+			(unsigned long long)(now->unsupported -
+				before->unsupported),
+			(unsigned long long)(now->rejected - before->rejected),
+			(now->pixels - before->pixels) / 1000000.0);
+
+	if (!bench_verbose)
+		return;
+
+	for (i = 0; i < STUB_G2D_REGS; i++)
+		if (now->reg_writes[i] != before->reg_writes[i])
+			printf("%-16s g2d: register 0x%04x written %llu "
+				"times\n", "", i * 4,
+				(unsigned long long)(now->reg_writes[i] -
+					before->reg_writes[i]));
+}
+
+static void
+bench_run(struct bench *bench, const struct bench_test *test,
+		int iterations)
+{
+	uint64_t ioctls[STUB_DRM_IOCTL_COUNT];
+	struct stub_g2d_stats g2d;
+	uint64_t start, elapsed;
+	int i;
+
+	memcpy(ioctls, stub_drm_ioctls, sizeof(ioctls));
+	g2d = stub_g2d_stats;
+	bench->accel = 0;
+	bench->fallback = 0;
+	bench->mismatches = 0;
+
+	start = armsoc_perf_now_us();
+	test->run(bench, iterations);
+	elapsed = armsoc_perf_now_us() - start;
+
+	printf("%-16s %dx%d depth %d: %d ops in %.1f ms, %.0f ops/s, "
+			"%lu accelerated, %lu on the CPU\n",
+			test->name, bench->width, bench->height, bench->depth,
+			iterations, elapsed / 1000.0,
+			elapsed ? iterations * 1000000.0 / elapsed : 0.0,
+			bench->accel, bench->fallback);
+
+	printf("%-16s ioctls:", "");
+	for (i = 0; i < STUB_DRM_IOCTL_COUNT; i++)
+		if (stub_drm_ioctls[i] != ioctls[i])
+			printf(" %s %llu", stub_drm_ioctl_name(i),
+				(unsigned long long)(stub_drm_ioctls[i] -
+					ioctls[i]));
+	printf("\n");
+
+	bench_report_g2d(&g2d);
+
+	if (bench->check)
+		printf("%-16s %lu pixels differ from the CPU path\n", "",
+				bench->mismatches);
+}
+
+static void
+bench_usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"usage: armsoc-bench [options] [test...]\n"
+		"  -w width      pixmap width (default 256)\n"
+		"  -h height     pixmap height (default 256)\n"
+		"  -d depth      16, 24 or 32 (default 24)\n"
+		"  -n count      operations per test (default 1000)\n"
+		"  -o pixels     shift of copy-overlap (default 8)\n"
+		"  -s bytes      SmallPixmapThreshold (default 0)\n"
+		"  -l            enable PixmapSlabs\n"
+		"  -m            enable PixmapMigration\n"
+		"  -g            disable G2D (NoG2D)\n"
+		"  -c            check accelerated ops against the CPU path\n"
+		"  -v            print the driver's messages and the G2D\n"
+		"                registers written\n"
+		"tests:");
+	for (i = 0; i < BENCH_TESTS; i++)
+		fprintf(stderr, " %s", bench_tests[i].name);
+	fprintf(stderr, " (default all)\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench bench;
+	ScrnInfoPtr pScrn;
+	ScreenPtr pScreen;
+	struct ARMSOCRec *pARMSOC;
+#ifndef XF86_SCRN_INTERFACE
+	int scrnIndex = 0;
+#endif
+	int iterations = 1000;
+	unsigned int i;
+	int fd, opt, j;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.width = 256;
+	bench.height = 256;
+	bench.depth = 24;
+	bench.overlap = 8;
+
+	pScrn = calloc(1, sizeof(*pScrn));
+	pScreen = calloc(1, sizeof(*pScreen));
+	pARMSOC = calloc(1, sizeof(*pARMSOC));
+	if (!pScrn || !pScreen || !pARMSOC)
+		bench_fail("out of memory");
+
+	while ((opt = getopt(argc, argv, "w:h:d:n:o:s:lmgcv")) != -1) {
+		switch (opt) {
+		case 'w':
+			bench.width = atoi(optarg);
+			break;
+		case 'h':
+			bench.height = atoi(optarg);
+			break;
+		case 'd':
+			bench.depth = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'o':
+			bench.overlap = atoi(optarg);
+			break;
+		case 's':
+			pARMSOC->SmallPixmapThreshold = atoi(optarg);
+			break;
+		case 'l':
+			pARMSOC->PixmapSlabs = TRUE;
+			break;
+		case 'm':
+			pARMSOC->PixmapMigration = TRUE;
+			break;
+		case 'g':
+			pARMSOC->NoG2D = TRUE;
+			break;
+		case 'c':
+			bench.check = 1;
+			break;
+		case 'v':
+			bench_verbose = 1;
+			break;
+		default:
+			bench_usage();
+		}
+	}
+
+	if (bench.width <= 0 || bench.height <= 0 || iterations <= 0 ||
+			(bench.depth != 16 && bench.depth != 24 &&
+			 bench.depth != 32))
+		bench_usage();
+	bench.bpp = bench.depth == 16 ? 16 : 32;
+
+	fd = stub_drm_open();
+	if (fd < 0)
+		bench_fail("cannot create the stub DRM device");
+
+	/* one screen, set up as ScreenInit and AccelInit would */
+	xf86Screens = &pScrn;
+	pScreen->myNum = 0;
+	pScrn->scrnIndex = 0;
+	pScrn->driverPrivate = pARMSOC;
+	pARMSOC->drmFD = fd;
+	pARMSOC->dev = armsoc_device_new(fd, bench_create_gem,
+			bench_get_pitch);
+	if (!pARMSOC->dev)
+		bench_fail("armsoc_device_new failed");
+	pARMSOC->scanout = armsoc_bo_new_with_dim(pARMSOC->dev, 1920, 1080,
+			24, 32, ARMSOC_BO_SCANOUT);
+	if (!pARMSOC->scanout)
+		bench_fail("cannot allocate the scanout");
+	pARMSOC->pARMSOCEXA = InitNullEXA(pScreen, pScrn, fd);
+	if (!pARMSOC->pARMSOCEXA || !bench_exa)
+		bench_fail("InitNullEXA failed");
+
+	bench.pScrn = pScrn;
+	bench.pScreen = pScreen;
+	bench.pARMSOC = pARMSOC;
+
+	for (i = 0; i < BENCH_TESTS; i++) {
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (!strcmp(argv[j], bench_tests[i].name))
+					break;
+			if (j == argc)
+				continue;
+		}
+		bench_run(&bench, &bench_tests[i], iterations);
+	}
+
+	for (j = optind; j < argc; j++) {
+		for (i = 0; i < BENCH_TESTS; i++)
+			if (!strcmp(argv[j], bench_tests[i].name))
+				break;
+		if (i == BENCH_TESTS)
+			fprintf(stderr, "armsoc-bench: no test %s\n", argv[j]);
+	}
+
+	pARMSOC->pARMSOCEXA->CloseScreen(CLOSE_SCREEN_ARGS);
+	armsoc_bo_unreference(pARMSOC->scanout);
+	armsoc_device_del(pARMSOC->dev);
+	stub_drm_close();
+
+	return 0;
+}
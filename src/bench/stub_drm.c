@@ -0,0 +1,314 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* fallocate() */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <uapi/drm/exynos_drm.h>
+
+#include "stub_drm.h"
+
+/* Address space of the memfd. Offsets are never reused; the pages of a
+ * destroyed buffer are given back by punching a hole.
+ */
+#define STUB_DRM_SPACE		(1ULL << 40)
+#define STUB_DRM_ALIGN		4096
+
+struct stub_drm_object {
+	uint64_t offset;
+	uint64_t size;
+	/* for the G2D emulator, mapped on first use */
+	void *map;
+	int used;
+};
+
+uint64_t stub_drm_ioctls[STUB_DRM_IOCTL_COUNT];
+
+static const char * const stub_drm_ioctl_names[STUB_DRM_IOCTL_COUNT] = {
+	[STUB_DRM_CREATE_DUMB] = "create_dumb",
+	[STUB_DRM_MAP_DUMB] = "map_dumb",
+	[STUB_DRM_DESTROY_DUMB] = "destroy_dumb",
+	[STUB_DRM_FLINK] = "flink",
+	[STUB_DRM_PRIME_TO_FD] = "prime_to_fd",
+	[STUB_DRM_ADD_FB] = "add_fb",
+	[STUB_DRM_RM_FB] = "rm_fb",
+	[STUB_DRM_G2D_GET_VER] = "g2d_get_ver",
+	[STUB_DRM_G2D_SET_CMDLIST] = "g2d_set_cmdlist",
+	[STUB_DRM_G2D_EXEC] = "g2d_exec",
+	[STUB_DRM_OTHER] = "other",
+};
+
+static int stub_fd = -1;
+static uint64_t stub_next_offset;
+static uint64_t stub_bytes;
+static struct stub_drm_object *stub_objects;
+static uint32_t stub_objects_size;
+static uint32_t stub_next_fb;
+
+int stub_drm_open(void)
+{
+	/* memfd_create() through syscall(), for older C libraries */
+	stub_fd = syscall(SYS_memfd_create, "armsoc-bench", 0);
+	if (stub_fd < 0)
+		return -1;
+
+	if (ftruncate(stub_fd, STUB_DRM_SPACE)) {
+		close(stub_fd);
+		stub_fd = -1;
+		return -1;
+	}
+
+	/* handle 0 is invalid in DRM; keep offset 0 unused as well */
+	stub_next_offset = STUB_DRM_ALIGN;
+	return stub_fd;
+}
+
+void stub_drm_close(void)
+{
+	uint32_t handle;
+
+	stub_g2d_reset();
+	for (handle = 1; handle < stub_objects_size; handle++)
+		if (stub_objects[handle].map)
+			munmap(stub_objects[handle].map,
+				stub_objects[handle].size);
+
+	if (stub_fd >= 0)
+		close(stub_fd);
+	stub_fd = -1;
+	free(stub_objects);
+	stub_objects = NULL;
+	stub_objects_size = 0;
+	stub_bytes = 0;
+}
+
+const char *stub_drm_ioctl_name(enum stub_drm_ioctl ioctl)
+{
+	return stub_drm_ioctl_names[ioctl];
+}
+
+uint64_t stub_drm_bytes(void)
+{
+	return stub_bytes;
+}
+
+static struct stub_drm_object *stub_drm_lookup(uint32_t handle)
+{
+	if (!handle || handle >= stub_objects_size ||
+			!stub_objects[handle].used)
+		return NULL;
+	return &stub_objects[handle];
+}
+
+void *stub_drm_map(uint32_t handle, uint64_t *size)
+{
+	struct stub_drm_object *obj = stub_drm_lookup(handle);
+	void *map;
+
+	if (!obj)
+		return NULL;
+
+	if (!obj->map) {
+		map = mmap(NULL, obj->size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, stub_fd, obj->offset);
+		if (map == MAP_FAILED)
+			return NULL;
+		obj->map = map;
+	}
+
+	*size = obj->size;
+	return obj->map;
+}
+
+static int stub_drm_create_dumb(struct drm_mode_create_dumb *create)
+{
+	uint32_t handle;
+	uint64_t size;
+
+	/* the same pitch as the Exynos backend hands out */
+	create->pitch = (create->width * ((create->bpp + 7) / 8) + 63) & ~63;
+	create->size = (uint64_t)create->pitch * create->height;
+	size = (create->size + STUB_DRM_ALIGN - 1) &
+			~(uint64_t)(STUB_DRM_ALIGN - 1);
+	if (!size || stub_next_offset + size > STUB_DRM_SPACE)
+		return -ENOMEM;
+
+	for (handle = 1; handle < stub_objects_size; handle++)
+		if (!stub_objects[handle].used)
+			break;
+
+	if (handle >= stub_objects_size) {
+		uint32_t new_size = stub_objects_size ?
+				stub_objects_size * 2 : 64;
+		struct stub_drm_object *objects = realloc(stub_objects,
+				new_size * sizeof(*objects));
+
+		if (!objects)
+			return -ENOMEM;
+		memset(objects + stub_objects_size, 0,
+			(new_size - stub_objects_size) * sizeof(*objects));
+		stub_objects = objects;
+		stub_objects_size = new_size;
+	}
+
+	stub_objects[handle].offset = stub_next_offset;
+	stub_objects[handle].size = size;
+	stub_objects[handle].used = 1;
+	stub_next_offset += size;
+	stub_bytes += size;
+
+	create->handle = handle;
+	return 0;
+}
+
+static int stub_drm_destroy(uint32_t handle)
+{
+	struct stub_drm_object *obj = stub_drm_lookup(handle);
+
+	if (!obj)
+		return -EINVAL;
+
+	if (obj->map)
+		munmap(obj->map, obj->size);
+	obj->map = NULL;
+
+	/* dumb buffers are zeroed, like the kernel's */
+	fallocate(stub_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			obj->offset, obj->size);
+	stub_bytes -= obj->size;
+	obj->used = 0;
+	return 0;
+}
+
+static int stub_drm_ioctl(unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_MODE_CREATE_DUMB:
+		stub_drm_ioctls[STUB_DRM_CREATE_DUMB]++;
+		return stub_drm_create_dumb(arg);
+
+	case DRM_IOCTL_MODE_MAP_DUMB: {
+		struct drm_mode_map_dumb *map = arg;
+		struct stub_drm_object *obj = stub_drm_lookup(map->handle);
+
+		stub_drm_ioctls[STUB_DRM_MAP_DUMB]++;
+		if (!obj)
+			return -EINVAL;
+		map->offset = obj->offset;
+		return 0;
+	}
+
+	case DRM_IOCTL_MODE_DESTROY_DUMB:
+		stub_drm_ioctls[STUB_DRM_DESTROY_DUMB]++;
+		return stub_drm_destroy(
+				((struct drm_mode_destroy_dumb *)arg)->handle);
+
+	case DRM_IOCTL_GEM_FLINK: {
+		struct drm_gem_flink *flink = arg;
+
+		stub_drm_ioctls[STUB_DRM_FLINK]++;
+		if (!stub_drm_lookup(flink->handle))
+			return -EINVAL;
+		flink->name = flink->handle;
+		return 0;
+	}
+
+	case DRM_IOCTL_PRIME_HANDLE_TO_FD:
+		/* no other process to share with */
+		stub_drm_ioctls[STUB_DRM_PRIME_TO_FD]++;
+		return -ENOSYS;
+
+	case DRM_IOCTL_EXYNOS_G2D_GET_VER: {
+		struct drm_exynos_g2d_get_ver *ver = arg;
+
+		stub_drm_ioctls[STUB_DRM_G2D_GET_VER]++;
+		ver->major = 4;
+		ver->minor = 1;
+		return 0;
+	}
+
+	case DRM_IOCTL_EXYNOS_G2D_SET_CMDLIST:
+		stub_drm_ioctls[STUB_DRM_G2D_SET_CMDLIST]++;
+		return stub_g2d_set_cmdlist(arg);
+
+	case DRM_IOCTL_EXYNOS_G2D_EXEC:
+		stub_drm_ioctls[STUB_DRM_G2D_EXEC]++;
+		return stub_g2d_exec(arg);
+
+	default:
+		stub_drm_ioctls[STUB_DRM_OTHER]++;
+		return -ENOTTY;
+	}
+}
+
+/* libdrm entry points the driver uses */
+
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	if (fd != stub_fd) {
+		errno = EBADF;
+		return -1;
+	}
+
+	ret = stub_drm_ioctl(request, arg);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return 0;
+}
+
+int drmModeAddFB(int fd, uint32_t width, uint32_t height, uint8_t depth,
+		uint8_t bpp, uint32_t pitch, uint32_t bo_handle,
+		uint32_t *buf_id)
+{
+	stub_drm_ioctls[STUB_DRM_ADD_FB]++;
+	if (fd != stub_fd || !stub_drm_lookup(bo_handle))
+		return -EINVAL;
+
+	*buf_id = ++stub_next_fb;
+	return 0;
+}
+
+int drmModeRmFB(int fd, uint32_t bufferId)
+{
+	stub_drm_ioctls[STUB_DRM_RM_FB]++;
+	return fd == stub_fd ? 0 : -EINVAL;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef STUB_DRM_H_
+#define STUB_DRM_H_
+
+#include <stdint.h>
+
+/* An in-memory stand-in for a DRM device, enough for armsoc_dumb.c and
+ * exynos_fimg2d.c: dumb buffers are carved out of one sparse memfd, so
+ * the real mmap() of the bo code works on the device fd, and the
+ * driver's drmIoctl(), drmModeAddFB() and drmModeRmFB() calls land here
+ * instead of in libdrm.
+ */
+enum stub_drm_ioctl {
+	STUB_DRM_CREATE_DUMB,
+	STUB_DRM_MAP_DUMB,
+	STUB_DRM_DESTROY_DUMB,
+	STUB_DRM_FLINK,
+	STUB_DRM_PRIME_TO_FD,
+	STUB_DRM_ADD_FB,
+	STUB_DRM_RM_FB,
+	STUB_DRM_G2D_GET_VER,
+	STUB_DRM_G2D_SET_CMDLIST,
+	STUB_DRM_G2D_EXEC,
+	STUB_DRM_OTHER,
+	STUB_DRM_IOCTL_COUNT
+};
+
+extern uint64_t stub_drm_ioctls[STUB_DRM_IOCTL_COUNT];
+
+/* Returns the device fd, or -1 */
+int stub_drm_open(void);
+void stub_drm_close(void);
+const char *stub_drm_ioctl_name(enum stub_drm_ioctl ioctl);
+/* Bytes in live dumb buffers */
+uint64_t stub_drm_bytes(void);
+/* CPU mapping of a dumb buffer, or NULL for an unknown handle */
+void *stub_drm_map(uint32_t handle, uint64_t *size);
+
+/* Registers from SOFT_RESET_REG to the end of the valid range */
+#define STUB_G2D_REGS		(0x0880 / 4)
+
+/* What the G2D emulator in stub_g2d.c was given and did. Each command
+ * list is one blit, as the driver flushes one per g2d_*() call.
+ */
+struct stub_g2d_stats {
+	uint64_t lists;		/* command lists accepted */
+	uint64_t rejected;	/* refused as the kernel would */
+	uint64_t execs;
+	uint64_t regs;		/* register writes, base addresses included */
+	uint64_t base_regs;	/* base address writes */
+	uint64_t unchanged;	/* writes of what the list before wrote */
+	uint64_t fills;
+	uint64_t blits;		/* through ROP4 */
+	uint64_t blends;
+	uint64_t scaled;
+	uint64_t rotated;
+	uint64_t unsupported;	/* lists using what isn't emulated */
+	uint64_t pixels;
+	uint64_t reg_writes[STUB_G2D_REGS];
+};
+
+extern struct stub_g2d_stats stub_g2d_stats;
+
+int stub_g2d_set_cmdlist(void *arg);
+int stub_g2d_exec(void *arg);
+void stub_g2d_reset(void);
+
+#endif /* STUB_DRM_H_ */
@@ -0,0 +1,902 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xf86drm.h>
+#include <uapi/drm/exynos_drm.h>
+
+#include "fimg2d_reg.h"
+#include "exynos_fimg2d.h"
+
+#include "stub_drm.h"
+
+/*
+ * A software FIMG2D for the G2D ioctls of stub_drm.c. Command lists are
+ * checked as exynos_drm_g2d.c checks them when they are set, and run on
+ * the CPU, in order, when they are executed. Like the kernel, every list
+ * starts from a reset register file and ends with a BITBLT start, so a
+ * list is exactly one blit; registers reset to 0 here.
+ *
+ * Emulated: the fast solid fill; the ROP4 blit with source, foreground
+ * or background colour operands and a foreground colour third operand;
+ * the alpha blend functions with premultiplied operands; nearest and
+ * bilinear scaling, the source and destination directions, 90 degree
+ * rotation and the clipping window; the RGB colour modes in any
+ * channel order for 8888 and AXRGB otherwise, plus A8 and L8. Colour
+ * registers hold the destination colour mode. Masks, patterns, colour
+ * keys, fading, (de)premultiplication and YCbCr are counted as
+ * unsupported and the list is skipped.
+ *
+ * Scaled sources are sampled at pixel centres as pixman does, so
+ * the rounding of the real scaler may differ by a pixel; bilinear
+ * weights have 8 bits.
+ */
+
+/* exynos_drm_g2d.c: G2D_VALID_START, G2D_VALID_END, G2D_LEN_MIN/MAX */
+#define STUB_G2D_VALID_START	0x0104
+#define STUB_G2D_VALID_END	0x0880
+#define STUB_G2D_LEN_MAX	8000
+
+#define STUB_G2D_REG(offset)	((offset) / 4)
+
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#define MAX(a, b)	((a) > (b) ? (a) : (b))
+
+enum stub_g2d_base {
+	STUB_G2D_BASE_SRC,
+	STUB_G2D_BASE_SRC_PLANE2,
+	STUB_G2D_BASE_DST,
+	STUB_G2D_BASE_DST_PLANE2,
+	STUB_G2D_BASE_PAT,
+	STUB_G2D_BASE_MASK,
+	STUB_G2D_BASE_COUNT
+};
+
+/* A base address: a GEM handle, or user memory */
+struct stub_g2d_buf {
+	uint32_t handle;
+	uint8_t *userptr;
+	uint64_t size;
+	int set;
+};
+
+struct stub_g2d_list {
+	uint32_t regs[STUB_G2D_REGS];
+	struct stub_g2d_buf bufs[STUB_G2D_BASE_COUNT];
+};
+
+struct stub_g2d_image {
+	uint8_t *base;
+	uint32_t stride;
+	uint32_t mode;
+	int cpp;
+	int x1, y1, x2, y2;
+};
+
+struct stub_g2d_stats stub_g2d_stats;
+
+static struct stub_g2d_list *stub_g2d_lists;
+static unsigned int stub_g2d_lists_nr;
+static unsigned int stub_g2d_lists_size;
+
+/* what the list before wrote, for the unchanged count */
+static uint32_t stub_g2d_last[STUB_G2D_REGS];
+static uint8_t stub_g2d_last_set[STUB_G2D_REGS];
+
+static int stub_g2d_base_index(uint32_t offset)
+{
+	switch (offset) {
+	case SRC_BASE_ADDR_REG:
+		return STUB_G2D_BASE_SRC;
+	case SRC_PLANE2_BASE_ADDR_REG:
+		return STUB_G2D_BASE_SRC_PLANE2;
+	case DST_BASE_ADDR_REG:
+		return STUB_G2D_BASE_DST;
+	case DST_PLANE2_BASE_ADDR_REG:
+		return STUB_G2D_BASE_DST_PLANE2;
+	case PAT_BASE_ADDR_REG:
+		return STUB_G2D_BASE_PAT;
+	case MASK_BASE_ADDR_REG:
+		return STUB_G2D_BASE_MASK;
+	default:
+		return -1;
+	}
+}
+
+/* Bytes per pixel of a colour mode, 0 for the ones not emulated */
+static int stub_g2d_cpp(uint32_t mode)
+{
+	uint32_t order = mode & G2D_ORDER_MASK;
+
+	if (mode & ~(G2D_COLOR_FMT_MASK | G2D_ORDER_MASK))
+		return 0;
+
+	switch (mode & G2D_COLOR_FMT_MASK) {
+	case G2D_COLOR_FMT_XRGB8888:
+	case G2D_COLOR_FMT_ARGB8888:
+		return 4;
+	case G2D_COLOR_FMT_RGB565:
+	case G2D_COLOR_FMT_XRGB1555:
+	case G2D_COLOR_FMT_ARGB1555:
+	case G2D_COLOR_FMT_XRGB4444:
+	case G2D_COLOR_FMT_ARGB4444:
+		return order == G2D_ORDER_AXRGB ? 2 : 0;
+	case G2D_COLOR_FMT_A8:
+	case G2D_COLOR_FMT_L8:
+		return order == G2D_ORDER_AXRGB ? 1 : 0;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t stub_g2d_expand(uint32_t v, int bits)
+{
+	/* replicate the top bits, as pixman does */
+	v <<= 8 - bits;
+	return v | (v >> bits);
+}
+
+/* 8888 in a register's channel order to AXRGB; each is its own inverse
+ * except RGBAX */
+static uint32_t stub_g2d_order(uint32_t mode, uint32_t v, int store)
+{
+	switch (mode & G2D_ORDER_MASK) {
+	case G2D_ORDER_RGBAX:
+		return store ? (v << 8) | (v >> 24) : (v >> 8) | (v << 24);
+	case G2D_ORDER_AXBGR:
+		return (v & 0xff00ff00) | ((v >> 16) & 0xff) |
+			((v & 0xff) << 16);
+	case G2D_ORDER_BGRAX:
+		return __builtin_bswap32(v);
+	default:
+		return v;
+	}
+}
+
+/* A pixel or colour register in a colour mode to a8r8g8b8 */
+static uint32_t stub_g2d_to_argb(uint32_t mode, uint32_t v)
+{
+	uint32_t a, r, g, b;
+
+	switch (mode & G2D_COLOR_FMT_MASK) {
+	case G2D_COLOR_FMT_XRGB8888:
+		return stub_g2d_order(mode, v, 0) | 0xff000000;
+	case G2D_COLOR_FMT_ARGB8888:
+		return stub_g2d_order(mode, v, 0);
+	case G2D_COLOR_FMT_RGB565:
+		a = 0xff;
+		r = stub_g2d_expand((v >> 11) & 0x1f, 5);
+		g = stub_g2d_expand((v >> 5) & 0x3f, 6);
+		b = stub_g2d_expand(v & 0x1f, 5);
+		break;
+	case G2D_COLOR_FMT_XRGB1555:
+	case G2D_COLOR_FMT_ARGB1555:
+		a = (mode & G2D_COLOR_FMT_MASK) == G2D_COLOR_FMT_XRGB1555 ||
+			(v & 0x8000) ? 0xff : 0;
+		r = stub_g2d_expand((v >> 10) & 0x1f, 5);
+		g = stub_g2d_expand((v >> 5) & 0x1f, 5);
+		b = stub_g2d_expand(v & 0x1f, 5);
+		break;
+	case G2D_COLOR_FMT_XRGB4444:
+	case G2D_COLOR_FMT_ARGB4444:
+		a = (mode & G2D_COLOR_FMT_MASK) == G2D_COLOR_FMT_XRGB4444 ?
+			0xff : ((v >> 12) & 0xf) * 0x11;
+		r = ((v >> 8) & 0xf) * 0x11;
+		g = ((v >> 4) & 0xf) * 0x11;
+		b = (v & 0xf) * 0x11;
+		break;
+	case G2D_COLOR_FMT_A8:
+		return (v & 0xff) << 24;
+	case G2D_COLOR_FMT_L8:
+		return 0xff000000 | (v & 0xff) * 0x010101;
+	default:
+		return 0;
+	}
+
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* a8r8g8b8 to a colour mode, truncating. X bits come out as ones. */
+static uint32_t stub_g2d_from_argb(uint32_t mode, uint32_t v)
+{
+	uint32_t a = v >> 24, r = (v >> 16) & 0xff;
+	uint32_t g = (v >> 8) & 0xff, b = v & 0xff;
+
+	switch (mode & G2D_COLOR_FMT_MASK) {
+	case G2D_COLOR_FMT_XRGB8888:
+		return stub_g2d_order(mode, v | 0xff000000, 1);
+	case G2D_COLOR_FMT_ARGB8888:
+		return stub_g2d_order(mode, v, 1);
+	case G2D_COLOR_FMT_RGB565:
+		return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	case G2D_COLOR_FMT_XRGB1555:
+		a = 0xff;
+		/* fall through */
+	case G2D_COLOR_FMT_ARGB1555:
+		return ((a >> 7) << 15) | ((r >> 3) << 10) |
+			((g >> 3) << 5) | (b >> 3);
+	case G2D_COLOR_FMT_XRGB4444:
+		a = 0xff;
+		/* fall through */
+	case G2D_COLOR_FMT_ARGB4444:
+		return ((a >> 4) << 12) | ((r >> 4) << 8) |
+			((g >> 4) << 4) | (b >> 4);
+	case G2D_COLOR_FMT_A8:
+		return a;
+	case G2D_COLOR_FMT_L8:
+		/* the luma of BT.601, as the blitter's CSC would */
+		return (r * 77 + g * 150 + b * 29) >> 8;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t stub_g2d_read(const struct stub_g2d_image *img, int x, int y)
+{
+	const uint8_t *p = img->base + (uint64_t)y * img->stride +
+			x * img->cpp;
+	uint32_t v;
+
+	switch (img->cpp) {
+	case 4:
+		memcpy(&v, p, 4);
+		break;
+	case 2: {
+		uint16_t v16;
+
+		memcpy(&v16, p, 2);
+		v = v16;
+		break;
+	}
+	default:
+		v = *p;
+		break;
+	}
+
+	return stub_g2d_to_argb(img->mode, v);
+}
+
+static void stub_g2d_write(const struct stub_g2d_image *img, int x, int y,
+		uint32_t raw)
+{
+	uint8_t *p = img->base + (uint64_t)y * img->stride + x * img->cpp;
+
+	switch (img->cpp) {
+	case 4:
+		memcpy(p, &raw, 4);
+		break;
+	case 2: {
+		uint16_t v16 = raw;
+
+		memcpy(p, &v16, 2);
+		break;
+	}
+	default:
+		*p = raw;
+		break;
+	}
+}
+
+static uint32_t stub_g2d_reg(const struct stub_g2d_list *list,
+		uint32_t offset)
+{
+	return list->regs[STUB_G2D_REG(offset)];
+}
+
+/* x in the low, y in the high half, see union g2d_point_val */
+static void stub_g2d_rect(const struct stub_g2d_list *list,
+		uint32_t lt, uint32_t rb, struct stub_g2d_image *img)
+{
+	union g2d_point_val pt;
+
+	pt.val = stub_g2d_reg(list, lt);
+	img->x1 = pt.data.x;
+	img->y1 = pt.data.y;
+	pt.val = stub_g2d_reg(list, rb);
+	img->x2 = pt.data.x;
+	img->y2 = pt.data.y;
+}
+
+/*
+ * The kernel's g2d_check_buf_desc_is_valid(): the rectangle must be
+ * ordered, within the blitter's limits and inside the buffer.
+ */
+static int stub_g2d_check_image(const struct stub_g2d_list *list,
+		int base, uint32_t mode_reg, uint32_t stride_reg,
+		uint32_t lt, uint32_t rb)
+{
+	const struct stub_g2d_buf *buf = &list->bufs[base];
+	struct stub_g2d_image img;
+	uint64_t size = buf->size;
+	uint64_t last;
+	int cpp;
+
+	if (buf->handle && !stub_drm_map(buf->handle, &size))
+		return -ENOENT;
+
+	stub_g2d_rect(list, lt, rb, &img);
+	if (img.x1 >= img.x2 || img.y1 >= img.y2 ||
+			img.x2 > STUB_G2D_LEN_MAX || img.y2 > STUB_G2D_LEN_MAX)
+		return -EINVAL;
+
+	/* modes the kernel knows but not emulated fail at exec */
+	cpp = stub_g2d_cpp(stub_g2d_reg(list, mode_reg));
+	if (!cpp)
+		return 0;
+
+	last = (uint64_t)(img.y2 - 1) * stub_g2d_reg(list, stride_reg) +
+			(uint64_t)img.x2 * cpp - 1;
+	return last < size ? 0 : -EFAULT;
+}
+
+static int stub_g2d_parse(struct stub_g2d_list *list,
+		const struct drm_exynos_g2d_cmd *cmds, uint32_t nr,
+		int for_addr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		uint32_t offset = cmds[i].offset & ~G2D_BUF_USERPTR;
+		int base = stub_g2d_base_index(offset);
+		struct stub_g2d_buf *buf;
+
+		if (offset < STUB_G2D_VALID_START ||
+				offset >= STUB_G2D_VALID_END || offset % 4)
+			return -EINVAL;
+
+		/* base addresses only in cmd_buf, and nothing else there */
+		if ((base >= 0) != for_addr)
+			return -EINVAL;
+
+		stub_g2d_stats.reg_writes[STUB_G2D_REG(offset)]++;
+		if (stub_g2d_last_set[STUB_G2D_REG(offset)] &&
+				stub_g2d_last[STUB_G2D_REG(offset)] ==
+				cmds[i].data)
+			stub_g2d_stats.unchanged++;
+		stub_g2d_last[STUB_G2D_REG(offset)] = cmds[i].data;
+		stub_g2d_last_set[STUB_G2D_REG(offset)] = 1;
+
+		list->regs[STUB_G2D_REG(offset)] = cmds[i].data;
+		if (base < 0)
+			continue;
+
+		buf = &list->bufs[base];
+		memset(buf, 0, sizeof(*buf));
+		buf->set = 1;
+		if (cmds[i].offset & G2D_BUF_USERPTR) {
+			/* the driver keeps this alive until the flush */
+			const struct drm_exynos_g2d_userptr *userptr =
+				(void *)(uintptr_t)cmds[i].data;
+
+			buf->userptr = (uint8_t *)(uintptr_t)userptr->userptr;
+			buf->size = userptr->size;
+		} else {
+			buf->handle = cmds[i].data;
+		}
+	}
+
+	return 0;
+}
+
+int stub_g2d_set_cmdlist(void *arg)
+{
+	struct drm_exynos_g2d_set_cmdlist *cmdlist = arg;
+	struct stub_g2d_list *list;
+	int ret;
+
+	if (stub_g2d_lists_nr == stub_g2d_lists_size) {
+		unsigned int size = stub_g2d_lists_size ?
+				stub_g2d_lists_size * 2 : 16;
+		struct stub_g2d_list *lists = realloc(stub_g2d_lists,
+				size * sizeof(*lists));
+
+		if (!lists)
+			return -ENOMEM;
+		stub_g2d_lists = lists;
+		stub_g2d_lists_size = size;
+	}
+
+	list = &stub_g2d_lists[stub_g2d_lists_nr];
+	memset(list, 0, sizeof(*list));
+
+	ret = stub_g2d_parse(list,
+			(void *)(uintptr_t)cmdlist->cmd_buf,
+			cmdlist->cmd_buf_nr, 1);
+	if (!ret)
+		ret = stub_g2d_parse(list, (void *)(uintptr_t)cmdlist->cmd,
+				cmdlist->cmd_nr, 0);
+
+	if (!ret && list->bufs[STUB_G2D_BASE_DST].set)
+		ret = stub_g2d_check_image(list, STUB_G2D_BASE_DST,
+				DST_COLOR_MODE_REG, DST_STRIDE_REG,
+				DST_LEFT_TOP_REG, DST_RIGHT_BOTTOM_REG);
+	if (!ret && list->bufs[STUB_G2D_BASE_SRC].set)
+		ret = stub_g2d_check_image(list, STUB_G2D_BASE_SRC,
+				SRC_COLOR_MODE_REG, SRC_STRIDE_REG,
+				SRC_LEFT_TOP_REG, SRC_RIGHT_BOTTOM_REG);
+
+	if (ret) {
+		stub_g2d_stats.rejected++;
+		return ret;
+	}
+
+	stub_g2d_stats.lists++;
+	stub_g2d_stats.regs += cmdlist->cmd_nr + cmdlist->cmd_buf_nr;
+	stub_g2d_stats.base_regs += cmdlist->cmd_buf_nr;
+	stub_g2d_lists_nr++;
+	return 0;
+}
+
+static int stub_g2d_image(const struct stub_g2d_list *list, int base,
+		uint32_t mode_reg, uint32_t stride_reg, uint32_t lt,
+		uint32_t rb, struct stub_g2d_image *img)
+{
+	const struct stub_g2d_buf *buf = &list->bufs[base];
+	uint64_t size;
+
+	if (!buf->set)
+		return 0;
+
+	img->base = buf->handle ? stub_drm_map(buf->handle, &size) :
+			buf->userptr;
+	img->mode = stub_g2d_reg(list, mode_reg);
+	img->cpp = stub_g2d_cpp(img->mode);
+	img->stride = stub_g2d_reg(list, stride_reg);
+	stub_g2d_rect(list, lt, rb, img);
+
+	return img->base && img->cpp;
+}
+
+static uint32_t stub_g2d_fetch(const struct stub_g2d_list *list,
+		const struct stub_g2d_image *img, int x, int y)
+{
+	int w = img->x2 - img->x1, h = img->y2 - img->y1;
+
+	x -= img->x1;
+	y -= img->y1;
+
+	if (x < 0 || x >= w || y < 0 || y >= h) {
+		switch (stub_g2d_reg(list, SRC_REPEAT_MODE_REG)) {
+		case G2D_REPEAT_MODE_REPEAT:
+			x = ((x % w) + w) % w;
+			y = ((y % h) + h) % h;
+			break;
+		case G2D_REPEAT_MODE_REFLECT:
+			x = ((x % (2 * w)) + 2 * w) % (2 * w);
+			y = ((y % (2 * h)) + 2 * h) % (2 * h);
+			if (x >= w)
+				x = 2 * w - 1 - x;
+			if (y >= h)
+				y = 2 * h - 1 - y;
+			break;
+		case G2D_REPEAT_MODE_PAD:
+			return stub_g2d_to_argb(img->mode,
+				stub_g2d_reg(list, SRC_PAD_VALUE_REG));
+		default:
+			/* clamp, and none as if clamped */
+			x = x < 0 ? 0 : x >= w ? w - 1 : x;
+			y = y < 0 ? 0 : y >= h ? h - 1 : y;
+			break;
+		}
+	}
+
+	return stub_g2d_read(img, img->x1 + x, img->y1 + y);
+}
+
+static uint32_t stub_g2d_lerp(uint32_t a, uint32_t b, uint32_t w)
+{
+	uint32_t r = 0;
+	int shift;
+
+	for (shift = 0; shift < 32; shift += 8)
+		r |= ((((a >> shift) & 0xff) * (256 - w) +
+			((b >> shift) & 0xff) * w) >> 8) << shift;
+	return r;
+}
+
+/*
+ * The source pixel for the position (x, y) in the scaler's output,
+ * which is the destination before the rotation. Positions are sampled
+ * at their centres; xscale and yscale are source pixels per output
+ * pixel in 16.16.
+ */
+static uint32_t stub_g2d_sample(const struct stub_g2d_list *list,
+		const struct stub_g2d_image *src, int x, int y)
+{
+	uint32_t ctrl = stub_g2d_reg(list, SRC_SCALE_CTRL_REG) & 3;
+	int64_t xscale = stub_g2d_reg(list, SRC_XSCALE_REG);
+	int64_t yscale = stub_g2d_reg(list, SRC_YSCALE_REG);
+	int64_t fx, fy;
+	uint32_t top, bottom;
+	int x0, y0;
+
+	if (ctrl == G2D_SCALE_MODE_NONE || !xscale || !yscale)
+		return stub_g2d_fetch(list, src, src->x1 + x, src->y1 + y);
+
+	fx = x * xscale + xscale / 2;
+	fy = y * yscale + yscale / 2;
+
+	if (ctrl == G2D_SCALE_MODE_NEAREST)
+		return stub_g2d_fetch(list, src,
+				src->x1 + (int)((fx - 1) >> 16),
+				src->y1 + (int)((fy - 1) >> 16));
+
+	fx -= 0x8000;
+	fy -= 0x8000;
+	x0 = src->x1 + (int)(fx >> 16);
+	y0 = src->y1 + (int)(fy >> 16);
+	top = stub_g2d_lerp(stub_g2d_fetch(list, src, x0, y0),
+			stub_g2d_fetch(list, src, x0 + 1, y0),
+			(fx >> 8) & 0xff);
+	bottom = stub_g2d_lerp(stub_g2d_fetch(list, src, x0, y0 + 1),
+			stub_g2d_fetch(list, src, x0 + 1, y0 + 1),
+			(fx >> 8) & 0xff);
+	return stub_g2d_lerp(top, bottom, (fy >> 8) & 0xff);
+}
+
+static uint32_t stub_g2d_rop(uint32_t rop3, uint32_t s, uint32_t d,
+		uint32_t p)
+{
+	uint32_t r = 0;
+	int k;
+
+	switch (rop3) {
+	case G2D_ROP3_SRC:
+		return s;
+	case G2D_ROP3_DST:
+		return d;
+	}
+
+	/* bit k of the ROP3 is the result for P, S, D = k[2], k[1], k[0] */
+	for (k = 0; k < 8; k++)
+		if (rop3 & (1 << k))
+			r |= ((k & 4) ? p : ~p) & ((k & 2) ? s : ~s) &
+				((k & 1) ? d : ~d);
+	return r;
+}
+
+/* pixman's MUL_UN8 */
+static uint32_t stub_g2d_mul(uint32_t a, uint32_t b)
+{
+	uint32_t t = a * b + 0x80;
+
+	return ((t >> 8) + t) >> 8;
+}
+
+static uint32_t stub_g2d_div(uint32_t a, uint32_t b)
+{
+	if (!b || a >= b)
+		return 0xff;
+	return a * 0xff / b;
+}
+
+/* The coefficient of enum e_g2d_coeff_mode for the channel at shift */
+static uint32_t stub_g2d_coeff(uint32_t mode, uint32_t s, uint32_t d,
+		uint32_t global, int shift)
+{
+	uint32_t sa = s >> 24, da = d >> 24;
+
+	switch (mode) {
+	case G2D_COEFF_MODE_ONE:
+		return 0xff;
+	case G2D_COEFF_MODE_SRC_ALPHA:
+		return sa;
+	case G2D_COEFF_MODE_SRC_COLOR:
+		return (s >> shift) & 0xff;
+	case G2D_COEFF_MODE_DST_ALPHA:
+		return da;
+	case G2D_COEFF_MODE_DST_COLOR:
+		return (d >> shift) & 0xff;
+	case G2D_COEFF_MODE_GB_ALPHA:
+		return global & 0xff;
+	case G2D_COEFF_MODE_GB_COLOR:
+		/* ALPHA_REG: RGB in bits 31:8, alpha in 7:0 */
+		return shift == 24 ? global & 0xff :
+			(global >> (shift + 8)) & 0xff;
+	case G2D_COEFF_MODE_DISJOINT_S:
+		return stub_g2d_div(0xff - sa, da);
+	case G2D_COEFF_MODE_DISJOINT_D:
+		return stub_g2d_div(0xff - da, sa);
+	case G2D_COEFF_MODE_CONJOINT_S:
+		return stub_g2d_div(sa, da);
+	case G2D_COEFF_MODE_CONJOINT_D:
+		return stub_g2d_div(da, sa);
+	default:
+		return 0;
+	}
+}
+
+static uint32_t stub_g2d_blend(uint32_t func, uint32_t global, uint32_t s,
+		uint32_t d)
+{
+	union g2d_blend_func_val val;
+	uint32_t r = 0;
+	int shift;
+
+	val.val = func;
+	for (shift = 0; shift < 32; shift += 8) {
+		uint32_t fs = stub_g2d_coeff(val.data.src_coeff, s, d,
+				global, shift);
+		uint32_t fd = stub_g2d_coeff(val.data.dst_coeff, s, d,
+				global, shift);
+		uint32_t c;
+
+		if (val.data.inv_src_color_coeff)
+			fs = 0xff - fs;
+		if (val.data.inv_dst_color_coeff)
+			fd = 0xff - fd;
+
+		c = stub_g2d_mul((s >> shift) & 0xff, fs) +
+			stub_g2d_mul((d >> shift) & 0xff, fd);
+		r |= (c > 0xff ? 0xff : c) << shift;
+	}
+
+	return r;
+}
+
+/* Why the list can't be emulated, or NULL */
+static const char *stub_g2d_unsupported(const struct stub_g2d_list *list)
+{
+	union g2d_bitblt_cmd_val bitblt;
+	union g2d_blend_func_val blend;
+	union g2d_rop4_val rop4;
+	uint32_t rop3;
+
+	bitblt.val = stub_g2d_reg(list, BITBLT_COMMAND_REG);
+	if (bitblt.data.fast_solid_color_fill_en)
+		return NULL;
+
+	if (bitblt.data.mask_rop4_en || bitblt.data.masking_en ||
+			bitblt.data.rop4_alpha_en)
+		return "masks";
+	if (bitblt.data.transparent_mode || bitblt.data.color_key_mode)
+		return "colour keys";
+	if (bitblt.data.src_pre_multiply || bitblt.data.pat_pre_multiply ||
+			bitblt.data.dst_pre_multiply ||
+			bitblt.data.dst_depre_multiply)
+		return "(de)premultiplication";
+	if (stub_g2d_reg(list, SRC_SELECT_REG) > G2D_SELECT_MODE_BGCOLOR ||
+			stub_g2d_reg(list, DST_SELECT_REG) >
+			G2D_SELECT_MODE_BGCOLOR)
+		return "select modes";
+
+	switch (bitblt.data.alpha_blend_mode) {
+	case G2D_ALPHA_BLEND_MODE_DISABLE:
+		rop4.val = stub_g2d_reg(list, ROP4_REG);
+		rop3 = rop4.data.unmasked_rop3;
+		if (((rop3 >> 4) ^ rop3) & 0x0f &&
+				!(stub_g2d_reg(list, THIRD_OPERAND_REG) & 1))
+			return "patterns";
+		return NULL;
+	case G2D_ALPHA_BLEND_MODE_ENABLE:
+		blend.val = stub_g2d_reg(list, BLEND_FUNCTION_REG);
+		if (blend.data.src_coeff_src_a || blend.data.src_coeff_dst_a ||
+				blend.data.dst_coeff_src_a ||
+				blend.data.dst_coeff_dst_a ||
+				blend.data.lighten_en || blend.data.darken_en ||
+				blend.data.win_ce_src_over_en)
+			return "blend modes";
+		return NULL;
+	default:
+		return "fading";
+	}
+}
+
+static void stub_g2d_fill(const struct stub_g2d_list *list,
+		const struct stub_g2d_image *dst, const struct stub_g2d_image *cw)
+{
+	uint32_t color = stub_g2d_reg(list, FG_COLOR_REG);
+	int x, y;
+
+	for (y = MAX(dst->y1, cw->y1); y < MIN(dst->y2, cw->y2); y++)
+		for (x = MAX(dst->x1, cw->x1); x < MIN(dst->x2, cw->x2); x++)
+			stub_g2d_write(dst, x, y, color);
+}
+
+static void stub_g2d_blit(const struct stub_g2d_list *list,
+		const struct stub_g2d_image *src,
+		const struct stub_g2d_image *dst,
+		const struct stub_g2d_image *cw)
+{
+	union g2d_bitblt_cmd_val bitblt;
+	union g2d_rop4_val rop4;
+	uint32_t src_select = stub_g2d_reg(list, SRC_SELECT_REG);
+	uint32_t dst_select = stub_g2d_reg(list, DST_SELECT_REG);
+	uint32_t src_dir = stub_g2d_reg(list, SRC_MASK_DIRECT_REG);
+	uint32_t dst_dir = stub_g2d_reg(list, DST_PAT_DIRECT_REG);
+	uint32_t func = stub_g2d_reg(list, BLEND_FUNCTION_REG);
+	uint32_t global = stub_g2d_reg(list, ALPHA_REG);
+	int rotate = stub_g2d_reg(list, ROTATE_REG) & 1;
+	/* the same direction on both sides only orders the blit */
+	int mirror_x = (src_dir ^ dst_dir) & 1;
+	int mirror_y = ((src_dir ^ dst_dir) >> 1) & 1;
+	int w = dst->x2 - dst->x1, h = dst->y2 - dst->y1;
+	/* the scaler's output, before the rotation */
+	int rw = rotate ? h : w, rh = rotate ? w : h;
+	uint32_t fg, bg, s, d, r;
+	int blend, i, j;
+
+	bitblt.val = stub_g2d_reg(list, BITBLT_COMMAND_REG);
+	blend = bitblt.data.alpha_blend_mode == G2D_ALPHA_BLEND_MODE_ENABLE;
+	rop4.val = stub_g2d_reg(list, ROP4_REG);
+
+	fg = stub_g2d_to_argb(dst->mode, stub_g2d_reg(list, FG_COLOR_REG));
+	bg = stub_g2d_to_argb(dst->mode, stub_g2d_reg(list, BG_COLOR_REG));
+
+	/* in the order the directions ask for, reading what earlier
+	 * pixels of an overlapping blit wrote, as the hardware does */
+	for (j = 0; j < h; j++) {
+		int y = (dst_dir & 2) ? h - 1 - j : j;
+
+		if (dst->y1 + y < cw->y1 || dst->y1 + y >= cw->y2)
+			continue;
+
+		for (i = 0; i < w; i++) {
+			int x = (dst_dir & 1) ? w - 1 - i : i;
+			int sx, sy;
+
+			if (dst->x1 + x < cw->x1 || dst->x1 + x >= cw->x2)
+				continue;
+
+			switch (src_select) {
+			case G2D_SELECT_MODE_FGCOLOR:
+				s = fg;
+				break;
+			case G2D_SELECT_MODE_BGCOLOR:
+				s = bg;
+				break;
+			default:
+				/* clockwise: (x, y) comes from (y, w - 1 - x) */
+				sx = rotate ? y : x;
+				sy = rotate ? w - 1 - x : y;
+				if (mirror_x)
+					sx = rw - 1 - sx;
+				if (mirror_y)
+					sy = rh - 1 - sy;
+				s = stub_g2d_sample(list, src, sx, sy);
+				break;
+			}
+
+			switch (dst_select) {
+			case G2D_SELECT_MODE_FGCOLOR:
+				d = fg;
+				break;
+			case G2D_SELECT_MODE_BGCOLOR:
+				d = bg;
+				break;
+			default:
+				d = stub_g2d_read(dst, dst->x1 + x, dst->y1 + y);
+				break;
+			}
+
+			if (blend)
+				r = stub_g2d_blend(func, global, s, d);
+			else
+				r = stub_g2d_rop(rop4.data.unmasked_rop3, s, d,
+						fg);
+
+			stub_g2d_write(dst, dst->x1 + x, dst->y1 + y,
+					stub_g2d_from_argb(dst->mode, r));
+		}
+	}
+}
+
+static void stub_g2d_run(const struct stub_g2d_list *list)
+{
+	static const char *warned;
+	union g2d_bitblt_cmd_val bitblt;
+	struct stub_g2d_image src, dst, cw;
+	const char *unsupported;
+	union g2d_point_val pt;
+
+	memset(&src, 0, sizeof(src));
+	memset(&dst, 0, sizeof(dst));
+
+	unsupported = stub_g2d_unsupported(list);
+	if (!unsupported &&
+			!stub_g2d_image(list, STUB_G2D_BASE_DST,
+				DST_COLOR_MODE_REG, DST_STRIDE_REG,
+				DST_LEFT_TOP_REG, DST_RIGHT_BOTTOM_REG, &dst))
+		unsupported = "destination buffer or colour mode";
+
+	bitblt.val = stub_g2d_reg(list, BITBLT_COMMAND_REG);
+	if (!unsupported && !bitblt.data.fast_solid_color_fill_en &&
+			stub_g2d_reg(list, SRC_SELECT_REG) ==
+			G2D_SELECT_MODE_NORMAL &&
+			!stub_g2d_image(list, STUB_G2D_BASE_SRC,
+				SRC_COLOR_MODE_REG, SRC_STRIDE_REG,
+				SRC_LEFT_TOP_REG, SRC_RIGHT_BOTTOM_REG, &src))
+		unsupported = "source buffer or colour mode";
+
+	if (unsupported) {
+		if (unsupported != warned)
+			fprintf(stderr, "stub_g2d: %s not emulated, "
+				"skipping\n", unsupported);
+		warned = unsupported;
+		stub_g2d_stats.unsupported++;
+		return;
+	}
+
+	/* the clipping window, or everything */
+	cw.x1 = cw.y1 = 0;
+	cw.x2 = cw.y2 = STUB_G2D_LEN_MAX;
+	if (bitblt.data.cw_en) {
+		pt.val = stub_g2d_reg(list, CW_LT_REG);
+		cw.x1 = pt.data.x;
+		cw.y1 = pt.data.y;
+		pt.val = stub_g2d_reg(list, CW_RB_REG);
+		cw.x2 = pt.data.x;
+		cw.y2 = pt.data.y;
+	}
+
+	stub_g2d_stats.pixels += (uint64_t)(dst.x2 - dst.x1) *
+			(dst.y2 - dst.y1);
+
+	if (bitblt.data.fast_solid_color_fill_en) {
+		stub_g2d_stats.fills++;
+		stub_g2d_fill(list, &dst, &cw);
+		return;
+	}
+
+	if (bitblt.data.alpha_blend_mode)
+		stub_g2d_stats.blends++;
+	else
+		stub_g2d_stats.blits++;
+	if (stub_g2d_reg(list, SRC_SCALE_CTRL_REG))
+		stub_g2d_stats.scaled++;
+	if (stub_g2d_reg(list, ROTATE_REG) & 1)
+		stub_g2d_stats.rotated++;
+
+	stub_g2d_blit(list, &src, &dst, &cw);
+}
+
+int stub_g2d_exec(void *arg)
+{
+	unsigned int i;
+
+	/* always synchronous; the driver asks for that anyway */
+	for (i = 0; i < stub_g2d_lists_nr; i++)
+		stub_g2d_run(&stub_g2d_lists[i]);
+
+	stub_g2d_lists_nr = 0;
+	stub_g2d_stats.execs++;
+	return 0;
+}
+
+void stub_g2d_reset(void)
+{
+	free(stub_g2d_lists);
+	stub_g2d_lists = NULL;
+	stub_g2d_lists_nr = 0;
+	stub_g2d_lists_size = 0;
+	memset(stub_g2d_last_set, 0, sizeof(stub_g2d_last_set));
+}
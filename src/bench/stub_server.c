@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2026 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+
+/* The few X server and EXA entry points the EXA code calls, for a
+ * single screen and no server behind it.
+ */
+
+ScrnInfoPtr *xf86Screens;
+ExaDriverPtr bench_exa;
+int bench_verbose;
+
+void
+xf86DrvMsg(int scrnIndex, MessageType type, const char *format, ...)
+{
+	va_list ap;
+
+	if (!bench_verbose && type != X_ERROR && type != X_WARNING)
+		return;
+
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+}
+
+ScrnInfoPtr
+xf86ScreenToScrn(ScreenPtr pScreen)
+{
+	return xf86Screens[pScreen->myNum];
+}
+
+CARD32
+GetTimeInMillis(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ExaDriverPtr
+exaDriverAlloc(void)
+{
+	return calloc(1, sizeof(ExaDriverRec));
+}
+
+Bool
+exaDriverInit(ScreenPtr pScreen, ExaDriverPtr pScreenInfo)
+{
+	bench_exa = pScreenInfo;
+	return TRUE;
+}
+
+void
+exaDriverFini(ScreenPtr pScreen)
+{
+	bench_exa = NULL;
+}
+
+void *
+exaGetPixmapDriverPrivate(PixmapPtr pPixmap)
+{
+	return ((struct bench_pixmap *)pPixmap)->driver_priv;
+}
+
+Bool
+exaPixmapHasGpuCopy(PixmapPtr pPixmap)
+{
+	return TRUE;
+}
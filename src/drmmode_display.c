@@ -55,15 +55,40 @@
 #include <libudev.h>
 #include "drmmode_driver.h"
 
-struct drmmode_cursor_rec {
-	/* hardware cursor: */
+#ifndef DRM_PLANE_TYPE_PRIMARY
+#define DRM_PLANE_TYPE_PRIMARY	1
+#endif
+#ifndef DRM_MODE_PROP_BITMASK
+#define DRM_MODE_PROP_BITMASK	(1<<5)
+#endif
+
+#ifndef DRM_PLANE_TYPE_OVERLAY
+#define DRM_PLANE_TYPE_OVERLAY	0
+#endif
+#ifndef DRM_PLANE_TYPE_CURSOR
+#define DRM_PLANE_TYPE_CURSOR	2
+#endif
+
+/* Number of cursor images kept in bos, enough for the frames of the
+ * usual animated cursors so cycling through them doesn't copy
+ */
+#define CURSOR_CACHE_SIZE 8
+
+struct drmmode_cursor_image {
+	/* padded image, NULL if this slot is unused */
 	struct armsoc_bo *bo;
-	int x, y;
-	 /* These are used for HWCURSOR_API_PLANE */
-	drmModePlane *ovr;
+	 /* This is used for HWCURSOR_API_PLANE */
 	uint32_t fb_id;
-	/* This is used for HWCURSOR_API_STANDARD */
-	uint32_t handle;
+	/* unpadded ARGB copy, to confirm hash matches */
+	CARD32 *argb;
+	uint32_t hash;
+	unsigned int last_used;
+};
+
+struct drmmode_cursor_rec {
+	/* hardware cursor images, shared by all crtcs: */
+	struct drmmode_cursor_image images[CURSOR_CACHE_SIZE];
+	unsigned int tick;
 };
 
 struct drmmode_rec {
@@ -75,15 +100,54 @@ struct drmmode_rec {
 	struct drmmode_cursor_rec *cursor;
 };
 
+/* Vblank event user_data points to a struct starting with one of these.
+ * DRI2's commands start with a type of 0.
+ */
+enum drmmode_event_type {
+	DRMMODE_EVENT_DRI2 = 0,
+	DRMMODE_EVENT_CURSOR,
+};
+
+struct drmmode_event {
+	int type;
+	xf86CrtcPtr crtc;
+};
+
 struct drmmode_crtc_private_rec {
 	struct drmmode_rec *drmmode;
 	uint32_t crtc_id;
+	/* index in mode_res->crtcs, as used by possible_crtcs masks */
+	int index;
 	int cursor_visible;
+	int cursor_x, cursor_y;
+	/* plane showing this crtc's cursor with HWCURSOR_API_PLANE.
+	 * Only shared with other crtcs if there aren't enough planes.
+	 */
+	drmModePlane *cursor_ovr;
+	Bool cursor_ovr_shared;
+	/* image this crtc's cursor shows */
+	struct drmmode_cursor_image *cursor_image;
+	/* HWCURSOR_API_PLANE moves are applied at most once per vblank:
+	 * the first goes straight to the plane and arms cursor_event,
+	 * later ones only set cursor_moved until the event flushes them
+	 */
+	struct drmmode_event cursor_event;
+	OsTimerPtr cursor_timer;
+	Bool cursor_flush_pending;
+	Bool cursor_moved;
 	/* settings retained on last good modeset */
 	int last_good_x;
 	int last_good_y;
 	Rotation last_good_rotation;
 	DisplayModePtr last_good_mode;
+	/* primary plane and its "rotation" property, if the display
+	 * controller can rotate the scanout itself. RandR's Rotation
+	 * bits have the same values as the property's bits.
+	 */
+	uint32_t primary_plane_id;
+	uint32_t rotation_prop_id;
+	uint32_t rotations;
+	uint32_t plane_rotation;
 };
 
 struct drmmode_prop_rec {
@@ -103,6 +167,11 @@ struct drmmode_output_priv {
 	drmModeConnectorPtr connector;
 	drmModeEncoderPtr *encoders;
 	drmModePropertyBlobPtr edid_blob;
+	/* connector/edid_blob were fetched by the PreInit probe threads
+	 * and have not been consumed by detect/get_modes yet
+	 */
+	Bool connector_fresh;
+	Bool edid_fresh;
 	int num_props;
 	struct drmmode_prop_rec *props;
 	int enc_mask;   /* encoders present (mask of encoder indices) */
@@ -110,7 +179,8 @@ struct drmmode_output_priv {
 };
 
 static void drmmode_output_dpms(xf86OutputPtr output, int mode);
-static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height);
+static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height,
+		uint32_t *old_fb_id);
 static Bool drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode, Rotation rotation, int x, int y);
 
 static struct drmmode_rec *
@@ -261,6 +331,66 @@ drmmode_revert_mode(xf86CrtcPtr crtc, uint32_t *output_ids, int output_count)
 	return TRUE;
 }
 
+/*
+ * Program the primary plane's rotation so that xf86CrtcRotate leaves
+ * the transform to the display controller rather than setting up a
+ * shadow. Transforms the plane can't express (scaling, or rotations
+ * it doesn't list) are reset to rotate-0 and left to the shadow path.
+ * Returns TRUE if the plane now applies @rotation.
+ */
+static Bool
+drmmode_crtc_set_rotation(xf86CrtcPtr crtc, Rotation rotation)
+{
+	ScrnInfoPtr pScrn = crtc->scrn;
+	struct drmmode_crtc_private_rec *drmmode_crtc = crtc->driver_private;
+	struct drmmode_rec *drmmode = drmmode_crtc->drmmode;
+	uint32_t plane_rotation = RR_Rotate_0;
+	Bool hw = FALSE;
+
+	if (!drmmode_crtc->rotation_prop_id)
+		return FALSE;
+
+#if XF86_CRTC_VERSION >= 7
+	if (!crtc->transformPresent &&
+	    (rotation & drmmode_crtc->rotations) == rotation) {
+		plane_rotation = rotation;
+		hw = TRUE;
+	}
+#endif
+
+	if (plane_rotation != drmmode_crtc->plane_rotation) {
+		if (drmModeObjectSetProperty(drmmode->fd,
+				drmmode_crtc->primary_plane_id,
+				DRM_MODE_OBJECT_PLANE,
+				drmmode_crtc->rotation_prop_id,
+				plane_rotation)) {
+			/* the current fb may not fit the rotated plane,
+			 * so try again with the crtc off
+			 */
+			drmModeSetCrtc(drmmode->fd, drmmode_crtc->crtc_id,
+					0, 0, 0, NULL, 0, NULL);
+			if (drmModeObjectSetProperty(drmmode->fd,
+					drmmode_crtc->primary_plane_id,
+					DRM_MODE_OBJECT_PLANE,
+					drmmode_crtc->rotation_prop_id,
+					plane_rotation)) {
+				WARNING_MSG("Failed to set plane rotation 0x%x on crtc %d",
+						plane_rotation,
+						drmmode_crtc->crtc_id);
+				plane_rotation = drmmode_crtc->plane_rotation;
+				hw = FALSE;
+			}
+		}
+		drmmode_crtc->plane_rotation = plane_rotation;
+	}
+
+#if XF86_CRTC_VERSION >= 7
+	crtc->driverIsPerformingTransform = hw ?
+			XF86DriverTransformOutput : XF86DriverTransformNone;
+#endif
+	return hw;
+}
+
 static Bool
 drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 		Rotation rotation, int x, int y)
@@ -276,6 +406,7 @@ drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 	int err;
 	int i;
 	uint32_t fb_id;
+	int fb_x = x, fb_y = y;
 	drmModeModeInfo kmode;
 	drmModeCrtcPtr newcrtc = NULL;
 
@@ -326,6 +457,8 @@ drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 		output_count++;
 	}
 
+	drmmode_crtc_set_rotation(crtc, rotation);
+
 	if (!xf86CrtcRotate(crtc)) {
 		ERROR_MSG(
 				"failed to assign rotation in drmmode_set_mode_major()");
@@ -333,6 +466,15 @@ drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 		goto cleanup;
 	}
 
+	/* A transform the plane can't do is rendered into a shadow,
+	 * which the crtc scans out from its origin
+	 */
+	if (crtc->rotatedData) {
+		fb_id = armsoc_bo_get_fb(ARMSOCPixmapBo(crtc->rotatedData));
+		fb_x = 0;
+		fb_y = 0;
+	}
+
 	if (crtc->funcs->gamma_set)
 		crtc->funcs->gamma_set(crtc, crtc->gamma_red, crtc->gamma_green,
 				       crtc->gamma_blue, crtc->gamma_size);
@@ -340,7 +482,7 @@ drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 	drmmode_ConvertToKMode(crtc->scrn, &kmode, mode);
 
 	err = drmModeSetCrtc(drmmode->fd, drmmode_crtc->crtc_id,
-			fb_id, x, y, output_ids, output_count, &kmode);
+			fb_id, fb_x, fb_y, output_ids, output_count, &kmode);
 	if (err) {
 		ERROR_MSG(
 				"drm failed to set mode: %s", strerror(-err));
@@ -451,7 +593,7 @@ drmmode_hide_cursor(xf86CrtcPtr crtc)
 
 	if (pARMSOC->drmmode_interface->cursor_api == HWCURSOR_API_PLANE) {
 		/* set plane's fb_id to 0 to disable it */
-		drmModeSetPlane(drmmode->fd, cursor->ovr->plane_id,
+		drmModeSetPlane(drmmode->fd, drmmode_crtc->cursor_ovr->plane_id,
 				drmmode_crtc->crtc_id, 0, 0,
 				0, 0, 0, 0, 0, 0, 0, 0);
 	} else { /* HWCURSOR_API_STANDARD */
@@ -483,6 +625,10 @@ drmmode_show_cursor_image(xf86CrtcPtr crtc, Bool update_image)
 
 	drmmode_crtc->cursor_visible = TRUE;
 
+	/* shown once an image is loaded */
+	if (!drmmode_crtc->cursor_image)
+		return;
+
 	w = pARMSOC->drmmode_interface->cursor_width;
 	h = pARMSOC->drmmode_interface->cursor_height;
 	pad = pARMSOC->drmmode_interface->cursor_padding;
@@ -490,8 +636,8 @@ drmmode_show_cursor_image(xf86CrtcPtr crtc, Bool update_image)
 	/* get padded width */
 	w = w + 2 * pad;
 	/* get x of padded cursor */
-	crtc_x = cursor->x - pad;
-	crtc_y = cursor->y;
+	crtc_x = drmmode_crtc->cursor_x - pad;
+	crtc_y = drmmode_crtc->cursor_y;
 
 	if (pARMSOC->drmmode_interface->cursor_api == HWCURSOR_API_PLANE) {
 		src_x = 0;
@@ -516,16 +662,20 @@ drmmode_show_cursor_image(xf86CrtcPtr crtc, Bool update_image)
 		if ((crtc_y + h) > crtc->mode.VDisplay)
 			h = crtc->mode.VDisplay - crtc_y;
 
+		drmmode_crtc->cursor_moved = FALSE;
+
 		/* note src coords (last 4 args) are in Q16 format */
-		drmModeSetPlane(drmmode->fd, cursor->ovr->plane_id,
-			drmmode_crtc->crtc_id, cursor->fb_id, 0,
+		drmModeSetPlane(drmmode->fd, drmmode_crtc->cursor_ovr->plane_id,
+			drmmode_crtc->crtc_id,
+			drmmode_crtc->cursor_image->fb_id, 0,
 			crtc_x, crtc_y, w, h, src_x<<16, src_y<<16,
 			w<<16, h<<16);
 	} else {
 		if (update_image)
 			drmModeSetCursor(drmmode->fd,
 					 drmmode_crtc->crtc_id,
-					 cursor->handle, w, h);
+					 armsoc_bo_handle(drmmode_crtc->cursor_image->bo),
+					 w, h);
 		drmModeMoveCursor(drmmode->fd,
 				  drmmode_crtc->crtc_id,
 				  crtc_x, crtc_y);
@@ -538,18 +688,107 @@ drmmode_show_cursor(xf86CrtcPtr crtc)
 	drmmode_show_cursor_image(crtc, TRUE);
 }
 
+/* The pipe bits of a vblank request for the crtc at @index */
+static uint32_t
+drmmode_crtc_vblank_pipe(int index)
+{
+	if (index > 1)
+		return (index << DRM_VBLANK_HIGH_CRTC_SHIFT) &
+				DRM_VBLANK_HIGH_CRTC_MASK;
+	else if (index > 0)
+		return DRM_VBLANK_SECONDARY;
+	return 0;
+}
+
+static void drmmode_cursor_arm_flush(xf86CrtcPtr crtc);
+
+/* Apply the last of the moves coalesced since the previous vblank */
+static void
+drmmode_cursor_flush(xf86CrtcPtr crtc)
+{
+	struct drmmode_crtc_private_rec *drmmode_crtc = crtc->driver_private;
+	struct drmmode_rec *drmmode = drmmode_crtc->drmmode;
+
+	drmmode_crtc->cursor_flush_pending = FALSE;
+
+	if (!drmmode->cursor || !drmmode_crtc->cursor_visible ||
+	    !drmmode_crtc->cursor_moved)
+		return;
+
+	drmmode_show_cursor_image(crtc, FALSE);
+	drmmode_cursor_arm_flush(crtc);
+}
+
+static CARD32
+drmmode_cursor_timer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+	drmmode_cursor_flush(arg);
+	return 0;
+}
+
+/*
+ * Get drmmode_cursor_flush called at the next vblank of @crtc, or
+ * after a refresh period if vblank events aren't available.
+ */
+static void
+drmmode_cursor_arm_flush(xf86CrtcPtr crtc)
+{
+	ScrnInfoPtr pScrn = crtc->scrn;
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct drmmode_crtc_private_rec *drmmode_crtc = crtc->driver_private;
+	drmVBlank vbl;
+	int vrefresh;
+	CARD32 interval = 16;
+
+	drmmode_crtc->cursor_flush_pending = TRUE;
+
+	if (pARMSOC->drmmode_interface->vblank_query_supported) {
+		vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+				drmmode_crtc_vblank_pipe(drmmode_crtc->index);
+		vbl.request.sequence = 1;
+		vbl.request.signal =
+				(unsigned long)&drmmode_crtc->cursor_event;
+		if (!drmWaitVBlank(drmmode_crtc->drmmode->fd, &vbl))
+			return;
+	}
+
+	vrefresh = xf86ModeVRefresh(&crtc->mode);
+	if (vrefresh > 0)
+		interval = max(1000 / vrefresh, 1);
+
+	drmmode_crtc->cursor_timer = TimerSet(drmmode_crtc->cursor_timer, 0,
+			interval, drmmode_cursor_timer, crtc);
+}
+
 static void
 drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
 {
 	struct drmmode_crtc_private_rec *drmmode_crtc = crtc->driver_private;
 	struct drmmode_rec *drmmode = drmmode_crtc->drmmode;
 	struct drmmode_cursor_rec *cursor = drmmode->cursor;
+	ScrnInfoPtr pScrn = crtc->scrn;
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 
 	if (!cursor)
 		return;
 
-	cursor->x = x;
-	cursor->y = y;
+	drmmode_crtc->cursor_x = x;
+	drmmode_crtc->cursor_y = y;
+
+	/*
+	 * A plane update per move would be wasted on moves the display
+	 * never shows, so only the last move before each vblank is applied.
+	 */
+	if (pARMSOC->drmmode_interface->cursor_api == HWCURSOR_API_PLANE &&
+	    drmmode_crtc->cursor_visible) {
+		if (drmmode_crtc->cursor_flush_pending) {
+			drmmode_crtc->cursor_moved = TRUE;
+			return;
+		}
+		drmmode_show_cursor_image(crtc, FALSE);
+		drmmode_cursor_arm_flush(crtc);
+		return;
+	}
 
 	/*
 	 * Show the cursor at a different position without updating the image
@@ -594,36 +833,331 @@ static void set_cursor_image(xf86CrtcPtr crtc, uint32_t *d, CARD32 *s)
 	}
 }
 
+/* FNV-1a over the unpadded cursor image */
+static uint32_t
+cursor_image_hash(const CARD32 *image, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)image;
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Allocate the padded bo (and fb for HWCURSOR_API_PLANE) of a slot */
+static Bool
+drmmode_cursor_image_alloc(ScrnInfoPtr pScrn,
+		struct drmmode_cursor_image *img)
+{
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
+	uint32_t handles[4], pitches[4], offsets[4]; /* we only use [0] */
+	int w, h, pad;
+
+	w = pARMSOC->drmmode_interface->cursor_width;
+	h = pARMSOC->drmmode_interface->cursor_height;
+	pad = pARMSOC->drmmode_interface->cursor_padding;
+
+	/* allow for cursor padding in the bo */
+	img->bo = armsoc_bo_new_with_dim(pARMSOC->dev,
+				w + 2 * pad, h,
+				0, 32, ARMSOC_BO_SCANOUT);
+	if (!img->bo) {
+		ERROR_MSG("HW cursor: buffer allocation failed");
+		return FALSE;
+	}
+	armsoc_bo_set_usage(img->bo, ARMSOC_USAGE_CURSOR);
+
+	if (pARMSOC->drmmode_interface->cursor_api != HWCURSOR_API_PLANE)
+		return TRUE;
+
+	handles[0] = armsoc_bo_handle(img->bo);
+	pitches[0] = armsoc_bo_pitch(img->bo);
+	offsets[0] = 0;
+
+	/* allow for cursor padding in the fb */
+	if (drmModeAddFB2(drmmode->fd, w + 2 * pad, h, DRM_FORMAT_ARGB8888,
+			handles, pitches, offsets, &img->fb_id, 0)) {
+		ERROR_MSG("HW cursor: drmModeAddFB2 failed: %s",
+					strerror(errno));
+		armsoc_bo_unreference(img->bo);
+		img->bo = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+drmmode_cursor_image_free(ScrnInfoPtr pScrn,
+		struct drmmode_cursor_image *img)
+{
+	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
+
+	if (img->fb_id && drmModeRmFB(drmmode->fd, img->fb_id))
+		ERROR_MSG("drmModeRmFB() failed");
+	if (img->bo)
+		armsoc_bo_unreference(img->bo);
+	free(img->argb);
+	memset(img, 0, sizeof(*img));
+}
+
+static Bool
+drmmode_cursor_image_in_use(ScrnInfoPtr pScrn,
+		struct drmmode_cursor_image *img)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int c;
+
+	for (c = 0; c < xf86_config->num_crtc; c++) {
+		struct drmmode_crtc_private_rec *drmmode_crtc =
+				xf86_config->crtc[c]->driver_private;
+
+		if (drmmode_crtc->cursor_image == img)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Find the cached copy of a cursor image, or write it into the least
+ * recently used slot that no crtc is showing. So the image that is
+ * being replaced never changes under the scanout.
+ */
+static struct drmmode_cursor_image *
+drmmode_cursor_image_get(xf86CrtcPtr crtc, CARD32 *image)
+{
+	ScrnInfoPtr pScrn = crtc->scrn;
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
+	struct drmmode_cursor_rec *cursor = drmmode->cursor;
+	struct drmmode_cursor_image *img, *victim = NULL;
+	size_t size;
+	uint32_t hash;
+	uint32_t *d;
+	int i;
+
+	size = 4 * pARMSOC->drmmode_interface->cursor_width *
+			pARMSOC->drmmode_interface->cursor_height;
+	hash = cursor_image_hash(image, size);
+
+	for (i = 0; i < CURSOR_CACHE_SIZE; i++) {
+		img = &cursor->images[i];
+
+		if (img->argb && img->hash == hash &&
+		    !memcmp(img->argb, image, size)) {
+			img->last_used = ++cursor->tick;
+			return img;
+		}
+
+		if (drmmode_cursor_image_in_use(pScrn, img))
+			continue;
+		if (!victim || (victim->argb && (!img->argb ||
+				img->last_used < victim->last_used)))
+			victim = img;
+	}
+
+	if (!victim)
+		return NULL;
+
+	if (!victim->bo && !drmmode_cursor_image_alloc(pScrn, victim))
+		return NULL;
+
+	if (!victim->argb) {
+		victim->argb = malloc(size);
+		if (!victim->argb)
+			return NULL;
+	}
+
+	d = armsoc_bo_map(victim->bo);
+	if (!d) {
+		xf86DrvMsg(crtc->scrn->scrnIndex, X_ERROR,
+			"load_cursor_argb map failure\n");
+		free(victim->argb);
+		victim->argb = NULL;
+		return NULL;
+	}
+
+	set_cursor_image(crtc, d, image);
+	memcpy(victim->argb, image, size);
+	victim->hash = hash;
+	victim->last_used = ++cursor->tick;
+
+	return victim;
+}
+
+/*
+ * Switching images is a single plane/cursor update, without hiding
+ * the cursor first, as the new image is in a bo of its own.
+ */
 static void
 drmmode_load_cursor_argb(xf86CrtcPtr crtc, CARD32 *image)
 {
-	uint32_t *d;
 	struct drmmode_crtc_private_rec *drmmode_crtc = crtc->driver_private;
 	struct drmmode_rec *drmmode = drmmode_crtc->drmmode;
 	struct drmmode_cursor_rec *cursor = drmmode->cursor;
-	int visible;
+	struct drmmode_cursor_image *img;
 
 	if (!cursor)
 		return;
 
-	visible = drmmode_crtc->cursor_visible;
+	img = drmmode_cursor_image_get(crtc, image);
+	if (!img || img == drmmode_crtc->cursor_image)
+		return;
 
-	if (visible)
-		drmmode_hide_cursor(crtc);
+	drmmode_crtc->cursor_image = img;
 
-	d = armsoc_bo_map(cursor->bo);
-	if (!d) {
-		xf86DrvMsg(crtc->scrn->scrnIndex, X_ERROR,
-			"load_cursor_argb map failure\n");
-		if (visible)
-			drmmode_show_cursor_image(crtc, TRUE);
-		return;
+	if (drmmode_crtc->cursor_visible)
+		drmmode_show_cursor_image(crtc, TRUE);
+}
+
+/* Returns the "type" property of a plane, or -1 if it has none */
+static int
+drmmode_plane_type(int fd, uint32_t plane_id)
+{
+	drmModeObjectPropertiesPtr props;
+	int type = -1;
+	int i;
+
+	props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return -1;
+
+	for (i = 0; i < props->count_props && type < 0; i++) {
+		drmModePropertyPtr prop;
+
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, "type"))
+			type = props->prop_values[i];
+		drmModeFreeProperty(prop);
 	}
+	drmModeFreeObjectProperties(props);
+	return type;
+}
 
-	set_cursor_image(crtc, d, image);
+static void
+drmmode_cursor_release_planes(ScrnInfoPtr pScrn)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int c;
 
-	if (visible)
-		drmmode_show_cursor_image(crtc, TRUE);
+	for (c = 0; c < xf86_config->num_crtc; c++) {
+		struct drmmode_crtc_private_rec *drmmode_crtc =
+				xf86_config->crtc[c]->driver_private;
+
+		if (drmmode_crtc->cursor_ovr && !drmmode_crtc->cursor_ovr_shared)
+			drmModeFreePlane(drmmode_crtc->cursor_ovr);
+		drmmode_crtc->cursor_ovr = NULL;
+		drmmode_crtc->cursor_ovr_shared = FALSE;
+	}
+}
+
+/*
+ * Give every crtc a plane of its own for the cursor: one of type CURSOR
+ * if it has one, otherwise an overlay that no other crtc uses. Crtcs
+ * left without one share another crtc's plane, which then only shows
+ * the cursor on one of them at a time.
+ */
+static Bool
+drmmode_cursor_assign_planes(ScrnInfoPtr pScrn,
+		drmModePlaneRes *plane_resources)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
+	int count = plane_resources->count_planes;
+	drmModePlanePtr *planes;
+	drmModePlanePtr shared = NULL;
+	int *types;
+	int pass, c, i;
+
+	planes = calloc(count, sizeof(*planes));
+	types = calloc(count, sizeof(*types));
+	if (!planes || !types) {
+		free(planes);
+		free(types);
+		return FALSE;
+	}
+
+	for (i = 0; i < count; i++) {
+		planes[i] = drmModeGetPlane(drmmode->fd,
+				plane_resources->planes[i]);
+		if (!planes[i])
+			continue;
+		types[i] = drmmode_plane_type(drmmode->fd, planes[i]->plane_id);
+		/* kernels without plane types only list overlays */
+		if (types[i] < 0)
+			types[i] = DRM_PLANE_TYPE_OVERLAY;
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		int want = pass ? DRM_PLANE_TYPE_OVERLAY : DRM_PLANE_TYPE_CURSOR;
+
+		for (c = 0; c < xf86_config->num_crtc; c++) {
+			struct drmmode_crtc_private_rec *drmmode_crtc =
+					xf86_config->crtc[c]->driver_private;
+
+			if (drmmode_crtc->cursor_ovr)
+				continue;
+
+			for (i = 0; i < count; i++) {
+				if (!planes[i] || types[i] != want ||
+				    !(planes[i]->possible_crtcs &
+						(1 << drmmode_crtc->index)))
+					continue;
+
+				if (pARMSOC->drmmode_interface->init_plane_for_cursor &&
+					pARMSOC->drmmode_interface->init_plane_for_cursor(
+						drmmode->fd, planes[i]->plane_id)) {
+					ERROR_MSG("Failed driver-specific cursor initialization of plane %d",
+							planes[i]->plane_id);
+					drmModeFreePlane(planes[i]);
+					planes[i] = NULL;
+					continue;
+				}
+
+				INFO_MSG("HW cursor: plane %d for crtc %d",
+						planes[i]->plane_id,
+						drmmode_crtc->crtc_id);
+				drmmode_crtc->cursor_ovr = planes[i];
+				planes[i] = NULL;
+				if (!shared)
+					shared = drmmode_crtc->cursor_ovr;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (planes[i])
+			drmModeFreePlane(planes[i]);
+	}
+	free(planes);
+	free(types);
+
+	if (!shared)
+		return FALSE;
+
+	for (c = 0; c < xf86_config->num_crtc; c++) {
+		struct drmmode_crtc_private_rec *drmmode_crtc =
+				xf86_config->crtc[c]->driver_private;
+
+		if (drmmode_crtc->cursor_ovr)
+			continue;
+
+		WARNING_MSG("HW cursor: no plane for crtc %d, sharing plane %d",
+				drmmode_crtc->crtc_id, shared->plane_id);
+		drmmode_crtc->cursor_ovr = shared;
+		drmmode_crtc->cursor_ovr_shared = TRUE;
+	}
+
+	return TRUE;
 }
 
 static Bool
@@ -634,9 +1168,7 @@ drmmode_cursor_init_plane(ScreenPtr pScreen)
 	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
 	struct drmmode_cursor_rec *cursor;
 	drmModePlaneRes *plane_resources;
-	drmModePlane *ovr;
-	int w, h, pad;
-	uint32_t handles[4], pitches[4], offsets[4]; /* we only use [0] */
+	int w, h;
 	struct drm_set_client_cap cap;
 	int io;
 
@@ -662,10 +1194,6 @@ drmmode_cursor_init_plane(ScreenPtr pScreen)
 		return FALSE;
 	}
 
-	/* find an unused plane which can be used as a mouse cursor.  Note
-	 * that we cheat a bit, in order to not burn one overlay per crtc,
-	 * and only show the mouse cursor on one crtc at a time
-	 */
 	plane_resources = drmModeGetPlaneResources(drmmode->fd);
 	if (!plane_resources) {
 		ERROR_MSG("HW cursor: drmModeGetPlaneResources failed: %s",
@@ -673,87 +1201,40 @@ drmmode_cursor_init_plane(ScreenPtr pScreen)
 		return FALSE;
 	}
 
-	if (plane_resources->count_planes < 1) {
+	if (!drmmode_cursor_assign_planes(pScrn, plane_resources)) {
 		ERROR_MSG("not enough planes for HW cursor");
 		drmModeFreePlaneResources(plane_resources);
 		return FALSE;
 	}
-
-	/* TODO: loop through planes and find the cursor plane */
-	ovr = drmModeGetPlane(drmmode->fd, plane_resources->planes[1]);
-	if (!ovr) {
-		ERROR_MSG("HW cursor: drmModeGetPlane failed: %s",
-					strerror(errno));
-		drmModeFreePlaneResources(plane_resources);
-		return FALSE;
-	}
-
-	if (pARMSOC->drmmode_interface->init_plane_for_cursor &&
-		pARMSOC->drmmode_interface->init_plane_for_cursor(
-				drmmode->fd, ovr->plane_id)) {
-		ERROR_MSG("Failed driver-specific cursor initialization");
-		drmModeFreePlaneResources(plane_resources);
-		return FALSE;
-	}
+	drmModeFreePlaneResources(plane_resources);
 
 	cursor = calloc(1, sizeof(struct drmmode_cursor_rec));
 	if (!cursor) {
 		ERROR_MSG("HW cursor: calloc failed");
-		drmModeFreePlane(ovr);
-		drmModeFreePlaneResources(plane_resources);
+		drmmode_cursor_release_planes(pScrn);
 		return FALSE;
 	}
 
-	cursor->ovr = ovr;
-
 	w = pARMSOC->drmmode_interface->cursor_width;
 	h = pARMSOC->drmmode_interface->cursor_height;
-	pad = pARMSOC->drmmode_interface->cursor_padding;
-
-	/* allow for cursor padding in the bo */
-	cursor->bo  = armsoc_bo_new_with_dim(pARMSOC->dev,
-				w + 2 * pad, h,
-				0, 32, ARMSOC_BO_SCANOUT);
-
-	if (!cursor->bo) {
-		ERROR_MSG("HW cursor: buffer allocation failed");
-		free(cursor);
-		drmModeFreePlane(ovr);
-		drmModeFreePlaneResources(plane_resources);
-		return FALSE;
-	}
-
-	handles[0] = armsoc_bo_handle(cursor->bo);
-	pitches[0] = armsoc_bo_pitch(cursor->bo);
-	offsets[0] = 0;
 
-	/* allow for cursor padding in the fb */
-	if (drmModeAddFB2(drmmode->fd, w + 2 * pad, h, DRM_FORMAT_ARGB8888,
-			handles, pitches, offsets, &cursor->fb_id, 0)) {
-		ERROR_MSG("HW cursor: drmModeAddFB2 failed: %s",
-					strerror(errno));
-		armsoc_bo_unreference(cursor->bo);
+	/* the rest of the cache is allocated as images are loaded */
+	if (!drmmode_cursor_image_alloc(pScrn, &cursor->images[0])) {
 		free(cursor);
-		drmModeFreePlane(ovr);
-		drmModeFreePlaneResources(plane_resources);
+		drmmode_cursor_release_planes(pScrn);
 		return FALSE;
 	}
 
 	if (!xf86_cursors_init(pScreen, w, h, HARDWARE_CURSOR_ARGB)) {
 		ERROR_MSG("xf86_cursors_init() failed");
-		if (drmModeRmFB(drmmode->fd, cursor->fb_id))
-			ERROR_MSG("drmModeRmFB() failed");
-
-		armsoc_bo_unreference(cursor->bo);
+		drmmode_cursor_image_free(pScrn, &cursor->images[0]);
 		free(cursor);
-		drmModeFreePlane(ovr);
-		drmModeFreePlaneResources(plane_resources);
+		drmmode_cursor_release_planes(pScrn);
 		return FALSE;
 	}
 
 	INFO_MSG("HW cursor initialized");
 	drmmode->cursor = cursor;
-	drmModeFreePlaneResources(plane_resources);
 	return TRUE;
 }
 
@@ -764,7 +1245,7 @@ drmmode_cursor_init_standard(ScreenPtr pScreen)
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
 	struct drmmode_cursor_rec *cursor;
-	int w, h, pad;
+	int w, h;
 
 	if (drmmode->cursor) {
 		INFO_MSG("cursor already initialized");
@@ -786,27 +1267,16 @@ drmmode_cursor_init_standard(ScreenPtr pScreen)
 
 	w = pARMSOC->drmmode_interface->cursor_width;
 	h = pARMSOC->drmmode_interface->cursor_height;
-	pad = pARMSOC->drmmode_interface->cursor_padding;
-
-	/* allow for cursor padding in the bo */
-	cursor->bo  = armsoc_bo_new_with_dim(pARMSOC->dev,
-				w + 2 * pad, h,
-				0, 32, ARMSOC_BO_SCANOUT);
 
-	if (!cursor->bo) {
-		ERROR_MSG("HW cursor (standard): buffer allocation failed");
+	/* the rest of the cache is allocated as images are loaded */
+	if (!drmmode_cursor_image_alloc(pScrn, &cursor->images[0])) {
 		free(cursor);
 		return FALSE;
 	}
 
-	cursor->handle = armsoc_bo_handle(cursor->bo);
-
 	if (!xf86_cursors_init(pScreen, w, h, HARDWARE_CURSOR_ARGB)) {
 		ERROR_MSG("xf86_cursors_init() failed");
-		if (drmModeRmFB(drmmode->fd, cursor->fb_id))
-			ERROR_MSG("drmModeRmFB() failed");
-
-		armsoc_bo_unreference(cursor->bo);
+		drmmode_cursor_image_free(pScrn, &cursor->images[0]);
 		free(cursor);
 		return FALSE;
 	}
@@ -849,17 +1319,28 @@ void drmmode_cursor_fini(ScreenPtr pScreen)
 	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
 	struct drmmode_cursor_rec *cursor = drmmode->cursor;
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i;
 
 	if (!cursor)
 		return;
 
 	drmmode->cursor = NULL;
 	xf86_cursors_fini(pScreen);
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		struct drmmode_crtc_private_rec *drmmode_crtc =
+				xf86_config->crtc[i]->driver_private;
+
+		drmmode_crtc->cursor_image = NULL;
+		TimerFree(drmmode_crtc->cursor_timer);
+		drmmode_crtc->cursor_timer = NULL;
+		drmmode_crtc->cursor_flush_pending = FALSE;
+		drmmode_crtc->cursor_moved = FALSE;
+	}
+	for (i = 0; i < CURSOR_CACHE_SIZE; i++)
+		drmmode_cursor_image_free(pScrn, &cursor->images[i]);
 	if (pARMSOC->drmmode_interface->cursor_api == HWCURSOR_API_PLANE)
-		drmModeRmFB(drmmode->fd, cursor->fb_id);
-	armsoc_bo_unreference(cursor->bo);
-	if (pARMSOC->drmmode_interface->cursor_api == HWCURSOR_API_PLANE)
-		drmModeFreePlane(cursor->ovr);
+		drmmode_cursor_release_planes(pScrn);
 	free(cursor);
 }
 
@@ -882,6 +1363,60 @@ drmmode_gamma_set(xf86CrtcPtr crtc, CARD16 *red, CARD16 *green, CARD16 *blue,
 }
 #endif
 
+/*
+ * The shadow of a transformed crtc is an ordinary scanout pixmap, so
+ * the server's damage-limited redisplay composites into it through EXA
+ * and can use the blitter, rather than rendering into malloc'd memory.
+ * The pixmap doubles as the shadow "data" so set_mode_major can get
+ * its fb before xf86RotatePrepare calls shadow_create.
+ */
+static void *
+drmmode_shadow_allocate(xf86CrtcPtr crtc, int width, int height)
+{
+	ScrnInfoPtr pScrn = crtc->scrn;
+	ScreenPtr pScreen = pScrn->pScreen;
+	PixmapPtr pixmap;
+	struct armsoc_bo *bo;
+
+	pixmap = pScreen->CreatePixmap(pScreen, width, height, pScrn->depth,
+			ARMSOC_CREATE_PIXMAP_SCANOUT);
+	if (!pixmap) {
+		ERROR_MSG("Couldn't allocate shadow pixmap for rotated CRTC");
+		return NULL;
+	}
+
+	bo = ARMSOCPixmapBo(pixmap);
+	if (!bo || (!armsoc_bo_get_fb(bo) && armsoc_bo_add_fb(bo))) {
+		ERROR_MSG("Couldn't add framebuffer for rotated CRTC");
+		pScreen->DestroyPixmap(pixmap);
+		return NULL;
+	}
+
+	return pixmap;
+}
+
+static PixmapPtr
+drmmode_shadow_create(xf86CrtcPtr crtc, void *data, int width, int height)
+{
+	if (!data)
+		data = drmmode_shadow_allocate(crtc, width, height);
+
+	return data;
+}
+
+static void
+drmmode_shadow_destroy(xf86CrtcPtr crtc, PixmapPtr pixmap, void *data)
+{
+	ScreenPtr pScreen = crtc->scrn->pScreen;
+
+	if (!pixmap)
+		pixmap = data;
+
+	/* the bo removes its fb when the last reference goes */
+	if (pixmap)
+		pScreen->DestroyPixmap(pixmap);
+}
+
 static const xf86CrtcFuncsRec drmmode_crtc_funcs = {
 		.dpms = drmmode_crtc_dpms,
 		.set_mode_major = drmmode_set_mode_major,
@@ -889,12 +1424,101 @@ static const xf86CrtcFuncsRec drmmode_crtc_funcs = {
 		.show_cursor = drmmode_show_cursor,
 		.hide_cursor = drmmode_hide_cursor,
 		.load_cursor_argb = drmmode_load_cursor_argb,
+		.shadow_allocate = drmmode_shadow_allocate,
+		.shadow_create = drmmode_shadow_create,
+		.shadow_destroy = drmmode_shadow_destroy,
 #if 1 == ARMSOC_SUPPORT_GAMMA
 		.gamma_set = drmmode_gamma_set,
 #endif
 };
 
 
+/*
+ * Find the primary plane of crtc @num and the rotations its "rotation"
+ * property supports. Leaves rotation_prop_id 0 if there is none.
+ */
+static void
+drmmode_crtc_init_rotation(ScrnInfoPtr pScrn,
+		struct drmmode_crtc_private_rec *drmmode_crtc, int num)
+{
+	int fd = drmmode_crtc->drmmode->fd;
+	drmModePlaneRes *plane_resources;
+	struct drm_set_client_cap cap;
+	int i, j, k;
+
+	if (!xf86LoaderCheckSymbol("drmModeObjectGetProperties"))
+		return;
+
+	/* primary planes are only listed to universal plane clients */
+	cap.capability = DRM_CLIENT_CAP_UNIVERSAL_PLANES;
+	cap.value = 1;
+	if (drmIoctl(fd, DRM_IOCTL_SET_CLIENT_CAP, &cap) < 0)
+		return;
+
+	plane_resources = drmModeGetPlaneResources(fd);
+	if (!plane_resources)
+		return;
+
+	for (i = 0; i < plane_resources->count_planes &&
+			!drmmode_crtc->primary_plane_id; i++) {
+		drmModePlanePtr plane;
+		drmModeObjectPropertiesPtr props;
+		Bool primary = FALSE;
+		uint32_t rotation_prop_id = 0;
+		uint32_t rotations = 0;
+		uint32_t plane_rotation = 0;
+
+		plane = drmModeGetPlane(fd, plane_resources->planes[i]);
+		if (!plane)
+			continue;
+
+		if (!(plane->possible_crtcs & (1 << num))) {
+			drmModeFreePlane(plane);
+			continue;
+		}
+
+		props = drmModeObjectGetProperties(fd, plane->plane_id,
+				DRM_MODE_OBJECT_PLANE);
+		for (j = 0; props && j < props->count_props; j++) {
+			drmModePropertyPtr prop;
+
+			prop = drmModeGetProperty(fd, props->props[j]);
+			if (!prop)
+				continue;
+
+			if (!strcmp(prop->name, "type")) {
+				primary = props->prop_values[j] ==
+						DRM_PLANE_TYPE_PRIMARY;
+			} else if (!strcmp(prop->name, "rotation") &&
+				   (prop->flags & DRM_MODE_PROP_BITMASK)) {
+				rotation_prop_id = prop->prop_id;
+				plane_rotation = props->prop_values[j];
+				for (k = 0; k < prop->count_enums; k++)
+					rotations |= 1 << prop->enums[k].value;
+			}
+			drmModeFreeProperty(prop);
+		}
+
+		if (primary) {
+			drmmode_crtc->primary_plane_id = plane->plane_id;
+			drmmode_crtc->rotation_prop_id = rotation_prop_id;
+			drmmode_crtc->rotations = rotations;
+			drmmode_crtc->plane_rotation = plane_rotation;
+		}
+
+		if (props)
+			drmModeFreeObjectProperties(props);
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(plane_resources);
+
+	if (drmmode_crtc->rotation_prop_id)
+		INFO_MSG("CRTC %d (id: %d) supports rotations 0x%x",
+				num, drmmode_crtc->crtc_id,
+				drmmode_crtc->rotations);
+}
+
 static void
 drmmode_crtc_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode, int num)
 {
@@ -909,17 +1533,47 @@ drmmode_crtc_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode, int num)
 
 	drmmode_crtc = xnfcalloc(1, sizeof *drmmode_crtc);
 	drmmode_crtc->crtc_id = drmmode->mode_res->crtcs[num];
+	drmmode_crtc->index = num;
 	drmmode_crtc->drmmode = drmmode;
+	drmmode_crtc->cursor_event.type = DRMMODE_EVENT_CURSOR;
+	drmmode_crtc->cursor_event.crtc = crtc;
 	drmmode_crtc->last_good_mode = NULL;
 
 	INFO_MSG("Got CRTC: %d (id: %d)",
 			num, drmmode_crtc->crtc_id);
 	crtc->driver_private = drmmode_crtc;
 
+	drmmode_crtc_init_rotation(pScrn, drmmode_crtc, num);
+
 	TRACE_EXIT();
 	return;
 }
 
+/* Fetch the EDID blob of a connector, or NULL if it doesn't have one */
+static drmModePropertyBlobPtr
+drmmode_get_edid_blob(int fd, drmModeConnectorPtr connector)
+{
+	drmModePropertyBlobPtr edid_blob = NULL;
+	drmModePropertyPtr prop;
+	int i;
+
+	for (i = 0; i < connector->count_props; i++) {
+		prop = drmModeGetProperty(fd, connector->props[i]);
+		if (!prop)
+			continue;
+
+		if ((prop->flags & DRM_MODE_PROP_BLOB) &&
+		    !strcmp(prop->name, "EDID")) {
+			if (edid_blob)
+				drmModeFreePropertyBlob(edid_blob);
+			edid_blob = drmModeGetPropertyBlob(fd,
+					connector->prop_values[i]);
+		}
+		drmModeFreeProperty(prop);
+	}
+	return edid_blob;
+}
+
 static xf86OutputStatus
 drmmode_output_detect(xf86OutputPtr output)
 {
@@ -927,11 +1581,16 @@ drmmode_output_detect(xf86OutputPtr output)
 	struct drmmode_output_priv *drmmode_output = output->driver_private;
 	struct drmmode_rec *drmmode = drmmode_output->drmmode;
 	xf86OutputStatus status;
-	drmModeFreeConnector(drmmode_output->connector);
 
-	drmmode_output->connector =
-			drmModeGetConnector(drmmode->fd,
-					drmmode_output->output_id);
+	if (drmmode_output->connector_fresh) {
+		drmmode_output->connector_fresh = FALSE;
+	} else {
+		drmModeFreeConnector(drmmode_output->connector);
+		drmmode_output->connector =
+				drmModeGetConnector(drmmode->fd,
+						drmmode_output->output_id);
+		drmmode_output->edid_fresh = FALSE;
+	}
 
 	switch (drmmode_output->connector->connection) {
 	case DRM_MODE_CONNECTED:
@@ -966,26 +1625,21 @@ drmmode_output_get_modes(xf86OutputPtr output)
 	drmModeConnectorPtr connector = drmmode_output->connector;
 	struct drmmode_rec *drmmode = drmmode_output->drmmode;
 	DisplayModePtr modes = NULL;
-	drmModePropertyPtr prop;
+	drmModePropertyBlobPtr edid_blob;
 	xf86MonPtr ddc_mon = NULL;
 	int i;
 
-	/* look for an EDID property */
-	for (i = 0; i < connector->count_props; i++) {
-		prop = drmModeGetProperty(drmmode->fd, connector->props[i]);
-		if (!prop)
-			continue;
-
-		if ((prop->flags & DRM_MODE_PROP_BLOB) &&
-		    !strcmp(prop->name, "EDID")) {
+	if (drmmode_output->edid_fresh) {
+		/* already fetched by the probe thread */
+		drmmode_output->edid_fresh = FALSE;
+	} else {
+		edid_blob = drmmode_get_edid_blob(drmmode->fd, connector);
+		if (edid_blob) {
 			if (drmmode_output->edid_blob)
 				drmModeFreePropertyBlob(
 						drmmode_output->edid_blob);
-			drmmode_output->edid_blob =
-					drmModeGetPropertyBlob(drmmode->fd,
-						connector->prop_values[i]);
+			drmmode_output->edid_blob = edid_blob;
 		}
-		drmModeFreeProperty(prop);
 	}
 
 	if (drmmode_output->edid_blob)
@@ -1346,32 +2000,72 @@ const char *output_names[] = { "None",
 };
 #define NUM_OUTPUT_NAMES (sizeof(output_names) / sizeof(output_names[0]))
 
+/*
+ * Probing a connector can mean DDC reads taking tens of milliseconds.
+ * What PreInit fetches for a connector is kept with its output, so the
+ * first detect and get_modes don't probe it again.
+ */
+struct drmmode_probe {
+	int fd;
+	uint32_t connector_id;
+	drmModeConnectorPtr connector;
+	drmModeEncoderPtr *encoders;
+	drmModePropertyBlobPtr edid_blob;
+};
+
 static void
-drmmode_output_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode, int num)
+drmmode_probe_connector(struct drmmode_probe *probe)
 {
-	xf86OutputPtr output;
 	drmModeConnectorPtr connector;
-	drmModeEncoderPtr *encoders = NULL;
-	struct drmmode_output_priv *drmmode_output;
-	char name[32];
 	int i;
 
-	TRACE_ENTER();
-
-	connector = drmModeGetConnector(drmmode->fd, drmmode->mode_res->connectors[num]);
+	connector = drmModeGetConnector(probe->fd, probe->connector_id);
 	if (!connector)
-		goto exit;
+		return;
 
-	encoders = calloc(sizeof(drmModeEncoderPtr), connector->count_encoders);
-	if (!encoders)
+	probe->encoders = calloc(sizeof(drmModeEncoderPtr),
+			connector->count_encoders);
+	if (!probe->encoders)
 		goto free_connector_exit;
 
 	for (i = 0; i < connector->count_encoders; i++) {
-		encoders[i] = drmModeGetEncoder(drmmode->fd, connector->encoders[i]);
-		if (!encoders[i])
+		probe->encoders[i] = drmModeGetEncoder(probe->fd,
+				connector->encoders[i]);
+		if (!probe->encoders[i])
 			goto free_encoders_exit;
 	}
 
+	probe->edid_blob = drmmode_get_edid_blob(probe->fd, connector);
+	probe->connector = connector;
+	return;
+
+free_encoders_exit:
+	for (i = 0; i < connector->count_encoders; i++)
+		if (probe->encoders[i])
+			drmModeFreeEncoder(probe->encoders[i]);
+	free(probe->encoders);
+	probe->encoders = NULL;
+
+free_connector_exit:
+	drmModeFreeConnector(connector);
+}
+
+static void
+drmmode_output_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode,
+		struct drmmode_probe *probe)
+{
+	xf86OutputPtr output;
+	drmModeConnectorPtr connector = probe->connector;
+	drmModeEncoderPtr *encoders = probe->encoders;
+	struct drmmode_output_priv *drmmode_output;
+	char name[32];
+	int i;
+
+	TRACE_ENTER();
+
+	if (!connector)
+		goto exit;
+
 	if (connector->connector_type >= NUM_OUTPUT_NAMES)
 		snprintf(name, 32, "Unknown%d-%d", connector->connector_type, connector->connector_type_id);
 	else
@@ -1387,9 +2081,12 @@ drmmode_output_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode, int num)
 		goto free_encoders_exit;
 	}
 
-	drmmode_output->output_id = drmmode->mode_res->connectors[num];
+	drmmode_output->output_id = probe->connector_id;
 	drmmode_output->connector = connector;
 	drmmode_output->encoders = encoders;
+	drmmode_output->edid_blob = probe->edid_blob;
+	drmmode_output->connector_fresh = TRUE;
+	drmmode_output->edid_fresh = TRUE;
 	drmmode_output->drmmode = drmmode;
 
 	output->mm_width = connector->mmWidth;
@@ -1418,8 +2115,11 @@ drmmode_output_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode, int num)
 free_encoders_exit:
 	for (i = 0; i < connector->count_encoders; i++)
 		drmModeFreeEncoder(encoders[i]);
+	free(encoders);
+
+	if (probe->edid_blob)
+		drmModeFreePropertyBlob(probe->edid_blob);
 
-free_connector_exit:
 	drmModeFreeConnector(connector);
 
 exit:
@@ -1427,6 +2127,39 @@ exit:
 	return;
 
 }
+
+/*
+ * Probe count connectors starting at index first and create their
+ * outputs, in connector order.
+ */
+static Bool
+drmmode_outputs_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode,
+		int first, int count)
+{
+	struct drmmode_probe *probes;
+	int i;
+
+	if (count == 0)
+		return TRUE;
+
+	probes = calloc(count, sizeof(*probes));
+	if (!probes) {
+		ERROR_MSG("Couldn't allocate connector probes");
+		return FALSE;
+	}
+
+	for (i = 0; i < count; i++) {
+		probes[i].fd = drmmode->fd;
+		probes[i].connector_id =
+				drmmode->mode_res->connectors[first + i];
+		drmmode_probe_connector(&probes[i]);
+		drmmode_output_init(pScrn, drmmode, &probes[i]);
+	}
+
+	free(probes);
+	return TRUE;
+}
+
 static void
 drmmode_clones_init(ScrnInfoPtr pScrn, struct drmmode_rec *drmmode)
 {
@@ -1494,7 +2227,13 @@ void set_scanout_bo(ScrnInfoPtr pScrn, struct armsoc_bo *bo)
 		armsoc_bo_unreference(old_scanout); /* Screen drops ref on old scanout bo */
 }
 
-static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height)
+/*
+ * Resize the scanout for a new screen size. If the scanout bo is only
+ * re-described, its previous fb is returned in old_fb_id for the caller
+ * to remove after the CRTCs have been moved to the new one.
+ */
+static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height,
+		uint32_t *old_fb_id)
 {
 	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
 	ScreenPtr pScreen = pScrn->pScreen;
@@ -1503,6 +2242,8 @@ static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height)
 
 	TRACE_ENTER();
 
+	*old_fb_id = 0;
+
 	depth = armsoc_bo_depth(pARMSOC->scanout);
 	bpp = armsoc_bo_bpp(pARMSOC->scanout);
 	DEBUG_MSG("Resize: %dx%d %d,%d", width, height, depth, bpp);
@@ -1515,7 +2256,18 @@ static Bool resize_scanout_bo(ScrnInfoPtr pScrn, int width, int height)
 	pScrn->virtualX = width;
 	pScrn->virtualY = height;
 
-	if ((width != armsoc_bo_width(pARMSOC->scanout)) ||
+	if (pARMSOC->ScanoutHeadroom &&
+		((width != armsoc_bo_width(pARMSOC->scanout)) ||
+		(height != armsoc_bo_height(pARMSOC->scanout))) &&
+		!armsoc_bo_resize_fb(pARMSOC->scanout, width, height,
+				old_fb_id)) {
+		/* The scanout was allocated with room for the new size:
+		 * keep using it, along with its contents.
+		 */
+		DEBUG_MSG("re-described scanout buffer in place");
+		pitch = armsoc_bo_pitch(pARMSOC->scanout);
+		pScrn->displayWidth = pitch / ((pScrn->bitsPerPixel + 7) / 8);
+	} else if ((width != armsoc_bo_width(pARMSOC->scanout)) ||
 		(height != armsoc_bo_height(pARMSOC->scanout))) {
 		struct armsoc_bo *new_scanout;
 
@@ -1637,9 +2389,10 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 {
 	int i;
 	xf86CrtcConfigPtr xf86_config;
+	uint32_t old_fb_id;
 
 	TRACE_ENTER();
-	if (!resize_scanout_bo(pScrn, width, height))
+	if (!resize_scanout_bo(pScrn, width, height, &old_fb_id))
 		goto fail;
 
 	/* Framebuffer needs to be reset on all CRTCs, not just
@@ -1655,6 +2408,10 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 				crtc->rotation, crtc->x, crtc->y);
 	}
 
+	/* Nothing scans out the previous fb of a re-described scanout now */
+	if (old_fb_id)
+		drmModeRmFB(drmmode_from_scrn(pScrn)->fd, old_fb_id);
+
 	TRACE_EXIT();
 	return TRUE;
 
@@ -1722,13 +2479,14 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, int fd, int cpp)
 	if (ARMSOCPTR(pScrn)->crtcNum != -1) {
 		if (ARMSOCPTR(pScrn)->crtcNum <
 				drmmode->mode_res->count_connectors)
-			drmmode_output_init(pScrn,
-					drmmode, ARMSOCPTR(pScrn)->crtcNum);
+			drmmode_outputs_init(pScrn,
+					drmmode, ARMSOCPTR(pScrn)->crtcNum, 1);
 		else
 			return FALSE;
 	} else {
-		for (i = 0; i < drmmode->mode_res->count_connectors; i++)
-			drmmode_output_init(pScrn, drmmode, i);
+		if (!drmmode_outputs_init(pScrn, drmmode, 0,
+				drmmode->mode_res->count_connectors))
+			return FALSE;
 	}
 	drmmode_clones_init(pScrn, drmmode);
 
@@ -1752,6 +2510,126 @@ drmmode_adjust_frame(ScrnInfoPtr pScrn, int x, int y)
 	drmmode_set_mode_major(crtc, &crtc->mode, crtc->rotation, x, y);
 }
 
+/*
+ * Size of a screen that can place every connected output side by side at
+ * its largest mode, in either landscape or portrait orientation. Used to
+ * give the scanout enough headroom that RandR changes never reallocate it.
+ */
+void
+drmmode_get_max_size(ScrnInfoPtr pScrn, int *width, int *height)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int sum_w = 0, sum_h = 0, max_w = 0, max_h = 0;
+	int i;
+
+	for (i = 0; i < xf86_config->num_output; i++) {
+		xf86OutputPtr output = xf86_config->output[i];
+		DisplayModePtr mode;
+		int mode_w = 0, mode_h = 0;
+
+		if (output->status != XF86OutputStatusConnected)
+			continue;
+
+		for (mode = output->probed_modes; mode; mode = mode->next) {
+			mode_w = max(mode_w, mode->HDisplay);
+			mode_h = max(mode_h, mode->VDisplay);
+		}
+		sum_w += mode_w;
+		sum_h += mode_h;
+		max_w = max(max_w, mode_w);
+		max_h = max(max_h, mode_h);
+	}
+
+	*width = min(max(sum_w, sum_h), xf86_config->maxWidth);
+	*height = min(max(max_w, max_h), xf86_config->maxHeight);
+}
+
+/*
+ * Whether any enabled CRTC shows the screen through a transform the
+ * server applies, scanning out its shadow rather than the screen's fb.
+ * Flipping the screen's fb would bypass the shadow, so DRI2 swaps must
+ * exchange or blit instead. Rotations the plane applies don't count.
+ */
+Bool
+drmmode_crtcs_shadowed(ScrnInfoPtr pScrn)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i;
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+
+		if (!crtc->enabled)
+			continue;
+		if (crtc->rotatedData)
+			return TRUE;
+#if XF86_CRTC_VERSION >= 7
+		if (crtc->driverIsPerformingTransform !=
+				XF86DriverTransformNone)
+			continue;
+#endif
+		if (crtc->transformPresent || crtc->rotation != RR_Rotate_0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Import the framebuffer that one of our CRTCs is scanning out when the
+ * server starts, typically left there by the bootloader or fbcon, so its
+ * contents can be carried over into our scanout. On return x, y, width
+ * and height give the part of it that is visible.
+ */
+struct armsoc_bo *
+drmmode_get_current_fb(ScrnInfoPtr pScrn, int *x, int *y,
+		int *width, int *height)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	struct ARMSOCRec *pARMSOC = ARMSOCPTR(pScrn);
+	struct drmmode_rec *drmmode = drmmode_from_scrn(pScrn);
+	struct armsoc_bo *bo = NULL;
+	drmModeCrtcPtr kcrtc;
+	drmModeFBPtr fb;
+	int i;
+
+	for (i = 0; i < xf86_config->num_crtc && !bo; i++) {
+		struct drmmode_crtc_private_rec *drmmode_crtc =
+				xf86_config->crtc[i]->driver_private;
+
+		kcrtc = drmModeGetCrtc(drmmode->fd, drmmode_crtc->crtc_id);
+		if (!kcrtc)
+			continue;
+
+		if (!kcrtc->buffer_id || !kcrtc->mode_valid) {
+			drmModeFreeCrtc(kcrtc);
+			continue;
+		}
+
+		fb = drmModeGetFB(drmmode->fd, kcrtc->buffer_id);
+		/* handle is 0 if we aren't allowed to access the buffer */
+		if (fb && fb->handle) {
+			bo = armsoc_bo_from_handle(pARMSOC->dev, fb->handle,
+					fb->width, fb->height, fb->depth,
+					fb->bpp, fb->pitch);
+			if (bo) {
+				*x = kcrtc->x;
+				*y = kcrtc->y;
+				*width = min(kcrtc->width, fb->width - kcrtc->x);
+				*height = min(kcrtc->height,
+						fb->height - kcrtc->y);
+				INFO_MSG("Inheriting %dx%d fb %d from CRTC %d",
+						fb->width, fb->height,
+						fb->fb_id, kcrtc->crtc_id);
+			}
+		}
+		drmModeFreeFB(fb);
+		drmModeFreeCrtc(kcrtc);
+	}
+
+	return bo;
+}
+
 /*
  * Page Flipping
  */
@@ -1760,13 +2638,21 @@ static void
 page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
 		unsigned int tv_usec, void *user_data)
 {
-	ARMSOCDRI2SwapComplete(user_data);
+	ARMSOC_TRACE(page_flip_done, "cmd=%p sequence=%u", user_data, sequence);
+	ARMSOCDRI2FlipComplete(user_data, sequence, tv_sec, tv_usec);
 }
 
 static void
 vblank_handler(int fd, unsigned int sequence, unsigned int tv_sec,
 		unsigned int tv_usec, void *user_data)
 {
+	struct drmmode_event *event = user_data;
+
+	if (event->type == DRMMODE_EVENT_CURSOR) {
+		drmmode_cursor_flush(event->crtc);
+		return;
+	}
+
 	ARMSOCDRI2VBlankHandler(sequence, tv_sec, tv_usec, user_data);
 }
 
@@ -1800,6 +2686,8 @@ drmmode_page_flip(DrawablePtr draw, uint32_t fb_id, void *priv)
 
 		ret = drmModePageFlip(mode->fd, crtc->crtc_id,
 				fb_id, flags, priv);
+		ARMSOC_TRACE(page_flip, "cmd=%p crtc=%u fb=%u ret=%d", priv,
+				crtc->crtc_id, fb_id, ret);
 		if (ret) {
 			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
 					"flip queue failed: %s\n",
@@ -94,12 +94,26 @@ struct drmmode_interface {
 	 *
 	 * A driver specific ioctl() is usually needed to create GEM objects
 	 * with particular features such as contiguous memory, uncached, etc...
+	 * create_gem->cache_type is only a hint and may be ignored by
+	 * drivers that have no control over caching, e.g. dumb buffers.
 	 *
 	 * @param       fd             DRM device file descriptor
 	 * @param       create_gem     generic GEM description
 	 * @return 0 on success, non-zero on failure
 	 */
 	int (*create_custom_gem)(int fd, struct armsoc_create_gem *create_gem);
+
+	/* (Optional) Pitch of a buffer created by create_custom_gem
+	 *
+	 * Lets an existing buffer be re-described in place for a new size
+	 * with the pitch the driver would have chosen. If omitted, a pitch
+	 * aligned to 64 bytes is assumed.
+	 *
+	 * @param       width          width in pixels
+	 * @param       bpp            bits per pixel
+	 * @return pitch in bytes
+	 */
+	uint32_t (*get_pitch)(uint32_t width, uint32_t bpp);
 };
 
 extern struct drmmode_interface exynos_interface;
@@ -112,14 +112,19 @@ static int init_plane_for_cursor(int drm_fd, uint32_t plane_id)
 	return res;
 }
 
+static uint32_t get_pitch(uint32_t width, uint32_t bpp)
+{
+	/* make pitch a multiple of 64 bytes for best performance */
+	return ALIGN(width * ((bpp + 7) / 8), 64);
+}
+
 static int create_custom_gem(int fd, struct armsoc_create_gem *create_gem)
 {
 	struct drm_exynos_gem_create create_exynos;
 	int ret;
 	unsigned int pitch;
 
-	/* make pitch a multiple of 64 bytes for best performance */
-	pitch = ALIGN(create_gem->width * ((create_gem->bpp + 7) / 8), 64);
+	pitch = get_pitch(create_gem->width, create_gem->bpp);
 	memset(&create_exynos, 0, sizeof(create_exynos));
 	create_exynos.size = create_gem->height * pitch;
 
@@ -132,6 +137,22 @@ static int create_custom_gem(int fd, struct armsoc_create_gem *create_gem)
 	 */
 	create_exynos.flags = EXYNOS_BO_NONCONTIG;
 
+	/* Scanouts stay uncached so the display never sees stale lines */
+	if (create_gem->buf_type == ARMSOC_BO_NON_SCANOUT) {
+		switch (create_gem->cache_type) {
+		case ARMSOC_CACHE_CACHED:
+			create_exynos.flags |= EXYNOS_BO_CACHABLE;
+			break;
+		case ARMSOC_CACHE_WRITECOMBINE:
+			create_exynos.flags |= EXYNOS_BO_WC;
+			break;
+		case ARMSOC_CACHE_DEFAULT:
+		case ARMSOC_CACHE_UNCACHED:
+			create_exynos.flags |= EXYNOS_BO_NONCACHABLE;
+			break;
+		}
+	}
+
 	ret = drmIoctl(fd, DRM_IOCTL_EXYNOS_GEM_CREATE, &create_exynos);
 	if (ret)
 		return ret;
@@ -155,4 +176,5 @@ struct drmmode_interface exynos_interface = {
 	init_plane_for_cursor /* init_plane_for_cursor */,
 	0                     /* vblank_query_supported */,
 	create_custom_gem     /* create_custom_gem */,
+	get_pitch             /* get_pitch */,
 };
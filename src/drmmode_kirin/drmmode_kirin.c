@@ -54,14 +54,19 @@ DEALINGS IN THE
 
 #define ALIGN(val, align)      (((val) + (align) - 1) & ~((align) - 1))
 
+static uint32_t get_pitch(uint32_t width, uint32_t bpp)
+{
+	/* For 32bpp mali 450GPU needs pitch 8 bytes alignment */
+	return ALIGN(width * ((bpp + 7) / 8), 8);
+}
+
 static int create_custom_gem(int fd, struct armsoc_create_gem *create_gem)
 {
 	struct drm_mode_create_dumb arg;
 	unsigned int pitch;
 	int ret;
 
-	/* For 32bpp mali 450GPU needs pitch 8 bytes alignment */
-	pitch = ALIGN(create_gem->width * ((create_gem->bpp + 7) / 8), 8);
+	pitch = get_pitch(create_gem->width, create_gem->bpp);
 	memset(&arg, 0, sizeof(arg));
 	arg.width = create_gem->width;
 	arg.height = create_gem->height;
@@ -91,5 +96,6 @@ struct drmmode_interface kirin_interface = {
 	NULL                  /* no plane for cursor */,
 	0                     /* vblank_query_supported */,
 	create_custom_gem     /* create_custom_gem */,
+	get_pitch             /* get_pitch */,
 };
 
@@ -87,6 +87,10 @@ static int create_custom_gem(int fd, struct armsoc_create_gem *create_gem)
 
 	if (create_gem->buf_type == ARMSOC_BO_SCANOUT)
 		create_pl111.flags = PL111_BOT_DMA | PL111_BOT_UNCACHED;
+#ifdef PL111_BOT_CACHED
+	else if (create_gem->cache_type == ARMSOC_CACHE_CACHED)
+		create_pl111.flags = PL111_BOT_SHM | PL111_BOT_CACHED;
+#endif
 	else
 		create_pl111.flags = PL111_BOT_SHM | PL111_BOT_UNCACHED;
 
@@ -48,7 +48,8 @@ static int create_custom_gem(int fd, struct armsoc_create_gem *create_gem)
 	/*
 	 * provide a method of creating both scanout and non-scanout GEM
 	 * objects here. This method is usually a custom ioctl() call to
-	 * the DRM driver.
+	 * the DRM driver. create_gem->cache_type may be mapped onto the
+	 * driver's caching flags, or ignored.
 	 */
 }
 
@@ -63,4 +64,5 @@ struct drmmode_interface template_interface = {
 	init_plane_for_cursor /* init_plane_for_cursor */,
 	0                     /* vblank_query_supported */,
 	create_custom_gem     /* create_custom_gem */,
+	NULL                  /* get_pitch */,
 };
@@ -34,6 +34,8 @@
 #include <uapi/drm/exynos_drm.h>
 #include "fimg2d_reg.h"
 #include "exynos_fimg2d.h"
+#include "armsoc_perf.h"
+#include "armsoc_trace.h"
 
 #define		SET_BF(val, sc, si, scsa, scda, dc, di, dcsa, dcda) \
 			val.data.src_coeff = sc;		\
@@ -362,8 +364,12 @@ static int g2d_flush(struct g2d_context *ctx)
 	ctx->cmd_nr = 0;
 	ctx->cmd_buf_nr = 0;
 
+	ARMSOC_PERF_INC(ARMSOC_PERF_G2D_CMDLIST);
+	ARMSOC_TRACE(g2d_flush, "cmd_nr=%u cmd_buf_nr=%u",
+			cmdlist.cmd_nr, cmdlist.cmd_buf_nr);
 	ret = drmIoctl(ctx->fd, DRM_IOCTL_EXYNOS_G2D_SET_CMDLIST, &cmdlist);
 	if (ret < 0) {
+		ARMSOC_PERF_INC(ARMSOC_PERF_G2D_ERRORS);
 		fprintf(stderr, MSG_PREFIX "failed to set cmdlist.\n");
 		return ret;
 	}
@@ -442,8 +448,12 @@ int g2d_exec(struct g2d_context *ctx)
 
 	exec.async = 0;
 
+	ARMSOC_PERF_INC(ARMSOC_PERF_G2D_EXEC);
+	ARMSOC_TRACE(g2d_exec_begin, "cmdlist_nr=%u", ctx->cmdlist_nr);
 	ret = drmIoctl(ctx->fd, DRM_IOCTL_EXYNOS_G2D_EXEC, &exec);
+	ARMSOC_TRACE(g2d_exec_end, "ret=%d", ret);
 	if (ret < 0) {
+		ARMSOC_PERF_INC(ARMSOC_PERF_G2D_ERRORS);
 		fprintf(stderr, MSG_PREFIX "failed to execute.\n");
 		return ret;
 	}
@@ -717,6 +727,13 @@ g2d_move(struct g2d_context *ctx, struct g2d_image *img,
  * @dst_h: height value to destination buffer.
  * @negative: indicate that it uses color negative to source and
  *	destination buffers.
+ *
+ * The source is sampled with src->scale_mode (bilinear if unset) when the
+ * sizes differ. It is mirrored when src->x_dir/src->y_dir are set and then
+ * rotated by 90 degrees clockwise when src->rotate_90 is set, in which
+ * case dst_w/dst_h are the rotated extents (i.e. compare to src_h/src_w).
+ * Only the part of the destination inside dst->cw_x1..cw_x2 and
+ * dst->cw_y1..cw_y2 is written when dst->cw_en is set.
  */
 int
 g2d_copy_with_scale(struct g2d_context *ctx, struct g2d_image *src,
@@ -728,19 +745,29 @@ g2d_copy_with_scale(struct g2d_context *ctx, struct g2d_image *src,
 {
 	union g2d_rop4_val rop4;
 	union g2d_point_val pt;
-	unsigned int scale, repeat_pad;
+	union g2d_direction_val dir;
+	union g2d_bitblt_cmd_val bitblt;
+	unsigned int scale, repeat_pad, transform, clip;
 	unsigned int scale_x, scale_y;
+	unsigned int rot_w, rot_h;
 
 	/* Sanitize this parameter to facilitate space computation below. */
 	if (negative)
 		negative = 1;
 
-	if (src_w == dst_w && src_h == dst_h)
+	transform = (src->rotate_90 || src->x_dir || src->y_dir) ? 1 : 0;
+	clip = dst->cw_en ? 1 : 0;
+
+	/* the scaler works on the source axes, before the rotation */
+	rot_w = src->rotate_90 ? dst_h : dst_w;
+	rot_h = src->rotate_90 ? dst_w : dst_h;
+
+	if (src_w == rot_w && src_h == rot_h)
 		scale = 0;
 	else {
 		scale = 1;
-		scale_x = g2d_get_scaling(src_w, dst_w);
-		scale_y = g2d_get_scaling(src_h, dst_h);
+		scale_x = g2d_get_scaling(src_w, rot_w);
+		scale_y = g2d_get_scaling(src_h, rot_h);
 	}
 
 	repeat_pad = src->repeat_mode == G2D_REPEAT_MODE_PAD ? 1 : 0;
@@ -760,7 +787,8 @@ g2d_copy_with_scale(struct g2d_context *ctx, struct g2d_image *src,
 		return -EINVAL;
 	}
 
-	if (g2d_check_space(ctx, 12 + scale * 3 + negative + repeat_pad, 2))
+	if (g2d_check_space(ctx, 12 + scale * 3 + negative + repeat_pad +
+			transform * 3 + clip * 3, 2))
 		return -ENOSPC;
 
 	g2d_add_cmd(ctx, DST_SELECT_REG, G2D_SELECT_MODE_BGCOLOR);
@@ -799,11 +827,39 @@ g2d_copy_with_scale(struct g2d_context *ctx, struct g2d_image *src,
 	g2d_add_cmd(ctx, ROP4_REG, rop4.val);
 
 	if (scale) {
-		g2d_add_cmd(ctx, SRC_SCALE_CTRL_REG, G2D_SCALE_MODE_BILINEAR);
+		g2d_add_cmd(ctx, SRC_SCALE_CTRL_REG,
+			src->scale_mode != G2D_SCALE_MODE_NONE ?
+			src->scale_mode : G2D_SCALE_MODE_BILINEAR);
 		g2d_add_cmd(ctx, SRC_XSCALE_REG, scale_x);
 		g2d_add_cmd(ctx, SRC_YSCALE_REG, scale_y);
 	}
 
+	if (transform) {
+		/* the register file is reset for every command list, so
+		 * this doesn't leak into later blits */
+		g2d_add_cmd(ctx, ROTATE_REG, src->rotate_90 ? 1 : 0);
+
+		dir.val[0] = dir.val[1] = 0;
+		dir.data.src_x_direction = src->x_dir ?
+			G2D_DIR_MODE_NEGATIVE : G2D_DIR_MODE_POSITIVE;
+		dir.data.src_y_direction = src->y_dir ?
+			G2D_DIR_MODE_NEGATIVE : G2D_DIR_MODE_POSITIVE;
+		g2d_set_direction(ctx, &dir);
+	}
+
+	if (clip) {
+		pt.data.x = dst->cw_x1;
+		pt.data.y = dst->cw_y1;
+		g2d_add_cmd(ctx, CW_LT_REG, pt.val);
+		pt.data.x = dst->cw_x2;
+		pt.data.y = dst->cw_y2;
+		g2d_add_cmd(ctx, CW_RB_REG, pt.val);
+
+		bitblt.val = 0;
+		bitblt.data.cw_en = 1;
+		g2d_add_cmd(ctx, BITBLT_COMMAND_REG, bitblt.val);
+	}
+
 	pt.data.x = src_x;
 	pt.data.y = src_y;
 	g2d_add_cmd(ctx, SRC_LEFT_TOP_REG, pt.val);
@@ -275,6 +275,12 @@ struct g2d_image {
 	unsigned char			x_dir;
 	unsigned char			y_dir;
 	unsigned char			component_alpha;
+	/* clipping window of a destination, see g2d_copy_with_scale() */
+	unsigned char			cw_en;
+	unsigned int			cw_x1;
+	unsigned int			cw_y1;
+	unsigned int			cw_x2;
+	unsigned int			cw_y2;
 	unsigned int			width;
 	unsigned int			height;
 	unsigned int			stride;